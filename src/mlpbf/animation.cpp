@@ -48,7 +48,7 @@ Animation::Animation( const TiXmlElement& elem ) :
 	m_numFrames = attribute( elem, "frames" );
 	m_frameTime = attribute( elem, "frame_time" );
 
-	loadTexture( xml::attribute( elem, "image" ) );
+	loadRegion( xml::attribute( elem, "image" ) );
 
 	// Optional
 
@@ -65,14 +65,14 @@ void Animation::update( sf::Sprite& sprite, unsigned frame ) const
 	frame = std::min( m_numFrames - 1, std::max( frame, 0U ) );
 
 	sprite.scale( ( m_flip ) ? -1.0f : 1.0f, 1.0f );
-	sprite.setTexture( getTexture() );
+	sprite.setTexture( *getRegion().texture );
 
 	sprite.setOrigin( m_dim.x / 2.0f, m_dim.y / 2.0f );
 
 	// Get the subrect to draw
 	sf::IntRect subrect;
-	subrect.left	= frame * m_dim.x;
-	subrect.top		= 0;
+	subrect.left	= getRegion().rect.left + frame * m_dim.x;
+	subrect.top		= getRegion().rect.top;
 	subrect.width	= m_dim.x;
 	subrect.height	= m_dim.y;
 
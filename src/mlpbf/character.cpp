@@ -60,21 +60,24 @@ inline sf::Vector2f getMoveSpeed( MoveSpeed m, Direction d )
 	throw Exception( "getMoveSpeed could not generate a move speed" );
 }
 
-sf::Vector2u convert( const sf::Vector2f& pos )
-{
-	return sf::Vector2u( (int) pos.x / TILE_WIDTH, (int) pos.y / TILE_HEIGHT );
-}
-
 /***************************************************************************/
 
 Character::Character( const std::string& spritesheet ) :
+	m_name( spritesheet ),
 	m_mapID( 0U ),
-	m_checkCollision( true )
+	m_checkCollision( true ),
+	m_placedMap( nullptr )
 {
 	m_sheet.load( spritesheet );
 	setMovement( Idle, Down );
 }
 
+Character::~Character()
+{
+	if ( m_placedMap )
+		m_placedMap->removeCharacter( *this );
+}
+
 /***************************************************************************/
 
 void Character::setMap( const std::string& map )
@@ -95,104 +98,23 @@ void Character::update( const sf::Time& time )
 	const Map& m = db::getMap( m_mapID );
 
 	sf::Vector2f move = std::get< 1 >( m_move ) * ( time.asMilliseconds() / 10.0f );
-	if ( move == sf::Vector2f( 0.0f, 0.0f ) ) return;
-
-	// Move the character bounds
-	sf::FloatRect bound = getBounds();
+	if ( move == sf::Vector2f( 0.0f, 0.0f ) )
+	{
+		place();
+		return;
+	}
 
-	// Check for collision depending on direction
+	// Slide the character bounds through the map and the other characters
 	if ( m_checkCollision )
 	{
-		sf::Vector2f checkA, checkB;
-		bool collision = false;
-	
-		//TODO: factor out code
-		switch ( std::get< 0 >( m_move ) )
-		{
-		case Up: // Top-left and top-right
-			checkA = sf::Vector2f( bound.left, bound.top + move.y );
-			checkB = sf::Vector2f( bound.left + bound.width, checkA.y );
-
-			while ( m.checkTileCollision( convert( checkA ) ) || m.checkObjectCollision( checkA ) ||
-					m.checkTileCollision( convert( checkB ) ) || m.checkObjectCollision( checkB ) )
-			{
-				if ( !collision )
-				{
-					checkA.y = checkB.y = std::floor( checkB.y / TILE_HEIGHT ) * TILE_HEIGHT + 1.0f;
-					collision = true;
-				}
-				else
-					checkA.y = checkB.y += TILE_HEIGHT;
-			}
-
-			bound.top = checkA.y;
-		break;
-
-		case Down: // Bottom-left and bottom-right
-			checkA = sf::Vector2f( bound.left, bound.top + bound.height + move.y );
-			checkB = sf::Vector2f( bound.left + bound.width, checkA.y );
-
-			while ( m.checkTileCollision( convert( checkA ) ) || m.checkObjectCollision( checkA ) ||
-					m.checkTileCollision( convert( checkB ) ) || m.checkObjectCollision( checkB ) )
-			{
-				if ( !collision )
-				{
-					checkA.y = checkB.y = std::ceil( checkB.y / TILE_HEIGHT ) * TILE_HEIGHT - 1.0f;
-					collision = true;
-				}
-				else
-					checkA.y = checkB.y += -TILE_HEIGHT;
-			}
-
-			bound.top = checkA.y - bound.height;
-		break;
-
-		case Left: // Top-left and bottom-left
-			checkA = sf::Vector2f( bound.left + move.x, bound.top ); 
-			checkB = sf::Vector2f( checkA.x, bound.top + bound.height );
-
-			while ( m.checkTileCollision( convert( checkA ) ) || m.checkObjectCollision( checkA ) ||
-					m.checkTileCollision( convert( checkB ) ) || m.checkObjectCollision( checkB ) )
-			{
-				if ( !collision )
-				{
-					checkA.x = checkB.x = std::floor( checkB.x / TILE_WIDTH ) * TILE_WIDTH + 1.0f;
-					collision = true;
-				}
-				else
-					checkA.x = checkB.x += TILE_WIDTH;
-			}
-
-			bound.left = checkA.x;
-		break;
-
-		case Right:	// Top-right and bottom-right
-			checkA = sf::Vector2f( bound.left + bound.width + move.x, bound.top );
-			checkB = sf::Vector2f( checkA.x, bound.top + bound.height );
-
-			while ( m.checkTileCollision( convert( checkA ) ) || m.checkObjectCollision( checkA ) ||
-					m.checkTileCollision( convert( checkB ) ) || m.checkObjectCollision( checkB ) )
-			{
-				if ( !collision )
-				{
-					checkA.x = checkB.x = std::ceil( checkB.x / TILE_WIDTH ) * TILE_WIDTH - 1.0f;
-					collision = true;
-				}
-				else
-					checkA.x = checkB.x += -TILE_WIDTH;
-			}
-
-			bound.left = checkA.x - bound.width;
-		break;
-		}
+		const Map::Sweep sweep = m.sweep( getBounds(), move, this );
+		bool collision = sweep.time < 1.0f;
 
 		if ( collision )
 			setMovement( Idle, std::get< 0 >( m_move ) );
 
 		std::get< 2 >( m_move ) = collision;
-		
-		m_pos.x = bound.left + ( bound.width / 2.0f );
-		m_pos.y = bound.top + ( bound.height / 2.0f );
+		m_pos += sweep.delta;
 	}
 	else
 		m_pos += move;
@@ -223,6 +145,19 @@ void Character::update( const sf::Time& time )
 		m_pos.x = m_pos.x - ( curMap.getWidth() * TILE_WIDTH );
 		m_pos.y = m_pos.y + ( curMap.getNeighborOffset( Right ) * TILE_HEIGHT );
 	}
+
+	place();
+}
+
+void Character::place()
+{
+	Map& map = db::getMap( m_mapID );
+
+	if ( m_placedMap && m_placedMap != &map )
+		m_placedMap->removeCharacter( *this );
+
+	map.placeCharacter( *this );
+	m_placedMap = &map;
 }
 
 void Character::setMovement( MoveSpeed m, Direction d )
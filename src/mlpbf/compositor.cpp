@@ -0,0 +1,160 @@
+#include "mlpbf/graphics/compositor.h"
+#include "mlpbf/graphics/tile_mesh.h"
+#include "mlpbf/exception.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace bf
+{
+namespace gfx
+{
+
+// x / 255 rounded to the nearest integer for x in [0, 255 * 255]
+inline unsigned div255( unsigned x )
+{
+	x += 128U;
+	return ( x + ( x >> 8 ) ) >> 8;
+}
+
+// The alpha channel blends like the colours with a source value of 255
+inline void blendPixel( sf::Uint8 * dst, const sf::Uint8 * src )
+{
+	const unsigned a = src[ 3 ], ia = 255U - a;
+
+	dst[ 0 ] = (sf::Uint8) div255( src[ 0 ] * a + dst[ 0 ] * ia );
+	dst[ 1 ] = (sf::Uint8) div255( src[ 1 ] * a + dst[ 1 ] * ia );
+	dst[ 2 ] = (sf::Uint8) div255( src[ 2 ] * a + dst[ 2 ] * ia );
+	dst[ 3 ] = (sf::Uint8) div255( 255U * a + dst[ 3 ] * ia );
+}
+
+#ifdef __SSE2__
+// Blends two pixels widened to 16 bits per channel, with the same rounding as blendPixel
+inline __m128i blendWide( __m128i src, __m128i dst )
+{
+	const __m128i full = _mm_set1_epi16( 255 );
+	const __m128i alphaLanes = _mm_set_epi16( -1, 0, 0, 0, -1, 0, 0, 0 );
+
+	const __m128i a = _mm_shufflehi_epi16( _mm_shufflelo_epi16( src, _MM_SHUFFLE( 3, 3, 3, 3 ) ), _MM_SHUFFLE( 3, 3, 3, 3 ) );
+	const __m128i ia = _mm_sub_epi16( full, a );
+	src = _mm_or_si128( _mm_andnot_si128( alphaLanes, src ), _mm_and_si128( alphaLanes, full ) );
+
+	// At most 255 * 255 + 128, which still fits an unsigned 16 bit lane
+	__m128i x = _mm_add_epi16( _mm_add_epi16( _mm_mullo_epi16( src, a ), _mm_mullo_epi16( dst, ia ) ), _mm_set1_epi16( 128 ) );
+	return _mm_srli_epi16( _mm_add_epi16( x, _mm_srli_epi16( x, 8 ) ), 8 );
+}
+#endif
+
+void blendPixels( sf::Uint8 * dst, const sf::Uint8 * src, std::size_t count )
+{
+	std::size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		const __m128i s = _mm_loadu_si128( reinterpret_cast< const __m128i* >( src + i * 4 ) );
+		const __m128i d = _mm_loadu_si128( reinterpret_cast< const __m128i* >( dst + i * 4 ) );
+
+		const __m128i lo = blendWide( _mm_unpacklo_epi8( s, zero ), _mm_unpacklo_epi8( d, zero ) );
+		const __m128i hi = blendWide( _mm_unpackhi_epi8( s, zero ), _mm_unpackhi_epi8( d, zero ) );
+
+		_mm_storeu_si128( reinterpret_cast< __m128i* >( dst + i * 4 ), _mm_packus_epi16( lo, hi ) );
+	}
+#endif
+
+	for ( ; i < count; i++ )
+		blendPixel( dst + i * 4, src + i * 4 );
+}
+
+/***************************************************************************/
+
+Compositor::Compositor( unsigned width, unsigned height, const sf::Color& background ) :
+	m_width( width ),
+	m_height( height ),
+	m_pixels( width * height * 4 )
+{
+	for ( std::size_t i = 0; i < m_pixels.size(); i += 4 )
+	{
+		m_pixels[ i + 0 ] = background.r;
+		m_pixels[ i + 1 ] = background.g;
+		m_pixels[ i + 2 ] = background.b;
+		m_pixels[ i + 3 ] = background.a;
+	}
+}
+
+void Compositor::blit( const sf::Image& image, const sf::IntRect& rect, int x, int y, unsigned flip )
+{
+	const int imageWidth = (int) image.getSize().x, imageHeight = (int) image.getSize().y;
+	if ( rect.left < 0 || rect.top < 0 || rect.width <= 0 || rect.height <= 0 || rect.left + rect.width > imageWidth || rect.top + rect.height > imageHeight )
+		throw Exception( "blit rect is outside of the image" );
+
+	// A diagonal flip swaps the sides on screen
+	const bool diagonal = ( flip & TileMesh::FLIP_DIAGONAL ) != 0;
+	const int width = diagonal ? rect.height : rect.width;
+	const int height = diagonal ? rect.width : rect.height;
+
+	// Clip against the buffer
+	const int left = std::max( x, 0 ), right = std::min( x + width, (int) m_width );
+	const int top = std::max( y, 0 ), bottom = std::min( y + height, (int) m_height );
+	if ( left >= right || top >= bottom )
+		return;
+
+	const sf::Uint8 * pixels = image.getPixelsPtr();
+	m_row.resize( ( right - left ) * 4 );
+
+	for ( int row = top; row < bottom; row++ )
+	{
+		const sf::Uint8 * src;
+
+		if ( flip == 0U )
+			src = pixels + ( ( rect.top + row - y ) * imageWidth + rect.left + left - x ) * 4;
+		else
+		{
+			// Gather the flipped row, undoing the flips in the same order as TileMesh::texCoords
+			for ( int col = left; col < right; col++ )
+			{
+				int u = col - x, v = row - y;
+				if ( flip & TileMesh::FLIP_VERTICAL )	v = height - 1 - v;
+				if ( flip & TileMesh::FLIP_HORIZONTAL )	u = width - 1 - u;
+				if ( diagonal )							std::swap( u, v );
+
+				std::memcpy( &m_row[ ( col - left ) * 4 ], pixels + ( ( rect.top + v ) * imageWidth + rect.left + u ) * 4, 4 );
+			}
+			src = &m_row[ 0 ];
+		}
+
+		blendPixels( &m_pixels[ ( row * m_width + left ) * 4 ], src, right - left );
+	}
+}
+
+void Compositor::blit( const res::AtlasRegion& region, const sf::IntRect& rect, int x, int y, unsigned flip )
+{
+	if ( region.file.empty() )
+		throw Exception( "atlas region has no source image" );
+
+	auto find = m_images.find( region.file );
+	if ( find == m_images.end() )
+		find = m_images.insert( std::make_pair( region.file, res::loadImage( region.file ) ) ).first;
+
+	sf::IntRect local( rect.left - region.rect.left, rect.top - region.rect.top, rect.width, rect.height );
+	blit( *find->second, local, x, y, flip );
+}
+
+sf::Image Compositor::getImage() const
+{
+	sf::Image image;
+	image.create( m_width, m_height, m_pixels.empty() ? nullptr : &m_pixels[ 0 ] );
+	return image;
+}
+
+/***************************************************************************/
+
+} // namespace gfx
+
+} // namespace bf
@@ -3,6 +3,7 @@
 
 #include "mlpbf/global.h"
 #include "mlpbf/exception.h"
+#include "mlpbf/graphics/render_recorder.h"
 #include "mlpbf/resource.h"
 
 #include <algorithm>
@@ -287,6 +288,8 @@ void Console::draw( sf::RenderTarget& target, sf::RenderStates states ) const
 {
 	if ( !m_active ) return;
 
+	gfx::RenderScope scope( "console" );
+
 	// Background 
 	sf::RectangleShape bg( sf::Vector2f( (float) SCREEN_WIDTH, (float) SCREEN_HEIGHT ) );
 	bg.setFillColor( sf::Color( 150, 150, 150, 150 ) );
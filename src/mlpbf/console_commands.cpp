@@ -8,9 +8,16 @@
 #include "mlpbf/player.h"
 #include "mlpbf/time.h"
 #include "mlpbf/exception.h"
+#include "mlpbf/xml.h"
 
+#include <cstring>
 #include <functional>
 #include <sstream>
+#include <unordered_map>
+#include <TmxUtil.h>
+#include <SFML/Graphics/Image.hpp>
+#include <SFML/Graphics/Texture.hpp>
+#include <SFML/System/Clock.hpp>
 
 namespace bf
 {
@@ -231,6 +238,312 @@ class ShowFPS : public con::Command
 	}
 };
 
+class CacheLayers : public con::Command
+{
+	const std::string name() const
+	{
+		return "cache_layers";
+	}
+
+	unsigned minArgs() const
+	{
+		return 1;
+	}
+
+	void help( Console& c ) const
+	{
+		c << setcinfo << "Renders the static map layers through a render texture cache" << con::endl;
+		c << setcinfo << "cache_layers true/false" << con::endl;
+	}
+
+	void execute( Console& c, const std::vector< std::string >& args ) const
+	{
+		std::istringstream( args[ 0 ] ) >> std::boolalpha >> bf::CACHE_LAYERS;
+	}
+};
+
+class BenchTiles : public con::Command
+{
+	const std::string name() const
+	{
+		return "bench_tiles";
+	}
+
+	unsigned minArgs() const
+	{
+		return 0;
+	}
+
+	void help( Console& c ) const
+	{
+		c << setcinfo << "Times the tile texture lookup of a map through a tileset hash map and through the precomputed tile tables" << con::endl;
+		c << setcinfo << "bench_tiles [map] [iterations] -- the map with the most tiles by default" << con::endl;
+	}
+
+	static std::vector< const Tmx::Layer* > tileLayers( const bf::Map& map )
+	{
+		std::vector< const Tmx::Layer* > layers( map.getLowerLayers() );
+		layers.insert( layers.end(), map.getUpperLayers().begin(), map.getUpperLayers().end() );
+		if ( map.getCollisionLayer() )
+			layers.push_back( map.getCollisionLayer() );
+		return layers;
+	}
+
+	static const bf::Map& largestMap()
+	{
+		const bf::Map * largest = nullptr;
+		std::size_t largestTiles = 0U;
+
+		for ( unsigned i = 0; i < db::getMapCount(); i++ )
+		{
+			const bf::Map& map = db::getMap( i );
+			const std::size_t tiles = tileLayers( map ).size() * map.getWidth() * map.getHeight();
+			if ( !largest || tiles > largestTiles )
+			{
+				largest = &map;
+				largestTiles = tiles;
+			}
+		}
+
+		if ( !largest )
+			throw Exception( "There are no maps to benchmark" );
+		return *largest;
+	}
+
+	void execute( Console& c, const std::vector< std::string >& args ) const
+	{
+		const bf::Map& map = args.size() > 0 ? db::getMap( args[ 0 ] ) : largestMap();
+		unsigned iterations = args.size() > 1 ? std::stoul( args[ 1 ] ) : 100U;
+
+		const auto& tables = map.getTileTables();
+		const std::vector< const Tmx::Layer* > layers = tileLayers( map );
+
+		// The previous layers held an unpacked tile per cell, so unpack them before timing
+		std::vector< std::vector< Tmx::MapTile > > unpacked( layers.size() );
+		for ( unsigned i = 0; i < layers.size(); i++ )
+		{
+			unpacked[ i ].reserve( layers[ i ]->GetWidth() * layers[ i ]->GetHeight() );
+			for ( int y = 0; y < layers[ i ]->GetHeight(); y++ )
+				for ( int x = 0; x < layers[ i ]->GetWidth(); x++ )
+					unpacked[ i ].push_back( layers[ i ]->GetTile( x, y ) );
+		}
+
+		// The previous lookup: hash the tileset, then derive the rect from the tileset width
+		struct Lookup
+		{
+			const sf::Texture * texture;
+			sf::Vector2i origin;
+			unsigned columns;
+		};
+
+		std::unordered_map< const Tmx::Tileset*, Lookup > lookups;
+		for ( const auto& cells : unpacked )
+			for ( const Tmx::MapTile& tile : cells )
+			{
+				if ( tile.tileset == nullptr || tables[ tile.tilesetId ].rects.empty() ) continue;
+
+				const bf::Map::TileTable& table = tables[ tile.tilesetId ];
+				Lookup lookup = { table.texture.get(), sf::Vector2i( table.rects[ 0 ].left, table.rects[ 0 ].top ), (unsigned) tile.tileset->GetImage()->GetWidth() / TILE_WIDTH };
+				lookups[ tile.tileset ] = lookup;
+			}
+
+		unsigned tiles = 0U, hashSum = 0U, tableSum = 0U;
+		sf::Clock clock;
+
+		for ( unsigned i = 0; i < iterations; i++ )
+			for ( const auto& cells : unpacked )
+				for ( const Tmx::MapTile& tile : cells )
+				{
+					if ( tile.tileset == nullptr ) continue;
+
+					auto find = lookups.find( tile.tileset );
+					if ( find == lookups.end() ) continue;
+
+					const Lookup& lookup = find->second;
+					sf::IntRect rect( lookup.origin.x + tile.id % lookup.columns * TILE_WIDTH, lookup.origin.y + tile.id / lookup.columns * TILE_HEIGHT, TILE_WIDTH, TILE_HEIGHT );
+					hashSum += rect.left + rect.top + lookup.texture->getSize().x;
+					tiles++;
+				}
+
+		sf::Time hashed = clock.restart();
+
+		for ( unsigned i = 0; i < iterations; i++ )
+			for ( const Tmx::Layer * layer : layers )
+				for ( int y = 0; y < layer->GetHeight(); y++ )
+				{
+					const Tmx::MapCell * row = layer->GetRow( y );
+
+					for ( int x = 0; x < layer->GetWidth(); x++ )
+					{
+						const int tileset = Tmx::GetMapCellTilesetIndex( row[ x ] );
+						if ( tileset < 0 ) continue;
+
+						const unsigned id = Tmx::GetMapCellId( row[ x ] );
+						const bf::Map::TileTable& table = tables[ tileset ];
+						if ( table.rects.size() <= id ) continue;
+
+						const sf::IntRect& rect = table.rects[ id ];
+						tableSum += rect.left + rect.top + table.texture->getSize().x;
+					}
+				}
+
+		sf::Time tabled = clock.getElapsedTime();
+
+		c << setcinfo << tiles << " tile lookups on map " << map.getID() << con::endl;
+		c << setcinfo << "hash map: " << hashed.asMicroseconds() << "us" << con::endl;
+		c << setcinfo << "tables: " << tabled.asMicroseconds() << "us" << con::endl;
+
+		if ( hashSum != tableSum )
+			c << setcerr << "Lookup results differ between the two paths" << con::endl;
+	}
+};
+
+class BenchTmx : public con::Command
+{
+	const std::string name() const
+	{
+		return "bench_tmx";
+	}
+
+	unsigned minArgs() const
+	{
+		return 0;
+	}
+
+	void help( Console& c ) const
+	{
+		c << setcinfo << "Times loading TMX files, and decoding their base64 layers through a string and straight into a buffer" << con::endl;
+		c << setcinfo << "Without a file, every map in data/maps.xml is timed" << con::endl;
+		c << setcinfo << "bench_tmx [file] [iterations]" << con::endl;
+	}
+
+	void execute( Console& c, const std::vector< std::string >& args ) const
+	{
+		std::vector< std::string > files;
+		if ( args.size() > 0 )
+			files.push_back( args[ 0 ] );
+		else
+		{
+			TiXmlDocument maps = xml::open( "data/maps.xml" );
+			for ( const TiXmlElement * elem = maps.RootElement()->FirstChildElement( "map" ); elem; elem = elem->NextSiblingElement( "map" ) )
+				files.push_back( xml::attribute( *elem, "file" ) );
+		}
+		unsigned iterations = args.size() > 1 ? std::stoul( args[ 1 ] ) : 10U;
+
+		for ( const std::string& file : files )
+		{
+			sf::Clock clock;
+
+			for ( unsigned i = 0; i < iterations; i++ )
+			{
+				Tmx::Map map;
+				map.ParseFile( file );
+				if ( map.HasError() )
+					throw Exception( map.GetErrorText().c_str() );
+			}
+
+			sf::Time loaded = clock.restart();
+
+			// The base64 layer payloads, decoded on their own
+			std::vector< const char * > payloads;
+			TiXmlDocument tmx = xml::open( file );
+			for ( const TiXmlElement * layer = tmx.RootElement()->FirstChildElement( "layer" ); layer; layer = layer->NextSiblingElement( "layer" ) )
+			{
+				const TiXmlElement * data = layer->FirstChildElement( "data" );
+				const char * encoding = data ? data->Attribute( "encoding" ) : nullptr;
+				if ( encoding && std::strcmp( encoding, "base64" ) == 0 && data->GetText() )
+					payloads.push_back( data->GetText() );
+			}
+
+			std::size_t stringBytes = 0U, bufferBytes = 0U;
+			std::vector< char > buffer;
+
+			clock.restart();
+			for ( unsigned i = 0; i < iterations; i++ )
+				for ( const char * payload : payloads )
+					stringBytes += Tmx::Util::DecodeBase64( std::string( payload ) ).size();
+
+			sf::Time stringed = clock.restart();
+
+			for ( unsigned i = 0; i < iterations; i++ )
+				for ( const char * payload : payloads )
+				{
+					const std::size_t length = std::strlen( payload );
+					buffer.resize( length / 4 * 3 + 3 );
+					bufferBytes += Tmx::Util::DecodeBase64( payload, length, &buffer[ 0 ], buffer.size() );
+				}
+
+			sf::Time buffered = clock.getElapsedTime();
+
+			c << setcinfo << file << ": " << loaded.asMicroseconds() / iterations << "us per load" << con::endl;
+			c << setcinfo << payloads.size() << " base64 layers, string: " << stringed.asMicroseconds() << "us, buffer: " << buffered.asMicroseconds() << "us" << con::endl;
+
+			if ( stringBytes != bufferBytes )
+				c << setcerr << "Decoded sizes differ between the two paths" << con::endl;
+		}
+	}
+};
+
+class RenderStats : public con::Command
+{
+	const std::string name() const
+	{
+		return "render_stats";
+	}
+
+	unsigned minArgs() const
+	{
+		return 0;
+	}
+
+	void help( Console& c ) const
+	{
+		c << setcinfo << "Records the next frames and prints the draw calls, vertices and texture switches of each subsystem" << con::endl;
+		c << setcinfo << "render_stats [frames]" << con::endl;
+	}
+
+	void execute( Console& c, const std::vector< std::string >& args ) const
+	{
+		unsigned frames = args.size() > 0 ? std::stoul( args[ 0 ] ) : 1U;
+		if ( frames == 0 )
+			throw Exception( "Number of frames must be greater than zero" );
+		bf::recordRenderStats( frames );
+	}
+};
+
+class Mapshot : public con::Command
+{
+	const std::string name() const
+	{
+		return "mapshot";
+	}
+
+	unsigned minArgs() const
+	{
+		return 2;
+	}
+
+	void help( Console& c ) const
+	{
+		c << setcinfo << "Renders a map on the CPU and saves it as an image, with margin tiles of its neighbours" << con::endl;
+		c << setcinfo << "mapshot <map> <file> [margin]" << con::endl;
+	}
+
+	void execute( Console& c, const std::vector< std::string >& args ) const
+	{
+		unsigned margin = args.size() > 2 ? std::stoul( args[ 2 ] ) : 0U;
+
+		sf::Clock clock;
+		sf::Image image = bf::mapshot( db::getMap( args[ 0 ] ), margin );
+		sf::Time elapsed = clock.getElapsedTime();
+
+		if ( !image.saveToFile( args[ 1 ] ) )
+			throw Exception( "Failed to save \"" + args[ 1 ] + "\"" );
+
+		c << setcinfo << "Saved " << image.getSize().x << "x" << image.getSize().y << " snapshot to " << args[ 1 ] << " in " << elapsed.asMilliseconds() << "ms" << con::endl;
+	}
+};
+
 class Message : public con::Command
 {
 	const std::string name() const
@@ -399,6 +712,11 @@ void defaultCommands( Console & console )
 	console.addCommand( new DebugCollision );
 	console.addCommand( new GetTime );
 	console.addCommand( new ShowFPS );
+	console.addCommand( new CacheLayers );
+	console.addCommand( new BenchTiles );
+	console.addCommand( new BenchTmx );
+	console.addCommand( new RenderStats );
+	console.addCommand( new Mapshot );
 	console.addCommand( new Timescale );
 	console.addCommand( new Message );
 	console.addCommand( new Lua );
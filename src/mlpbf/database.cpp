@@ -187,6 +187,11 @@ public:
 	{ 
 		return *m_ids[ i ]; 
 	}
+
+	unsigned getCount() const
+	{
+		return m_ids.size();
+	}
 } * g_dbMap = nullptr;
 
 /***************************************************************************/
@@ -283,6 +288,11 @@ bf::Map & db::getMap( const std::string & id )
 	return const_cast< bf::Map & >( g_dbMap->get( id ) );
 }
 
+unsigned db::getMapCount()
+{
+	return g_dbMap->getCount();
+}
+
 /***************************************************************************/
 
 } // namespace bf
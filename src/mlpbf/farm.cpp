@@ -1,6 +1,7 @@
 #include "mlpbf/exception.h"
 #include "mlpbf/farm.h"
 #include "mlpbf/global.h"
+#include "mlpbf/graphics/compositor.h"
 #include "mlpbf/resource.h"
 
 #include <SFML/Graphics/Sprite.hpp>
@@ -17,6 +18,7 @@ struct Field
 {
 	field::Tile * tiles;
 	std::vector< field::Object * > objects;
+	field::CollisionListener listener;
 } g_Field;
 
 inline unsigned convert( unsigned x, unsigned y )
@@ -69,7 +71,7 @@ public:
 
 /***************************************************************************/
 
-class Stone : public field::Object, res::TextureLoader<>
+class Stone : public field::Object, res::RegionLoader<>
 {
 	unsigned m_size;
 	
@@ -81,16 +83,21 @@ public:
 		
 		switch ( size )
 		{
-			case 1: loadTexture( "data/farm/clutter/rock_s.png" ); break;
-			case 2: loadTexture( "data/farm/clutter/rock_m.png" ); break;
-			case 3: loadTexture( "data/farm/clutter/rock_l.png" ); break;
+			case 1: loadRegion( "data/farm/clutter/rock_s.png" ); break;
+			case 2: loadRegion( "data/farm/clutter/rock_m.png" ); break;
+			case 3: loadRegion( "data/farm/clutter/rock_l.png" ); break;
 		}
 	}
 	
 	void draw( sf::RenderTarget & target, sf::RenderStates states ) const
 	{
 		states.transform *= getTransform();
-		target.draw( sf::Sprite( getTexture() ), states );
+		target.draw( sf::Sprite( *getRegion().texture, getRegion().rect ), states );
+	}
+	
+	void composite( gfx::Compositor & target, int x, int y ) const
+	{
+		target.blit( getRegion(), getRegion().rect, x, y );
 	}
 	
 	bool hasCollision() const
@@ -160,6 +167,9 @@ void addObject( unsigned x, unsigned y, field::Object * obj )
 
 		obj->setPosition( x * TILE_WIDTH, y * TILE_HEIGHT );
 		g_Field.objects.push_back( obj );
+		
+		if ( g_Field.listener && obj->hasCollision() )
+			g_Field.listener( x, y, obj->getWidth(), obj->getHeight(), true );
 	}
 	catch ( ... )
 	{
@@ -168,6 +178,17 @@ void addObject( unsigned x, unsigned y, field::Object * obj )
 	}
 }
 
+void field::setCollisionListener( const CollisionListener & listener )
+{
+	g_Field.listener = listener;
+	if ( !listener )
+		return;
+		
+	for ( field::Object * obj : g_Field.objects )
+		if ( obj->hasCollision() )
+			listener( (unsigned) obj->getPosition().x / TILE_WIDTH, (unsigned) obj->getPosition().y / TILE_HEIGHT, obj->getWidth(), obj->getHeight(), true );
+}
+
 void field::placeStone( unsigned x, unsigned y, unsigned size )
 {
 	addObject( x, y, new Stone( size ) );
@@ -0,0 +1,185 @@
+#include "mlpbf/graphics/layer_cache.h"
+#include "mlpbf/graphics/render_recorder.h"
+#include "mlpbf/global.h"
+
+#include <cmath>
+#include <SFML/Graphics/RectangleShape.hpp>
+#include <SFML/Graphics/VertexArray.hpp>
+#include <SFML/Graphics/View.hpp>
+
+namespace bf
+{
+namespace gfx
+{
+
+inline int wrap( int i, int n )
+{
+	int r = i % n;
+	return r < 0 ? r + n : r;
+}
+
+// Splits a rectangle into the pieces that are contiguous in a ring of size cols x rows
+// f( piece, ringX, ringY ) is called for every piece
+template< typename F >
+inline void forEachPiece( const sf::IntRect& rect, int cols, int rows, F f )
+{
+	for ( int y = rect.top; y < rect.top + rect.height; )
+	{
+		int ry = wrap( y, rows );
+		int h = std::min( rect.top + rect.height - y, rows - ry );
+
+		for ( int x = rect.left; x < rect.left + rect.width; )
+		{
+			int rx = wrap( x, cols );
+			int w = std::min( rect.left + rect.width - x, cols - rx );
+
+			f( sf::IntRect( x, y, w, h ), rx, ry );
+			x += w;
+		}
+
+		y += h;
+	}
+}
+
+// Appends the parts of a that are not covered by b
+inline void difference( const sf::IntRect& a, const sf::IntRect& b, std::vector< sf::IntRect >& out )
+{
+	sf::IntRect o;
+	if ( !a.intersects( b, o ) )
+	{
+		out.push_back( a );
+		return;
+	}
+
+	// columns beside the overlap span the full height
+	if ( o.left > a.left )
+		out.push_back( sf::IntRect( a.left, a.top, o.left - a.left, a.height ) );
+	if ( o.left + o.width < a.left + a.width )
+		out.push_back( sf::IntRect( o.left + o.width, a.top, a.left + a.width - o.left - o.width, a.height ) );
+
+	// rows above and below only span the overlapped columns
+	if ( o.top > a.top )
+		out.push_back( sf::IntRect( o.left, a.top, o.width, o.top - a.top ) );
+	if ( o.top + o.height < a.top + a.height )
+		out.push_back( sf::IntRect( o.left, o.top + o.height, o.width, a.top + a.height - o.top - o.height ) );
+}
+
+/***************************************************************************/
+
+bool LayerCache::resize( const sf::Vector2f& view )
+{
+	int cols = static_cast< int >( std::ceil( view.x / TILE_WIDTH ) ) + 1 + 2 * MARGIN;
+	int rows = static_cast< int >( std::ceil( view.y / TILE_HEIGHT ) ) + 1 + 2 * MARGIN;
+
+	if ( cols == m_cols && rows == m_rows )
+		return true;
+
+	m_cols = m_rows = 0;
+	invalidate();
+
+	if ( !m_page.create( cols * TILE_WIDTH, rows * TILE_HEIGHT ) )
+		return false;
+
+	m_cols = cols;
+	m_rows = rows;
+	return true;
+}
+
+void LayerCache::invalidate()
+{
+	m_valid = sf::IntRect( 0, 0, 0, 0 );
+	m_dirty.clear();
+}
+
+void LayerCache::invalidate( const sf::FloatRect& area )
+{
+	int left   = static_cast< int >( std::floor( area.left / TILE_WIDTH ) );
+	int top    = static_cast< int >( std::floor( area.top / TILE_HEIGHT ) );
+	int right  = static_cast< int >( std::ceil( ( area.left + area.width ) / TILE_WIDTH ) );
+	int bottom = static_cast< int >( std::ceil( ( area.top + area.height ) / TILE_HEIGHT ) );
+
+	m_dirty.push_back( sf::IntRect( left, top, right - left, bottom - top ) );
+}
+
+void LayerCache::redraw( const sf::IntRect& tiles, const Fill& fill )
+{
+	forEachPiece( tiles, m_cols, m_rows, [&]( const sf::IntRect& piece, int rx, int ry )
+	{
+		sf::FloatRect world( (float) piece.left * TILE_WIDTH, (float) piece.top * TILE_HEIGHT, (float) piece.width * TILE_WIDTH, (float) piece.height * TILE_HEIGHT );
+
+		// the viewport clips drawing to the piece so the neighbouring texels stay intact
+		sf::View view( world );
+		view.setViewport( sf::FloatRect( (float) rx / m_cols, (float) ry / m_rows, (float) piece.width / m_cols, (float) piece.height / m_rows ) );
+		m_page.setView( view );
+
+		sf::RectangleShape clear( sf::Vector2f( world.width, world.height ) );
+		clear.setPosition( world.left, world.top );
+		clear.setFillColor( sf::Color::Transparent );
+		m_page.draw( clear, sf::RenderStates( sf::BlendNone ) );
+
+		fill( m_page, sf::RenderStates::Default, world );
+	} );
+}
+
+void LayerCache::draw( sf::RenderTarget& target, sf::RenderStates states, const sf::FloatRect& area, const Fill& fill )
+{
+	int left   = static_cast< int >( std::floor( area.left / TILE_WIDTH ) );
+	int top    = static_cast< int >( std::floor( area.top / TILE_HEIGHT ) );
+	int right  = static_cast< int >( std::ceil( ( area.left + area.width ) / TILE_WIDTH ) );
+	int bottom = static_cast< int >( std::ceil( ( area.top + area.height ) / TILE_HEIGHT ) );
+
+	sf::IntRect need( left, top, right - left, bottom - top ), overlap;
+	bool changed = false;
+
+	// Scroll the page: recentre it on the view and redraw only the strips it did not hold before
+	if ( !m_valid.intersects( need, overlap ) || overlap != need )
+	{
+		sf::IntRect next( left - ( m_cols - need.width ) / 2, top - ( m_rows - need.height ) / 2, m_cols, m_rows );
+
+		std::vector< sf::IntRect > strips;
+		difference( next, m_valid, strips );
+
+		m_valid = next;
+		for ( const sf::IntRect& strip : strips )
+			redraw( strip, fill );
+
+		changed = true;
+	}
+
+	// Redraw invalidated regions that are on the page; the rest are redrawn when they scroll in
+	for ( const sf::IntRect& dirty : m_dirty )
+		if ( m_valid.intersects( dirty, overlap ) )
+		{
+			redraw( overlap, fill );
+			changed = true;
+		}
+	m_dirty.clear();
+
+	if ( changed )
+		m_page.display();
+
+	// Present the area with one quad per contiguous piece of the page
+	sf::IntRect pixels( static_cast< int >( std::floor( area.left ) ), static_cast< int >( std::floor( area.top ) ),
+						static_cast< int >( std::ceil( area.width ) ), static_cast< int >( std::ceil( area.height ) ) );
+
+	sf::VertexArray quads( sf::Quads );
+	forEachPiece( pixels, m_cols * TILE_WIDTH, m_rows * TILE_HEIGHT, [&]( const sf::IntRect& piece, int rx, int ry )
+	{
+		float x = piece.left - area.left, y = piece.top - area.top;
+		float w = (float) piece.width, h = (float) piece.height;
+
+		quads.append( sf::Vertex( sf::Vector2f( x,     y     ), sf::Vector2f( (float) rx,     (float) ry     ) ) );
+		quads.append( sf::Vertex( sf::Vector2f( x + w, y     ), sf::Vector2f( (float) rx + w, (float) ry     ) ) );
+		quads.append( sf::Vertex( sf::Vector2f( x + w, y + h ), sf::Vector2f( (float) rx + w, (float) ry + h ) ) );
+		quads.append( sf::Vertex( sf::Vector2f( x,     y + h ), sf::Vector2f( (float) rx,     (float) ry + h ) ) );
+	} );
+
+	states.texture = &m_page.getTexture();
+	gfx::draw( target, quads, states );
+}
+
+/***************************************************************************/
+
+} // namespace gfx
+
+} // namespace bf
@@ -0,0 +1,107 @@
+#include "mlpbf/graphics/lightmap.h"
+#include "mlpbf/graphics/render_recorder.h"
+#include "mlpbf/console.h"
+#include "mlpbf/global.h"
+
+#include <cmath>
+#include <SFML/Graphics/RectangleShape.hpp>
+#include <SFML/Graphics/Sprite.hpp>
+#include <SFML/Graphics/View.hpp>
+
+namespace bf
+{
+namespace gfx
+{
+
+// Cheap smooth wavering in [0, 1], decorrelated per light
+inline float waver( sf::Uint32 time, std::size_t index )
+{
+	float t = (float) time;
+	float i = (float) index;
+	return 0.5f + 0.3f * std::sin( t * 0.011f + i * 1.7f ) + 0.2f * std::sin( t * 0.029f + i * 3.1f );
+}
+
+/***************************************************************************/
+
+void Lightmap::fan( sf::VertexArray& vertices, const sf::Vector2f& center, float radius, const sf::Color& inner, const sf::Color& outer ) const
+{
+	const float step = 2.0f * 3.14159265f / SEGMENTS;
+
+	for ( int i = 0; i < SEGMENTS; i++ )
+	{
+		sf::Vector2f a( center.x + radius * std::cos( step * i ), center.y + radius * std::sin( step * i ) );
+		sf::Vector2f b( center.x + radius * std::cos( step * ( i + 1 ) ), center.y + radius * std::sin( step * ( i + 1 ) ) );
+
+		vertices.append( sf::Vertex( center, inner ) );
+		vertices.append( sf::Vertex( a, outer ) );
+		vertices.append( sf::Vertex( b, outer ) );
+	}
+}
+
+void Lightmap::draw( sf::RenderTarget& target, sf::RenderStates states, const sf::Color& ambient, const std::vector< Light >& lights, sf::Uint32 time )
+{
+	// Daylight
+	if ( ambient.a == 0 )
+		return;
+
+	if ( m_state == NotCreated )
+	{
+		if ( m_page.create( SCREEN_WIDTH / SCALE, SCREEN_HEIGHT / SCALE ) )
+		{
+			m_page.setSmooth( true );
+			m_page.setView( sf::View( sf::FloatRect( 0.0f, 0.0f, (float) SCREEN_WIDTH, (float) SCREEN_HEIGHT ) ) );
+			m_state = Created;
+		}
+		else
+		{
+			Console::singleton() << con::setcerr << "Failed to create the lightmap, lights are disabled" << con::endl;
+			m_state = Failed;
+		}
+	}
+
+	// Without lights the tint is one flat rectangle
+	if ( lights.empty() || m_state == Failed )
+	{
+		sf::RectangleShape rect( sf::Vector2f( (float) SCREEN_WIDTH, (float) SCREEN_HEIGHT ) );
+		rect.setFillColor( ambient );
+		target.draw( rect, states );
+		return;
+	}
+
+	const float darkness = ambient.a / 255.0f;
+
+	m_cut.setPrimitiveType( sf::Triangles );
+	m_cut.clear();
+	m_glow.setPrimitiveType( sf::Triangles );
+	m_glow.clear();
+
+	for ( std::size_t i = 0; i < lights.size(); i++ )
+	{
+		const Light& light = lights[ i ];
+		const float intensity = 1.0f - light.flicker * waver( time, i );
+
+		// Multiplying the alpha removes the tint at the centre of the light
+		fan( m_cut, light.position, light.radius, sf::Color( 255, 255, 255, static_cast< sf::Uint8 >( 255 * ( 1.0f - intensity ) ) ), sf::Color::White );
+
+		const float glow = intensity * darkness;
+		sf::Color color( static_cast< sf::Uint8 >( light.color.r * glow ), static_cast< sf::Uint8 >( light.color.g * glow ), static_cast< sf::Uint8 >( light.color.b * glow ) );
+		fan( m_glow, light.position, light.radius, color, sf::Color::Black );
+	}
+
+	m_page.clear( ambient );
+	gfx::draw( m_page, m_cut, sf::RenderStates( sf::BlendMultiply ) );
+	m_page.display();
+
+	sf::Sprite overlay( m_page.getTexture() );
+	overlay.setScale( (float) SCALE, (float) SCALE );
+	target.draw( overlay, states );
+
+	states.blendMode = sf::BlendAdd;
+	gfx::draw( target, m_glow, states );
+}
+
+/***************************************************************************/
+
+} // namespace gfx
+
+} // namespace bf
@@ -2,6 +2,7 @@
 #include "mlpbf/console/command.h"
 #include "mlpbf/exception.h"
 #include "mlpbf/farm.h"
+#include "mlpbf/graphics/render_recorder.h"
 #include "mlpbf/global.h"
 #include "mlpbf/lua.h"
 #include "mlpbf/player.h"
@@ -536,6 +537,8 @@ void lua::Container::display( bool state )
 
 void lua::Container::draw( sf::RenderTarget & target, sf::RenderStates states ) const
 {
+	gfx::RenderScope scope( "lua" );
+
 	states.transform *= getTransform();
 	for ( const lua::Drawable * d : m_draw )
 		target.draw( d->getDrawable(), states );
@@ -2,6 +2,7 @@
 
 #include "mlpbf/global.h"
 #include "mlpbf/direction.h"
+#include "mlpbf/exception.h"
 #include "mlpbf/resource.h"
 
 #include "mlpbf/database.h"
@@ -17,17 +18,24 @@
 
 #include "mlpbf/console.h"
 #include "mlpbf/console/function.h"
+#include "mlpbf/graphics/render_recorder.h"
 #include "mlpbf/lua.h"
+#include "mlpbf/xml.h"
 
 #include <SFML/System/Clock.hpp>
 #include <SFML/Graphics.hpp>
 #include <deque>
+#include <cctype>
+#include <iostream>
+#include <sstream>
+#include <vector>
 
 // NOTE:
 // Microsoft Visual Studio C++ 2010 Redistributable required
 
 bool bf::DEBUG_COLLISION = false;
 bool bf::SHOW_FPS = true;
+bool bf::CACHE_LAYERS = false;
 
 #ifdef MAIN_TRY_CATCH
 #	ifdef _WIN32
@@ -200,6 +208,54 @@ void bf::fadeOut( sf::Time t )
 
 /***************************************************************************/
 
+void drawFrame( sf::RenderTarget& target )
+{
+	target.draw( bf::state::global() );
+	for ( const sf::Drawable * d : g_Drawables )
+		target.draw( *d );
+	target.draw( ScreenTint );
+	target.draw( bf::Console::singleton() );
+	target.draw( FPS );
+}
+
+static unsigned g_RecordFrames = 0U;
+static std::unique_ptr< bf::gfx::RenderRecorder > g_Recorder;
+
+void bf::recordRenderStats( unsigned frames )
+{
+	if ( !g_Recorder )
+		g_Recorder.reset( new gfx::RenderRecorder( sf::Vector2u( SCREEN_WIDTH, SCREEN_HEIGHT ) ) );
+
+	g_Recorder->reset();
+	g_RecordFrames = frames;
+}
+
+// Draws the frame into the window, recording its draws while the render_stats command asks for them
+void drawWindow( bf::gfx::RecordingWindow& window )
+{
+	if ( g_RecordFrames == 0U )
+	{
+		drawFrame( window );
+		return;
+	}
+
+	g_Recorder->beginFrame();
+	drawFrame( window );
+	g_Recorder->endFrame();
+
+	if ( --g_RecordFrames == 0U )
+	{
+		std::ostringstream report;
+		g_Recorder->report( report );
+
+		std::istringstream lines( report.str() );
+		for ( std::string line; std::getline( lines, line ); )
+			bf::Console::singleton() << bf::con::setcinfo << line << bf::con::endl;
+	}
+}
+
+/***************************************************************************/
+
 int main( int argc, char* argv[] )
 {
 	using namespace bf;
@@ -208,20 +264,113 @@ int main( int argc, char* argv[] )
 	try
 	{
 #endif
+		// --render-stats [frames]: simulate and record frames without opening a window, then exit
+		//		(drawing never touches OpenGL, but loading textures and glyphs still needs a context)
+		// --mapshot <map> <file> [margin]: render maps on the CPU into images, then exit (repeatable)
+		// --bake: compile every map in data/maps.xml into the .bfmap loaded in its place, then exit
+		unsigned statFrames = 0U;
+		bool bake = false;
+
+		struct Mapshot { std::string map, file; unsigned margin; };
+		std::vector< Mapshot > mapshots;
+
+		for ( int i = 1; i < argc; i++ )
+			if ( std::string( argv[ i ] ) == "--render-stats" )
+			{
+				statFrames = 60U;
+				if ( i + 1 < argc && std::isdigit( argv[ i + 1 ][ 0 ] ) )
+					std::istringstream( argv[ ++i ] ) >> statFrames;
+			}
+			else if ( std::string( argv[ i ] ) == "--mapshot" )
+			{
+				if ( i + 2 >= argc )
+					throw Exception( "--mapshot needs a map and a file" );
+
+				Mapshot shot = { argv[ i + 1 ], argv[ i + 2 ], 0U };
+				i += 2;
+				if ( i + 1 < argc && std::isdigit( argv[ i + 1 ][ 0 ] ) )
+					std::istringstream( argv[ ++i ] ) >> shot.margin;
+				mapshots.push_back( shot );
+			}
+			else if ( std::string( argv[ i ] ) == "--bake" )
+				bake = true;
+
+		// Baking reads the TMX files and tileset images without starting the game
+		if ( bake )
+		{
+			int status = EXIT_SUCCESS;
+
+			TiXmlDocument maps = xml::open( "data/maps.xml" );
+			for ( const TiXmlElement * elem = maps.RootElement()->FirstChildElement( "map" ); elem; elem = elem->NextSiblingElement( "map" ) )
+			{
+				const std::string file = xml::attribute( *elem, "file" );
+				try
+				{
+					Map::bake( file );
+					std::cout << file << " -> " << Map::bakedFile( file ) << std::endl;
+				}
+				catch ( std::exception& err )
+				{
+					std::cout << "Failed to bake " << file << ": " << err.what() << std::endl;
+					status = EXIT_FAILURE;
+				}
+			}
+
+			return status;
+		}
+
 		init();
 
-		sf::RenderWindow window( sf::VideoMode( SCREEN_WIDTH, SCREEN_HEIGHT ), "Budding Friendships", sf::Style::Close );
-		window.setFramerateLimit( 60U );
-		
+		if ( !mapshots.empty() )
+		{
+			int status = EXIT_SUCCESS;
+			for ( const Mapshot& shot : mapshots )
+			{
+				if ( mapshot( db::getMap( shot.map ), shot.margin ).saveToFile( shot.file ) )
+					std::cout << shot.map << " -> " << shot.file << std::endl;
+				else
+				{
+					std::cout << "Failed to save " << shot.file << std::endl;
+					status = EXIT_FAILURE;
+				}
+			}
+
+			cleanup();
+			return status;
+		}
+
 		//TODO: make function to initialize all global variables
 		Map::global( 0 );
 		state::global( std::unique_ptr< state::Base >( new state::Map() ) );
 
+		Player::singleton().setMap( "path_a", sf::Vector2f( 448.0f , 448.0f ) );
+
+		if ( statFrames > 0U )
+		{
+			gfx::RenderRecorder recorder( sf::Vector2u( SCREEN_WIDTH, SCREEN_HEIGHT ) );
+			const sf::Time frameTime = sf::milliseconds( 16 );
+
+			for ( unsigned i = 0; i < statFrames; i++ )
+			{
+				state::global().update( frameTime );
+				lua::update( frameTime.asMilliseconds() );
+				ScreenTint.update();
+
+				recorder.beginFrame();
+				drawFrame( recorder );
+				recorder.endFrame();
+			}
+
+			recorder.report( std::cout );
+			cleanup();
+			return EXIT_SUCCESS;
+		}
+
+		gfx::RecordingWindow window( sf::VideoMode( SCREEN_WIDTH, SCREEN_HEIGHT ), "Budding Friendships", sf::Style::Close );
+		window.setFramerateLimit( 60U );
+
 		sf::Clock clock;
-		Console& console = Console::singleton();
 
-		Player::singleton().setMap( "path_a", sf::Vector2f( 448.0f , 448.0f ) );
-		
 		while ( window.isOpen() )
 		{
 			state::Base& state = state::global();
@@ -242,14 +391,7 @@ int main( int argc, char* argv[] )
 			ScreenTint.update();
 
 			window.clear();
-
-				window.draw( state );
-				for ( const sf::Drawable * d : g_Drawables )
-					window.draw( *d );
-				window.draw( ScreenTint );
-				window.draw( console );
-				window.draw( FPS );
-
+			drawWindow( window );
 			window.display();
 		}
 		
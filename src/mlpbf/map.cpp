@@ -4,43 +4,55 @@
 #include "mlpbf/direction.h"
 #include "mlpbf/exception.h"
 #include "mlpbf/farm.h"
+#include "mlpbf/graphics/compositor.h"
+#include "mlpbf/graphics/render_recorder.h"
 #include "mlpbf/global.h"
 #include "mlpbf/lua.h"
 #include "mlpbf/map.h"
 #include "mlpbf/resource.h"
+#include "mlpbf/time.h"
 #include "mlpbf/time/season.h"
+#include "mlpbf/utility/radix_sort.h"
 
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
 #include <SFML/Graphics/RectangleShape.hpp>
 #include <SFML/Graphics/RenderTarget.hpp>
+#include <SFML/System/Clock.hpp>
 #include <sstream>
+#include <sys/stat.h>
 
 namespace bf
 {
 
-inline void assertBounds( const sf::Vector2u& pos, unsigned width, unsigned height )
+// Map objects are bucketed into cells of 4x4 tiles
+static const float OBJECT_CELL_SIZE = 4.0f * TILE_WIDTH;
+
+// Span of the wheel objects sleep on until an hour of the game clock
+static const int MINUTES_PER_DAY = 24 * 60;
+
+inline unsigned tileFlip( Tmx::MapCell cell )
 {
-	if ( pos.x < 0 || width <= pos.x )
-		throw Exception( "x-position is out of map bounds" );
-	if ( pos.y < 0 || height <= pos.y )
-		throw Exception( "y-position is out of map bounds" );
+	return ( ( cell & Tmx::FlippedHorizontallyFlag ) ? gfx::TileMesh::FLIP_HORIZONTAL : 0U )
+		 | ( ( cell & Tmx::FlippedVerticallyFlag ) ? gfx::TileMesh::FLIP_VERTICAL : 0U )
+		 | ( ( cell & Tmx::FlippedDiagonallyFlag ) ? gfx::TileMesh::FLIP_DIAGONAL : 0U );
 }
 
-inline void renderLayer( sf::RenderTarget& target, sf::RenderStates& states, 
-						 const Map& map, const std::vector< const Tmx::Layer* >& layer, 
-						 const sf::FloatRect& rect, const sf::IntRect& draw )
+inline void tileQuad( sf::Vertex * quad, unsigned x, unsigned y, const sf::IntRect& rect, unsigned flip )
 {
-	sf::Sprite sprite;
-	for ( auto it = layer.begin(); it != layer.end(); ++it )
-		for ( int y = std::max( draw.top, 0 ); y < draw.top + draw.height; y++ )
-			for ( int x = std::max( draw.left, 0 ); x < draw.left + draw.width; x++ )
-			{
-				if ( map.adjustSprite( **it, sf::Vector2u( x, y ), sprite ) )
-				{
-					sprite.move( -rect.left, -rect.top );
-					target.draw( sprite, states );
-				}
-			}
+	float left = (float) x * TILE_WIDTH, top = (float) y * TILE_HEIGHT;
+
+	quad[0].position = sf::Vector2f( left, top );
+	quad[1].position = sf::Vector2f( left + TILE_WIDTH, top );
+	quad[2].position = sf::Vector2f( left + TILE_WIDTH, top + TILE_HEIGHT );
+	quad[3].position = sf::Vector2f( left, top + TILE_HEIGHT );
+
+	gfx::TileMesh::texCoords( quad, rect, flip );
 }
 
 inline float round( float f )
@@ -69,43 +81,324 @@ inline void setNeighbor( const std::map< std::string, std::string >& map, const
 	}
 }
 
+// The image of a tileset, relative to the game rather than the tileset
+inline std::string tilesetImage( const Tmx::Tileset& tileset )
+{
+	const std::string& base = tileset.GetSource();
+
+	std::string file;
+	if ( !base.empty() ) // If externally loaded, prepend the location minus the final '/'
+		file = base.substr( 0, base.find_last_of( '/' ) + 1 );
+	file += tileset.GetImage()->GetSource();
+
+	return file;
+}
+
+// Top left corner of every tile of a tileset image, relative to the image, by local tile id
+inline std::vector< sf::Vector2i > tileCorners( int width, int height )
+{
+	int columns = width / TILE_WIDTH;
+	int rows = height / TILE_HEIGHT;
+
+	std::vector< sf::Vector2i > corners;
+	corners.reserve( columns * rows );
+	for ( int y = 0; y < rows; y++ )
+		for ( int x = 0; x < columns; x++ )
+			corners.push_back( sf::Vector2i( x * TILE_WIDTH, y * TILE_HEIGHT ) );
+
+	return corners;
+}
+
+// Places the tiles of a tileset at its region of the atlas
+static void loadTileTable( Map::TileTable& table, const res::AtlasRegion& region, const std::vector< sf::Vector2i >& corners, const Tmx::Tileset& tileset )
+{
+	table.texture = region.texture;
+	table.region = region;
+
+	table.rects.reserve( corners.size() );
+	for ( const sf::Vector2i& corner : corners )
+		table.rects.push_back( sf::IntRect( region.rect.left + corner.x, region.rect.top + corner.y, TILE_WIDTH, TILE_HEIGHT ) );
+
+	// Animated tiles
+	for ( const Tmx::Tile * tile : tileset.GetTiles() )
+	{
+		gfx::TileMesh::Animation anim;
+		sf::Uint32 end = 0U;
+
+		for ( const Tmx::AnimationFrame& frame : tile->GetAnimation() )
+		{
+			if ( frame.tileId < 0 || (int) table.rects.size() <= frame.tileId || frame.duration <= 0 )
+				continue;
+
+			end += frame.duration;
+			anim.rects.push_back( table.rects[ frame.tileId ] );
+			anim.ends.push_back( end );
+		}
+
+		if ( !anim.rects.empty() && 0 <= tile->GetId() && tile->GetId() < (int) table.rects.size() )
+			table.animations.insert( std::make_pair( (unsigned) tile->GetId(), anim ) );
+	}
+}
+
 /***************************************************************************/
 
-class Map::Object : public virtual sf::Drawable, private virtual sf::Transformable
+bool CollisionShape::contains( const sf::FloatRect& bounds, const sf::Vector2f& local ) const
+{
+	switch ( type )
+	{
+	case Rect:
+		return true;
+
+	case Ellipse:
+	{
+		const float rx = bounds.width / 2.0f, ry = bounds.height / 2.0f;
+		const float dx = ( local.x - rx ) / rx, dy = ( local.y - ry ) / ry;
+		return dx * dx + dy * dy <= 1.0f;
+	}
+
+	case Polygon:
+	{
+		// Even-odd rule: count the edges crossed by a ray to the right
+		bool inside = false;
+		for ( std::size_t i = 0, j = points.size() - 1; i < points.size(); j = i++ )
+		{
+			const sf::Vector2f& a = points[ i ];
+			const sf::Vector2f& b = points[ j ];
+			if ( ( a.y > local.y ) != ( b.y > local.y ) && local.x < ( b.x - a.x ) * ( local.y - a.y ) / ( b.y - a.y ) + a.x )
+				inside = !inside;
+		}
+		return inside;
+	}
+
+	case Mask:
+	{
+		const int x = (int) local.x, y = (int) local.y;
+		return x >= 0 && y >= 0 && x < (int) mask->getSize().x && y < (int) mask->getSize().y && mask->getPixel( x, y ).a >= 128;
+	}
+
+	default:
+		return false;
+	}
+}
+
+class Map::Object
 {
 public:
-	friend Map::Object * generateObject( const Tmx::Object & );
+	friend class Map;
+	friend Map::Object * generateObject( Map &, const Tmx::Object & );
 	virtual ~Object() {}
 
 	inline const std::string & getName() const { return m_name; }
-	inline const sf::FloatRect & getBounds() const { return m_bounds; }
+	inline Map::ObjectHandle getHandle() const { return m_handle; }
 	inline const Tmx::Object & getObject() const { return *m_object; }
 
-	using sf::Transformable::getPosition;
-	using sf::Transformable::setPosition;
+	// Components, stored by the map
+	inline const sf::FloatRect & getBounds() const { return m_map->m_components.bounds[ m_handle.index ]; }
+	inline sf::Vector2f getPosition() const { return sf::Vector2f( getBounds().left, getBounds().top ); }
+
+	const CollisionShape & getShape() const { return m_map->m_components.shape[ m_handle.index ]; }
+	void setShape( const CollisionShape & shape ) { m_map->m_components.shape[ m_handle.index ] = shape; }
+
+	// Switches the collision shape on and off without forgetting it
+	bool isSolid() const { return m_map->m_components.solid[ m_handle.index ] != 0; }
+	void setSolid( bool solid ) { m_map->m_components.solid[ m_handle.index ] = solid ? 1 : 0; }
 
 public:
 	virtual void load( const Tmx::Object& object ) = 0;
-	virtual void update( sf::Uint32 frameTime, const sf::Vector2f& pos ) {}
+	virtual void update( sf::Uint32 frameTime, const sf::Vector2f& pos ) { sleep(); }
 
 	virtual void onEnter( sf::Uint32 frameTime, const sf::Vector2f& pos ) {}
 	virtual void whileInside( sf::Uint32 frameTime, const sf::Vector2f& pos ) {}
 	virtual void onExit( sf::Uint32 frameTime, const sf::Vector2f& pos ) {}
 
+	virtual void onCharacterEnter( const Character& c, const sf::Vector2f& pos ) {}
+	virtual void onCharacterExit( const Character& c, const sf::Vector2f& pos ) {}
+
+	virtual void onProximityEnter( const Character& c, const sf::Vector2f& pos ) {}
+	virtual void onProximityExit( const Character& c, const sf::Vector2f& pos ) {}
+
+	// Reports characters coming within radius of the bounds through the proximity callbacks, 0 stops
+	void setProximity( float radius ) { m_map->watchProximity( m_handle, radius ); }
+
 	virtual void onInteract( const sf::Vector2f& pos ) {}
 
+	// Only asked when the collision shape is CollisionShape::Callback
 	virtual bool hasCollision( const sf::Vector2f& pos ) const = 0;
 
+	// update() is only called while the object is awake
+	bool isAwake() const { return m_awake; }
+
+	// Sleeps until woken
+	void sleep()
+	{
+		m_awake = false;
+		m_sleep++;
+	}
+
+	// Sleeps for ms of map updates
+	void sleep( sf::Uint32 ms )
+	{
+		sleep();
+		m_map->m_sleepers.schedule( Map::Sleeper( m_handle, m_sleep ), m_map->m_sleepers.now() + ms );
+	}
+
+	// Sleeps until the game clock reaches hour, the next day if it is that time already
+	void sleep( const time::Hour& hour )
+	{
+		sleep();
+
+		const int now = m_map->m_clockMinute >= 0 ? m_map->m_clockMinute : Time::singleton().getHour().getRaw();
+		const int minutes = ( hour.getRaw() - now + MINUTES_PER_DAY - 1 ) % MINUTES_PER_DAY + 1;
+		m_map->m_clockSleepers.schedule( Map::Sleeper( m_handle, m_sleep ), m_map->m_clockSleepers.now() + minutes );
+	}
+
+	void wake()
+	{
+		if ( m_awake )
+			return;
+
+		m_awake = true;
+		m_sleep++;
+
+		if ( !m_listed )
+		{
+			m_listed = true;
+			m_map->m_awakeObjects.push_back( m_handle );
+		}
+	}
+
+	// Draws the object with states already moving it to the top left of its bounds
+	virtual void draw( sf::RenderTarget& target, sf::RenderStates states ) const = 0;
+
+	// Y coordinate the object is sorted by against characters, the bottom of its bounds by default
+	// Flat objects lying on the ground should return the top instead
+	// Read once after the object is loaded
+	virtual float getDepth() const { return getBounds().top + getBounds().height; }
+
+	// Renders the object on the CPU with the top left of its bounds at (x, y)
+	// Objects without a software path are left out of map snapshots
+	virtual void composite( gfx::Compositor& target, int x, int y ) const {}
+
 protected:
-	using sf::Transformable::getTransform;
+	// The map the object was generated for
+	Map & getMap() const { return *m_map; }
 
 private:
+	Map * m_map;
+	Map::ObjectHandle m_handle;	// set once the map registers the object
 	std::string m_name;
-	sf::FloatRect m_bounds;
 	const Tmx::Object * m_object;
+
+	bool m_awake;
+	bool m_listed;		// in the map's awake objects, which drops sleeping ones lazily
+	unsigned m_sleep;	// incremented on every sleep and wake, outdates scheduled wakes
 };
 
-Map::Object * generateObject( const Tmx::Object & tmxObject );
+Map::Object * generateObject( Map & map, const Tmx::Object & tmxObject );
+
+// Bounds of an object; polygons have no size in TMX, so they are measured from their points
+inline sf::FloatRect objectBounds( const Tmx::Object& object )
+{
+	const Tmx::Polygon * polygon = object.GetPolygon();
+	if ( polygon == nullptr || polygon->GetNumPoints() == 0 )
+		return sf::FloatRect( (float) object.GetX(), (float) object.GetY(), (float) object.GetWidth(), (float) object.GetHeight() );
+
+	int left = polygon->GetPoint( 0 ).x, right = left, top = polygon->GetPoint( 0 ).y, bottom = top;
+	for ( int i = 1; i < polygon->GetNumPoints(); i++ )
+	{
+		left = std::min( left, polygon->GetPoint( i ).x );
+		right = std::max( right, polygon->GetPoint( i ).x );
+		top = std::min( top, polygon->GetPoint( i ).y );
+		bottom = std::max( bottom, polygon->GetPoint( i ).y );
+	}
+
+	return sf::FloatRect( (float) ( object.GetX() + left ), (float) ( object.GetY() + top ), (float) ( right - left ), (float) ( bottom - top ) );
+}
+
+// Reads the "collision" property of an object:
+//	none, rect, ellipse, polygon (its TMX polygon), shape (whichever of the three the TMX object is),
+//	mask (the image in the "mask" property) or script (asks the object every time)
+inline CollisionShape parseShape( const std::string& value, const Tmx::Object& object, const sf::FloatRect& bounds )
+{
+	const auto& properties = object.GetProperties().GetList();
+
+	CollisionShape shape;
+	std::string type = value;
+	std::transform( type.begin(), type.end(), type.begin(), ::tolower );
+
+	if ( type == "shape" )
+		type = object.GetPolygon() ? "polygon" : object.IsEllipse() ? "ellipse" : "rect";
+
+	if ( type == "none" )
+		shape.type = CollisionShape::None;
+	else if ( type == "rect" )
+		shape.type = CollisionShape::Rect;
+	else if ( type == "ellipse" )
+		shape.type = CollisionShape::Ellipse;
+	else if ( type == "script" )
+		shape.type = CollisionShape::Callback;
+	else if ( type == "polygon" )
+	{
+		const Tmx::Polygon * polygon = object.GetPolygon();
+		if ( polygon == nullptr || polygon->GetNumPoints() < 3 )
+			throw Exception( "polygon collision needs a TMX polygon object" );
+
+		shape.type = CollisionShape::Polygon;
+		for ( int i = 0; i < polygon->GetNumPoints(); i++ )
+			shape.points.push_back( sf::Vector2f( object.GetX() + polygon->GetPoint( i ).x - bounds.left, object.GetY() + polygon->GetPoint( i ).y - bounds.top ) );
+	}
+	else if ( type == "mask" )
+	{
+		auto find = properties.find( "mask" );
+		if ( find == properties.end() )
+			throw Exception( "mask collision needs a \"mask\" image property" );
+
+		shape.type = CollisionShape::Mask;
+		shape.mask = res::loadImage( find->second );
+	}
+	else
+		throw Exception( "unknown collision shape \"" + value + "\"" );
+
+	return shape;
+}
+
+// Reads a light object: its centre, and the optional radius, color ("r,g,b") and flicker properties
+inline gfx::Light parseLight( const Tmx::Object& object )
+{
+	const auto& properties = object.GetProperties().GetList();
+
+	gfx::Light light;
+	light.position = sf::Vector2f( object.GetX() + object.GetWidth() / 2.0f, object.GetY() + object.GetHeight() / 2.0f );
+	light.radius = std::max( 96.0f, std::max( object.GetWidth(), object.GetHeight() ) / 2.0f );
+	light.color = sf::Color( 255, 200, 120 );
+	light.flicker = 0.0f;
+
+	auto find = properties.find( "radius" );
+	if ( find != properties.end() )
+		light.radius = std::stof( find->second );
+
+	find = properties.find( "color" );
+	if ( find != properties.end() )
+	{
+		int r = 255, g = 255, b = 255;
+		char comma;
+
+		std::istringstream ss( find->second );
+		if ( !( ss >> r >> comma >> g >> comma >> b ) )
+			throw Exception( "light color must be in the format \"r,g,b\"" );
+
+		light.color = sf::Color( (sf::Uint8) r, (sf::Uint8) g, (sf::Uint8) b );
+	}
+
+	find = properties.find( "flicker" );
+	if ( find != properties.end() )
+		light.flicker = std::min( std::max( std::stof( find->second ), 0.0f ), 1.0f );
+
+	if ( light.radius <= 0.0f )
+		throw Exception( "light radius must be greater than zero" );
+
+	return light;
+}
 
 /***************************************************************************/
 
@@ -130,414 +423,1540 @@ Map& Map::global( const std::string& map )
 
 /***************************************************************************/
 
+Map::Map() :
+	m_map( new Tmx::Map() ),
+	m_mapID( 0U ),
+	m_season( time::Spring ),
+	m_collision( nullptr ),
+	m_revision( 0U ),
+	m_clockMinute( -1 ),
+	m_isExterior( true )
+{
+}
+
 Map::~Map()
 {
-	for ( Map::Object * obj : m_objects )
-		delete obj;
+	// Characters that outlive the map must not remove themselves from it
+	m_characters.forEach( []( const Character * c, const sf::FloatRect& ) { c->m_placedMap = nullptr; } );
+
+	m_objects.forEach( [this]( Map::ObjectHandle, Map::Object * obj ) { m_arena.destroy( obj ); } );
 	m_objects.clear();
+	m_arena.release();
 }
 
 bool Map::adjustSprite( const Tmx::Layer& layer, sf::Vector2u pos, sf::Sprite& sprite ) const
 {
-	assertBounds( pos, getWidth(), getHeight() );
+	if ( getWidth() <= pos.x || getHeight() <= pos.y ) return false;
 
-	const Tmx::MapTile& tile = layer.GetTile( pos.x, pos.y );
-	if ( tile.tileset == nullptr ) return false;
+	const Tmx::MapCell cell = layer.GetTileRaw( pos.x, pos.y );
+	const int tileset = Tmx::GetMapCellTilesetIndex( cell );
+	if ( tileset < 0 ) return false;
 
-	const Tmx::Tileset& tileset = *tile.tileset;
-
-	const std::shared_ptr< sf::Texture >& texture = m_textures.find( &tileset )->second;
-	unsigned tilesetWidth = texture->getSize().x / TILE_WIDTH;
-	
-	sf::IntRect rect;
-	rect.left	= tile.id % tilesetWidth * TILE_WIDTH;
-	rect.top	= tile.id / tilesetWidth * TILE_HEIGHT;
-	rect.width	= TILE_WIDTH;
-	rect.height = TILE_HEIGHT;
+	const unsigned id = Tmx::GetMapCellId( cell );
+	const TileTable& table = m_tileTables[ tileset ];
+	if ( table.rects.size() <= id ) return false;
 
 	sprite.setPosition( (float) pos.x * TILE_WIDTH, (float) pos.y * TILE_HEIGHT );
-	sprite.setTexture( *texture );
-	sprite.setTextureRect( rect );
+	sprite.setTexture( *table.texture );
+	sprite.setTextureRect( table.rects[ id ] );
 
 	return true;
 }
 
+void Map::buildMesh( gfx::TileMesh& mesh, const std::vector< const Tmx::Layer* >& layers ) const
+{
+	mesh.reset( getWidth(), getHeight() );
+
+	sf::Vertex quad[ 4 ];
+	for ( const Tmx::Layer * layer : layers )
+	{
+		mesh.beginLayer();
+
+		for ( unsigned y = 0; y < getHeight(); y++ )
+		{
+			const Tmx::MapCell * row = layer->GetRow( y );
+
+			for ( unsigned x = 0; x < getWidth(); x++ )
+			{
+				const int tileset = Tmx::GetMapCellTilesetIndex( row[ x ] );
+				if ( tileset < 0 ) continue;
+
+				const unsigned id = Tmx::GetMapCellId( row[ x ] );
+				const TileTable& table = m_tileTables[ tileset ];
+				if ( table.rects.size() <= id ) continue;
+
+				auto anim = table.animations.find( id );
+				if ( anim != table.animations.end() )
+				{
+					tileQuad( quad, x, y, anim->second.rects.front(), tileFlip( row[ x ] ) );
+					mesh.append( x, y, *table.texture, quad, &anim->second, tileFlip( row[ x ] ) );
+				}
+				else
+				{
+					tileQuad( quad, x, y, table.rects[ id ], tileFlip( row[ x ] ) );
+					mesh.append( x, y, *table.texture, quad );
+				}
+			}
+		}
+	}
+}
+
 bool Map::checkTileCollision( const sf::Vector2u& pos ) const
 {
-	return m_collision && ( 0 <= pos.x && pos.x < getWidth() && 0 <= pos.y && pos.y < getHeight() ) && m_collision->GetTile( pos.x, pos.y ).tileset != 0;
+	return m_staticCollision.test( pos.x, pos.y ) || m_dynamicCollision.test( pos.x, pos.y );
+}
+
+bool Map::checkTileCollision( const sf::IntRect& tiles ) const
+{
+	const unsigned left = (unsigned) std::max( tiles.left, 0 ), top = (unsigned) std::max( tiles.top, 0 );
+	const unsigned right = (unsigned) std::max( tiles.left + tiles.width, 0 ), bottom = (unsigned) std::max( tiles.top + tiles.height, 0 );
+
+	return m_staticCollision.any( left, top, right, bottom ) || m_dynamicCollision.any( left, top, right, bottom );
+}
+
+void Map::setCollision( const sf::IntRect& tiles, bool solid )
+{
+	const unsigned left = (unsigned) std::max( tiles.left, 0 ), top = (unsigned) std::max( tiles.top, 0 );
+	const unsigned right = (unsigned) std::max( tiles.left + tiles.width, 0 ), bottom = (unsigned) std::max( tiles.top + tiles.height, 0 );
+
+	const unsigned width = getWidth();
+	for ( unsigned y = top; y < std::min( bottom, getHeight() ); y++ )
+		for ( unsigned x = left; x < std::min( right, width ); x++ )
+		{
+			sf::Uint16& holds = m_dynamicHolds[ y * width + x ];
+			if ( solid && holds++ == 0U )
+				m_dynamicCollision.set( x, y );
+			else if ( !solid && holds > 0U && --holds == 0U )
+				m_dynamicCollision.set( x, y, false );
+		}
 }
 
 bool Map::checkObjectCollision( const sf::Vector2f& pos ) const
 {
-	if ( !m_collision ) 
+	// Object shapes are solid with or without a collision layer, as they are for sweep()
+	bool collision = false;
+	m_objectGrid.query( pos, [&]( ObjectHandle h ) { collision = collision || objectCollision( h, pos ); } );
+	return collision;
+}
+
+bool Map::objectCollision( ObjectHandle h, const sf::Vector2f& pos ) const
+{
+	const sf::FloatRect& bounds = m_components.bounds[ h.index ];
+	if ( !m_components.solid[ h.index ] || !bounds.contains( pos ) )
 		return false;
 
-	for ( Map::Object * obj : m_objects )
-		if ( obj->getBounds().contains( pos ) && obj->hasCollision( pos - obj->getPosition() ) )
-			return true;
-	return false;
+	const CollisionShape& shape = m_components.shape[ h.index ];
+	const sf::Vector2f local( pos.x - bounds.left, pos.y - bounds.top );
+
+	if ( shape.type == CollisionShape::Callback )
+		return getObject( h )->hasCollision( local );
+	return shape.contains( bounds, local );
 }
 
-void Map::load( unsigned id, const std::string& map )
+// The leading edge of a box moving along an axis, and the extent it covers on the other one
+struct Edge
 {
-	m_mapID = id;
-	m_map.ParseFile( map );
+	float position, from, to;
+};
+
+inline Edge leadingEdge( const sf::FloatRect& box, float delta, bool horizontal )
+{
+	Edge e;
+	if ( horizontal )
+	{
+		e.position = delta > 0.0f ? box.left + box.width : box.left;
+		e.from = box.top;
+		e.to = box.top + box.height;
+	}
+	else
+	{
+		e.position = delta > 0.0f ? box.top + box.height : box.top;
+		e.from = box.left;
+		e.to = box.left + box.width;
+	}
+	return e;
+}
 
-	if ( m_map.HasError() )
-		throw Exception( m_map.GetErrorText().c_str() );
+float Map::sweepTiles( const sf::FloatRect& box, float delta, bool horizontal ) const
+{
+	const Edge e = leadingEdge( box, delta, horizontal );
+	const int size = horizontal ? TILE_WIDTH : TILE_HEIGHT, other = horizontal ? TILE_HEIGHT : TILE_WIDTH;
+	const int count = horizontal ? (int) getWidth() : (int) getHeight();
 
-	m_collision = nullptr;
-	std::fill( m_neighbors.begin(), m_neighbors.end(), std::make_pair( nullptr, 0 ) );
+	// The strip of tiles the box covers on the other axis
+	const int from = (int) std::floor( e.from / other ), to = (int) std::ceil( e.to / other );
+
+	auto solid = [&]( int line )
+	{
+		return horizontal ? checkTileCollision( sf::IntRect( line, from, 1, to - from ) ) : checkTileCollision( sf::IntRect( from, line, to - from, 1 ) );
+	};
 
-	// Load tilesets
-	const auto& tilesets = m_map.GetTilesets();
-	for ( auto it = tilesets.begin(); it != tilesets.end(); ++it )
+	// Walk the tile lines the leading edge enters, skipping the one it is already in; tiles off the map are never solid
+	if ( delta > 0.0f )
 	{
-		const std::string& base = (*it)->GetSource();
+		const int first = std::max( (int) std::ceil( e.position / size ), 0 );
+		const int last = std::min( (int) std::ceil( ( e.position + delta ) / size ) - 1, count - 1 );
 
-		std::string file;
-		if ( !base.empty() ) // If externally loaded, prepend the location minus the final '/'
-			file = base.substr( 0, base.find_last_of( '/' ) + 1 );
-		file += (*it)->GetImage()->GetSource();
+		for ( int line = first; line <= last; line++ )
+			if ( solid( line ) )
+				return std::min( delta, line * size - e.position );
+	}
+	else
+	{
+		const int first = std::min( (int) std::floor( e.position / size ) - 1, count - 1 );
+		const int last = std::max( (int) std::floor( ( e.position + delta ) / size ), 0 );
 
-		std::shared_ptr< sf::Texture > texture = res::loadTexture( file );
-		m_textures.insert( std::make_pair( *it, texture ) );
+		for ( int line = first; line >= last; line-- )
+			if ( solid( line ) )
+				return std::max( delta, ( line + 1 ) * size - e.position );
 	}
 
-	// Load layers
-	const auto& layers = m_map.GetLayers();
-	for ( auto it = layers.begin(); it != layers.end(); ++it )
+	return delta;
+}
+
+float Map::sweepObjects( const sf::FloatRect& box, float delta, bool horizontal, float allowed ) const
+{
+	// Shapes other than rects are probed along the leading edge: marched in at most
+	// MARCH_STEPS steps, then the first blocked step is bisected
+	enum { MARCH_STEPS = 16, BISECTIONS = 6 };
+	const float EPSILON = 0.01f, MIN_STEP = 4.0f, PROBE_SPACING = TILE_WIDTH / 2.0f;
+
+	const Edge e = leadingEdge( box, delta, horizontal );
+	const float sign = delta > 0.0f ? 1.0f : -1.0f;
+
+	sf::FloatRect swept = horizontal
+		? sf::FloatRect( std::min( e.position, e.position + delta ), box.top, std::abs( delta ), box.height )
+		: sf::FloatRect( box.left, std::min( e.position, e.position + delta ), box.width, std::abs( delta ) );
+
+	m_objectGrid.query( swept, [&]( ObjectHandle h )
 	{
-		const auto& properties = (*it)->GetProperties().GetList();
-		bool add = true, upper = false;
+		const CollisionShape::Type type = m_components.shape[ h.index ].type;
+		if ( !m_components.solid[ h.index ] || type == CollisionShape::None )
+			return;
 
-		if ( m_collision == nullptr )
+		const sf::FloatRect& b = m_components.bounds[ h.index ];
+		const float face = horizontal ? ( sign > 0.0f ? b.left : b.left + b.width ) : ( sign > 0.0f ? b.top : b.top + b.height );
+		const float distance = face - e.position;
+
+		// Already overlapping: let the box out
+		if ( distance * sign < 0.0f )
+			return;
+
+		if ( type == CollisionShape::Rect )
 		{
-			std::string name = (*it)->GetName();
-			std::transform( name.begin(), name.end(), name.begin(), ::tolower );
-			if ( name == "collision" )
-			{
-				m_collision = *it;
-				continue;
-			}
+			if ( distance * sign < allowed * sign )
+				allowed = distance;
+			return;
 		}
 
-		auto findSeason = properties.find( "season" );
-		if ( findSeason != properties.end() )
-			add = time::parseSeasons( findSeason->second )[ m_season ];
+		// Whether the leading edge moved by t (along the movement) touches the shape
+		auto blocked = [&]( float t )
+		{
+			const float p = e.position + t - sign * EPSILON;
+			const int probes = std::max( 1, (int) std::ceil( ( e.to - e.from ) / PROBE_SPACING ) );
 
-		auto findRender = properties.find( "render" );
-		if ( findRender != properties.end() )
-			upper = ( findRender->second == "above" );
+			for ( int i = 0; i <= probes; i++ )
+			{
+				const float q = std::min( e.from + i * ( e.to - e.from ) / probes, e.to - EPSILON );
+				if ( objectCollision( h, horizontal ? sf::Vector2f( p, q ) : sf::Vector2f( q, p ) ) )
+					return true;
+			}
+			return false;
+		};
 
-		if ( add ) 
-			( upper ? m_upper : m_lower ).push_back( *it );
-	}
+		if ( blocked( 0.0f ) )
+			return;
 
-	// Load objects
-	const auto& objects = m_map.GetObjectGroups();
-	for ( auto it = objects.begin(); it != objects.end(); ++it )
-	{
-		const auto& objectGroup = (*it)->GetObjects();
-		for ( auto ij = objectGroup.begin(); ij != objectGroup.end(); ++ij )
+		const int steps = std::min( (int) MARCH_STEPS, std::max( 1, (int) std::ceil( std::abs( allowed ) / MIN_STEP ) ) );
+		float clear = 0.0f;
+		for ( int i = 1; i <= steps; i++ )
 		{
-			const Tmx::Object& object = *(*ij);
-			const std::string& name = object.GetName();
-
-			try
+			const float t = allowed * i / steps;
+			if ( !blocked( t ) )
 			{
-				m_objects.push_back( generateObject( object ) );
+				clear = t;
+				continue;
 			}
-			catch ( std::exception& err )
+
+			float hit = t;
+			for ( int j = 0; j < BISECTIONS; j++ )
 			{
-				Console::singleton() << con::setcerr << map << ": failed to load object \"" << name << "\": " << err.what() << con::endl;
+				const float mid = ( clear + hit ) / 2.0f;
+				( blocked( mid ) ? hit : clear ) = mid;
 			}
+
+			allowed = clear;
+			return;
 		}
-	}
-	
-	const auto & properties = m_map.GetProperties().GetList();
-	auto find = properties.find( "type" );
-	if ( find != properties.end() )
-		m_isExterior = find->second != "interior";
-	else
-		m_isExterior = true;
+	} );
 
-	if ( !m_collision )
-		Console::singleton() << con::setcerr << "Warning: Map \"" << map << "\" does not have a collision layer!" << con::endl;
+	return allowed;
 }
 
-void Map::loadNeighbors()
+float Map::sweepCharacters( const sf::FloatRect& box, float delta, bool horizontal, float allowed, const Character * self ) const
 {
-	const auto& properties = m_map.GetProperties().GetList();
+	const Edge e = leadingEdge( box, delta, horizontal );
+	const float sign = delta > 0.0f ? 1.0f : -1.0f;
 
-	setNeighbor( properties, "north", m_neighbors[ Up ] );
-	setNeighbor( properties, "south", m_neighbors[ Down ] );
-	setNeighbor( properties, "west", m_neighbors[ Left ] );
-	setNeighbor( properties, "east", m_neighbors[ Right ] );
+	sf::FloatRect swept = horizontal
+		? sf::FloatRect( std::min( e.position, e.position + delta ), box.top, std::abs( delta ), box.height )
+		: sf::FloatRect( box.left, std::min( e.position, e.position + delta ), box.width, std::abs( delta ) );
+
+	m_characters.query( swept, [&]( const Character * c, const sf::FloatRect& b )
+	{
+		if ( c == self || !c->isCollisionEnabled() )
+			return;
+
+		const float face = horizontal ? ( sign > 0.0f ? b.left : b.left + b.width ) : ( sign > 0.0f ? b.top : b.top + b.height );
+		const float distance = face - e.position;
+
+		// Already overlapping: let the box out
+		if ( distance * sign >= 0.0f && distance * sign < allowed * sign )
+			allowed = distance;
+	} );
+
+	return allowed;
 }
 
-void Map::reloadObject( const std::string & objStr )
+Map::Sweep Map::sweep( const sf::FloatRect& box, const sf::Vector2f& delta, const Character * self ) const
 {
-	std::vector< Map::Object * >::iterator objItr;
-	for ( objItr = m_objects.begin(); objItr != m_objects.end(); objItr++ )
-		if ( (*objItr)->getName() == objStr )
-			break;
-		
-	Map::Object * obj = nullptr;
-	const Tmx::Object * objTmx = nullptr;
-	
-	if ( objItr != m_objects.end() )
-	{
-		// retrieve the object and delete it (note: the address is still exists)
-		obj = *objItr;
-		objTmx = &obj->getObject();
-		delete obj;
-	
-		// erase from objects vector
-		m_objects.erase( objItr );
-	
-		// if in active objects, find and remove it
-		auto find = std::find( m_activeObjects.begin(), m_activeObjects.end(), obj );
-		if ( find != m_activeObjects.end() ) m_activeObjects.erase( find );
-	}
-	else
+	Sweep result;
+	result.time = 1.0f;
+
+	sf::FloatRect moved = box;
+
+	for ( int axis = 0; axis < 2; axis++ )
 	{
-		const auto & objects = m_map.GetObjectGroups();
-		for ( auto it = objects.begin(); it != objects.end() && objTmx == nullptr; ++it )
+		const bool horizontal = axis == 0;
+		const float d = horizontal ? delta.x : delta.y;
+		if ( d == 0.0f )
+			continue;
+
+		float allowed = sweepTiles( moved, d, horizontal );
+		allowed = sweepObjects( moved, d, horizontal, allowed );
+		if ( self != nullptr )
+			allowed = sweepCharacters( moved, d, horizontal, allowed, self );
+
+		if ( allowed != d )
 		{
-			const auto& objectGroup = (*it)->GetObjects();
-			for ( auto ij = objectGroup.begin(); ij != objectGroup.end() && objTmx == nullptr; ++ij )
+			const float time = allowed / d;
+			if ( time < result.time )
 			{
-				const Tmx::Object & object = *(*ij);
-				if ( object.GetName() == objStr )
-					objTmx = &object;
+				result.time = time;
+				result.normal = horizontal ? sf::Vector2f( d > 0.0f ? -1.0f : 1.0f, 0.0f ) : sf::Vector2f( 0.0f, d > 0.0f ? -1.0f : 1.0f );
 			}
 		}
+
+		( horizontal ? moved.left : moved.top ) += allowed;
+		( horizontal ? result.delta.x : result.delta.y ) = allowed;
 	}
-	
-	// generate the object
-	obj = generateObject( *objTmx );
-	
-	// add the object to the object vector
-	m_objects.push_back( obj );
+
+	return result;
 }
 
-void Map::update( sf::Uint32 frameTime, const sf::Vector2f& pos )
+void Map::season( time::Season s )
 {
-	// Check if the player has left any of the active objects and call their onExit
-	for ( Map::Object * object : m_activeObjects )
-		if ( !object->getBounds().contains( pos ) )
-		{
-			try { object->onExit( frameTime, pos - object->getPosition() ); }
-			catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
-			m_activeObjects.erase( std::find( m_activeObjects.begin(), m_activeObjects.end(), object ) );
-		}
+	if ( s == m_season )
+		return;
 
-	// Update all objects on the map
-	for ( Map::Object * object : m_objects )
+	m_season = s;
+
+	// Seasonal layers have to be reselected once the map is loaded
+	if ( !m_map->GetLayers().empty() )
+		selectLayers();
+}
+
+void Map::readLayers()
+{
+	const auto& layers = m_map->GetLayers();
+	m_layerInfo.clear();
+	m_collision = nullptr;
+
+	for ( auto it = layers.begin(); it != layers.end(); ++it )
+	{
+		const auto& properties = (*it)->GetProperties().GetList();
+		LayerInfo info = { 0x0F, false, false };
+
+		if ( m_collision == nullptr )
+		{
+			std::string name = (*it)->GetName();
+			std::transform( name.begin(), name.end(), name.begin(), ::tolower );
+			if ( name == "collision" )
+			{
+				m_collision = *it;
+				info.collision = true;
+			}
+		}
+
+		auto findSeason = properties.find( "season" );
+		if ( findSeason != properties.end() )
+			info.seasons = (unsigned char) time::parseSeasons( findSeason->second ).to_ulong();
+
+		auto findRender = properties.find( "render" );
+		if ( findRender != properties.end() )
+			info.upper = ( findRender->second == "above" );
+
+		m_layerInfo.push_back( info );
+	}
+
+	// Bake the collision layer
+	m_staticCollision.reset( getWidth(), getHeight() );
+	if ( m_collision )
+		for ( unsigned y = 0; y < getHeight(); y++ )
+		{
+			const Tmx::MapCell * row = m_collision->GetRow( y );
+			for ( unsigned x = 0; x < getWidth(); x++ )
+				if ( Tmx::GetMapCellTilesetIndex( row[ x ] ) >= 0 )
+					m_staticCollision.set( x, y );
+		}
+}
+
+void Map::selectLayers()
+{
+	m_lower.clear();
+	m_upper.clear();
+
+	const auto& layers = m_map->GetLayers();
+	for ( unsigned i = 0; i < layers.size(); i++ )
+	{
+		const LayerInfo& info = m_layerInfo[ i ];
+		if ( !info.collision && ( ( info.seasons >> m_season ) & 1U ) )
+			( info.upper ? m_upper : m_lower ).push_back( layers[ i ] );
+	}
+
+	// Build the static tile meshes
+	buildMesh( m_lowerMesh, m_lower );
+	buildMesh( m_upperMesh, m_upper );
+	if ( m_collision )
+		buildMesh( m_collisionMesh, std::vector< const Tmx::Layer* >( 1, m_collision ) );
+	else
+		m_collisionMesh.reset( 0U, 0U );
+
+	m_revision++;
+}
+
+void Map::load( unsigned id, const std::string& map )
+{
+	m_mapID = id;
+
+	std::fill( m_neighbors.begin(), m_neighbors.end(), std::make_pair( nullptr, 0 ) );
+
+	if ( !loadBaked( map ) )
+	{
+		m_map->ParseFile( map );
+
+		if ( m_map->HasError() )
+			throw Exception( m_map->GetErrorText().c_str() );
+
+		readLayers();
+
+		// Load tilesets and precompute the texture rect of every tile
+		const auto& tilesets = m_map->GetTilesets();
+		m_tileTables.clear();
+		m_tileTables.resize( tilesets.size() );
+		for ( unsigned i = 0; i < tilesets.size(); i++ )
+		{
+			// Tilesets are packed into the shared atlas so maps batch across them
+			const res::AtlasRegion region = res::loadRegion( tilesetImage( *tilesets[ i ] ) );
+			loadTileTable( m_tileTables[ i ], region, tileCorners( region.rect.width, region.rect.height ), *tilesets[ i ] );
+		}
+	}
+
+	// Load layers
+	selectLayers();
+
+	// Load objects
+	m_dynamicCollision.reset( getWidth(), getHeight() );
+	m_dynamicHolds.assign( getWidth() * getHeight(), 0U );
+	m_objectGrid.reset( (float) getWidth() * TILE_WIDTH, (float) getHeight() * TILE_HEIGHT, OBJECT_CELL_SIZE );
+	m_lights.clear();
+	const auto& objects = m_map->GetObjectGroups();
+	for ( auto it = objects.begin(); it != objects.end(); ++it )
+	{
+		const auto& objectGroup = (*it)->GetObjects();
+		for ( auto ij = objectGroup.begin(); ij != objectGroup.end(); ++ij )
+		{
+			const Tmx::Object& object = *(*ij);
+			const std::string& name = object.GetName();
+
+			try
+			{
+				// Lights are only drawn by the lightmap and never become map objects
+				if ( object.GetType() == "light" )
+					m_lights.push_back( parseLight( object ) );
+				else
+				{
+					m_tmxObjects.insert( std::make_pair( name, &object ) );
+					addObject( generateObject( *this, object ) );
+				}
+			}
+			catch ( std::exception& err )
+			{
+				Console::singleton() << con::setcerr << map << ": failed to load object \"" << name << "\": " << err.what() << con::endl;
+			}
+		}
+	}
+	
+	const auto & properties = m_map->GetProperties().GetList();
+	auto find = properties.find( "type" );
+	if ( find != properties.end() )
+		m_isExterior = find->second != "interior";
+	else
+		m_isExterior = true;
+
+	if ( !m_collision )
+		Console::singleton() << con::setcerr << "Warning: Map \"" << map << "\" does not have a collision layer!" << con::endl;
+}
+
+void Map::loadNeighbors()
+{
+	const auto& properties = m_map->GetProperties().GetList();
+
+	setNeighbor( properties, "north", m_neighbors[ Up ] );
+	setNeighbor( properties, "south", m_neighbors[ Down ] );
+	setNeighbor( properties, "west", m_neighbors[ Left ] );
+	setNeighbor( properties, "east", m_neighbors[ Right ] );
+}
+
+void Map::reloadObject( const std::string & objStr )
+{
+	auto tmx = m_tmxObjects.find( objStr );
+	if ( tmx == m_tmxObjects.end() )
+		throw Exception( "no object named \"" + objStr + "\"" );
+
+	// handles to the old object, in the grid and trigger lists or held by Lua, stop finding it
+	removeObject( findObject( objStr ) );
+	addObject( generateObject( *this, *tmx->second ) );
+}
+
+Map::Object * Map::getObject( ObjectHandle h ) const
+{
+	Map::Object * const * obj = m_objects.get( h );
+	return obj ? *obj : nullptr;
+}
+
+Map::ObjectHandle Map::findObject( const std::string & name ) const
+{
+	auto find = m_objectNames.find( name );
+	return find != m_objectNames.end() ? find->second : ObjectHandle();
+}
+
+void Map::addObject( Map::Object * obj )
+{
+	const ObjectHandle h = obj->getHandle();
+
+	m_objectNames.insert( std::make_pair( obj->getName(), h ) );
+	m_objectGrid.insert( h, obj->getBounds() );
+
+	// objects may have gone to sleep while loading
+	if ( obj->isAwake() )
+	{
+		obj->m_listed = true;
+		m_awakeObjects.push_back( h );
+	}
+}
+
+void Map::removeObject( ObjectHandle h )
+{
+	Map::Object * obj = getObject( h );
+	if ( obj == nullptr )
+		return;
+
+	auto name = m_objectNames.find( obj->getName() );
+	if ( name != m_objectNames.end() && name->second == h )
+		m_objectNames.erase( name );
+
+	m_objectGrid.remove( h, obj->getBounds() );
+	m_objects.remove( h );
+	m_arena.destroy( obj );
+
+	// the slot's components are reused by the next object, drop the mask image until then
+	m_components.shape[ h.index ] = CollisionShape();
+}
+
+Map::ObjectHandle Map::registerObject( Map::Object * obj, const sf::FloatRect& bounds )
+{
+	const ObjectHandle h = m_objects.insert( obj );
+
+	if ( m_components.bounds.size() <= h.index )
+	{
+		m_components.bounds.resize( h.index + 1 );
+		m_components.depth.resize( h.index + 1 );
+		m_components.shape.resize( h.index + 1 );
+		m_components.solid.resize( h.index + 1 );
+	}
+
+	m_components.bounds[ h.index ] = bounds;
+	m_components.depth[ h.index ] = bounds.top + bounds.height;
+	m_components.shape[ h.index ] = CollisionShape();
+	m_components.solid[ h.index ] = 1;
+	return h;
+}
+
+// Replaces inside with the objects containing pos and lists the ones that were entered and exited
+// The sets are kept sorted, so the differences are a single merge
+static void updateTriggers( const util::SpatialGrid< Map::ObjectHandle >& grid, const sf::Vector2f& pos, std::vector< Map::ObjectHandle >& inside, std::vector< Map::ObjectHandle >& entered, std::vector< Map::ObjectHandle >& exited )
+{
+	std::vector< Map::ObjectHandle > now;
+	grid.query( pos, [&]( Map::ObjectHandle h ) { now.push_back( h ); } );
+	std::sort( now.begin(), now.end() );
+
+	entered.clear();
+	exited.clear();
+	std::set_difference( now.begin(), now.end(), inside.begin(), inside.end(), std::back_inserter( entered ) );
+	std::set_difference( inside.begin(), inside.end(), now.begin(), now.end(), std::back_inserter( exited ) );
+
+	inside.swap( now );
+}
+
+void Map::update( sf::Uint32 frameTime, const sf::Vector2f& pos, const std::vector< const Character* >& characters )
+{
+	// Work out which objects the player entered and exited before calling any of them
+	// The callbacks may reload objects, whose handles then find nothing
+	std::vector< ObjectHandle > entered, exited;
+	updateTriggers( m_objectGrid, pos, m_activeObjects, entered, exited );
+
+	for ( ObjectHandle h : exited )
+	{
+		Map::Object * object = getObject( h );
+		if ( object == nullptr )
+			continue;
+
+		object->wake();
+		try { object->onExit( frameTime, pos - object->getPosition() ); }
+		catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
+	}
+
+	// Wake the sleeping objects that are due
+	auto due = [this]( const Sleeper& s )
 	{
+		Map::Object * object = getObject( s.first );
+		if ( object != nullptr && !object->isAwake() && object->m_sleep == s.second )
+			object->wake();
+	};
+	m_sleepers.advance( frameTime, due );
+
+	const int minute = Time::singleton().getHour().getRaw();
+	if ( m_clockMinute >= 0 )
+		m_clockSleepers.advance( ( minute - m_clockMinute + MINUTES_PER_DAY ) % MINUTES_PER_DAY, due );
+	m_clockMinute = minute;
+
+	// Update the awake objects, those woken meanwhile start on the next update
+	const std::size_t awake = m_awakeObjects.size();
+	for ( std::size_t i = 0; i < awake; i++ )
+	{
+		Map::Object * object = getObject( m_awakeObjects[ i ] );
+		if ( object == nullptr || !object->isAwake() )
+			continue;
+
 		try { object->update( frameTime, pos - object->getPosition() ); }
 		catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
 	}
 
-	// Update all active objects
-	for ( Map::Object * object : m_activeObjects )
+	m_awakeObjects.erase( std::remove_if( m_awakeObjects.begin(), m_awakeObjects.end(), [this]( ObjectHandle h )
+	{
+		Map::Object * object = getObject( h );
+		if ( object == nullptr )
+			return true;
+		object->m_listed = object->isAwake();
+		return !object->m_listed;
+	} ), m_awakeObjects.end() );
+
+	// Objects the player was already inside
+	std::vector< ObjectHandle > stayed;
+	std::set_difference( m_activeObjects.begin(), m_activeObjects.end(), entered.begin(), entered.end(), std::back_inserter( stayed ) );
+
+	for ( ObjectHandle h : stayed )
 	{
+		Map::Object * object = getObject( h );
+		if ( object == nullptr )
+			continue;
+
 		try { object->whileInside( frameTime, pos - object->getPosition() ); }
 		catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
 	}
 
-	// Check if the player has entered any new objects
-	for ( Map::Object * object : m_objects )
+	for ( ObjectHandle h : entered )
+	{
+		Map::Object * object = getObject( h );
+		if ( object == nullptr )
+			continue;
+
+		object->wake();
+		try { object->onEnter( frameTime, pos - object->getPosition() ); }
+		catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
+	}
+
+	// Characters are tracked from the first update they are on this map until they leave it
+	for ( const Character * c : characters )
 	{
-		const sf::FloatRect& rect = object->getBounds();
-		if ( rect.contains( pos ) && std::find( m_activeObjects.begin(), m_activeObjects.end(), object ) == m_activeObjects.end() )
+		auto tracked = std::find_if( m_characterObjects.begin(), m_characterObjects.end(), [c]( const std::pair< const Character*, std::vector< ObjectHandle > >& p ) { return p.first == c; } );
+		const bool here = c->getMapID() == m_mapID;
+
+		if ( !here && tracked == m_characterObjects.end() )
+			continue;
+		if ( tracked == m_characterObjects.end() )
+			tracked = m_characterObjects.insert( m_characterObjects.end(), std::make_pair( c, std::vector< ObjectHandle >() ) );
+
+		if ( here )
+			updateTriggers( m_objectGrid, c->getPosition(), tracked->second, entered, exited );
+		else
+		{
+			entered.clear();
+			exited.swap( tracked->second );
+			m_characterObjects.erase( tracked );
+		}
+
+		for ( ObjectHandle h : exited )
+		{
+			Map::Object * object = getObject( h );
+			if ( object == nullptr )
+				continue;
+
+			object->wake();
+			try { object->onCharacterExit( *c, c->getPosition() - object->getPosition() ); }
+			catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
+		}
+
+		for ( ObjectHandle h : entered )
 		{
-			try { object->onEnter( frameTime, pos - object->getPosition() ); }
+			Map::Object * object = getObject( h );
+			if ( object == nullptr )
+				continue;
+
+			object->wake();
+			try { object->onCharacterEnter( *c, c->getPosition() - object->getPosition() ); }
 			catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
-			m_activeObjects.push_back( object );
 		}
 	}
+
+	updateProximity();
 }
 
 bool Map::interact( const sf::Vector2f& pos )
 {
-	bool ret = false;
-	for ( Map::Object * obj : m_objects )
-		if ( obj->getBounds().contains( pos ) )
+	std::vector< ObjectHandle > found;
+	m_objectGrid.query( pos, [&]( ObjectHandle h ) { found.push_back( h ); } );
+
+	for ( ObjectHandle h : found )
+	{
+		Map::Object * obj = getObject( h );
+		if ( obj == nullptr )
+			continue;
+
+		obj->wake();
+		try { obj->onInteract( pos - obj->getPosition() ); }
+		catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
+	}
+	return !found.empty();
+}
+
+void Map::placeCharacter( const Character& c )
+{
+	m_characters.place( &c, c.getBounds() );
+}
+
+void Map::removeCharacter( const Character& c )
+{
+	// Forget the objects it was inside, so a new character at the same address starts outside of them
+	std::vector< ObjectHandle > inside;
+	auto tracked = std::find_if( m_characterObjects.begin(), m_characterObjects.end(), [&c]( const std::pair< const Character*, std::vector< ObjectHandle > >& p ) { return p.first == &c; } );
+	if ( tracked != m_characterObjects.end() )
+	{
+		inside.swap( tracked->second );
+		m_characterObjects.erase( tracked );
+	}
+
+	for ( ObjectHandle h : inside )
+	{
+		Map::Object * object = getObject( h );
+		if ( object == nullptr )
+			continue;
+
+		object->wake();
+		try { object->onCharacterExit( c, c.getPosition() - object->getPosition() ); }
+		catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
+	}
+
+	if ( !m_characters.contains( &c ) )
+		return;
+
+	m_characters.remove( &c );
+
+	// The objects it was near find out now, the character may be gone by the next update
+	std::vector< ObjectHandle > left;
+	for ( ProximityWatch& watch : m_proximity )
+	{
+		auto find = std::lower_bound( watch.near.begin(), watch.near.end(), &c );
+		if ( find != watch.near.end() && *find == &c )
+		{
+			watch.near.erase( find );
+			left.push_back( watch.object );
+		}
+	}
+
+	for ( ObjectHandle h : left )
+	{
+		Map::Object * object = getObject( h );
+		if ( object == nullptr )
+			continue;
+
+		object->wake();
+		try { object->onProximityExit( c, c.getPosition() - object->getPosition() ); }
+		catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
+	}
+}
+
+void Map::watchProximity( ObjectHandle h, float radius )
+{
+	auto find = std::find_if( m_proximity.begin(), m_proximity.end(), [h]( const ProximityWatch& w ) { return w.object == h; } );
+
+	if ( radius <= 0.0f )
+	{
+		if ( find != m_proximity.end() )
+			m_proximity.erase( find );
+		return;
+	}
+
+	if ( find == m_proximity.end() )
+	{
+		ProximityWatch watch;
+		watch.object = h;
+		find = m_proximity.insert( m_proximity.end(), watch );
+	}
+	find->radius = radius;
+}
+
+void Map::updateProximity()
+{
+	m_proximity.erase( std::remove_if( m_proximity.begin(), m_proximity.end(), [this]( const ProximityWatch& w ) { return getObject( w.object ) == nullptr; } ), m_proximity.end() );
+
+	// Gathered first, as the callbacks may change the watches
+	struct Event
+	{
+		ObjectHandle object;
+		const Character * character;
+		bool enter;
+	};
+	std::vector< Event > events;
+	std::vector< const Character * > near, changed;
+
+	for ( ProximityWatch& watch : m_proximity )
+	{
+		const sf::FloatRect& b = m_components.bounds[ watch.object.index ];
+		const sf::FloatRect area( b.left - watch.radius, b.top - watch.radius, b.width + 2.0f * watch.radius, b.height + 2.0f * watch.radius );
+
+		near.clear();
+		m_characters.query( area, [&]( const Character * c, const sf::FloatRect& ) { near.push_back( c ); } );
+		std::sort( near.begin(), near.end() );
+
+		changed.clear();
+		std::set_difference( watch.near.begin(), watch.near.end(), near.begin(), near.end(), std::back_inserter( changed ) );
+		for ( const Character * c : changed )
 		{
-			try { obj->onInteract( pos - obj->getPosition() ); }
-			catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
-			ret = true;
+			Event e = { watch.object, c, false };
+			events.push_back( e );
+		}
+
+		changed.clear();
+		std::set_difference( near.begin(), near.end(), watch.near.begin(), watch.near.end(), std::back_inserter( changed ) );
+		for ( const Character * c : changed )
+		{
+			Event e = { watch.object, c, true };
+			events.push_back( e );
+		}
+
+		watch.near.swap( near );
+	}
+
+	for ( const Event& e : events )
+	{
+		Map::Object * object = getObject( e.object );
+		if ( object == nullptr )
+			continue;
+
+		object->wake();
+		const sf::Vector2f pos = e.character->getPosition() - object->getPosition();
+
+		try
+		{
+			if ( e.enter )
+				object->onProximityEnter( *e.character, pos );
+			else
+				object->onProximityExit( *e.character, pos );
+		}
+		catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
+	}
+}
+
+/***************************************************************************/
+
+//-------------------------------------------------------------------------
+// A .bfmap is a TMX map compiled by Map::bake so loading it is a mmap and
+// a walk over fixed size records instead of XML, base64 and zlib
+//
+// LAYOUT
+//
+//		BakeHeader
+//		Tmx::Map::WriteBinary of the TMX map: its tilesets, objects, property
+//			tables (every string stored once) and the packed tile cells of its
+//			layers, which the Tmx::Map reads in place from the mapping
+//		Game section, a Tmx::BinaryWriter stream of
+//			every layer: season mask, drawn above characters, collision layer
+//			collision bitmap: width, height, BitGrid rows
+//			every tileset: image, image size, top left of every tile in the image
+//
+// The atlas places tileset images at runtime, so the tile rects are stored
+// relative to the image and offset by its region on load
+// Values are in the byte order of the machine that baked them, bakes of an
+// other byte order or version are refused and the TMX is loaded instead
+//-------------------------------------------------------------------------
+struct BakeHeader
+{
+	char magic[ 8 ];
+	sf::Uint32 version;
+	sf::Uint32 tmxSize;		// of the Tmx::Map, the game section follows it
+};
+
+static const char BAKE_MAGIC[ 8 ] = "BFMAP";
+static const sf::Uint32 BAKE_VERSION = 1U;
+
+// Modification time of a file, false when it does not exist
+inline bool modified( const std::string& file, std::time_t& time )
+{
+	struct stat info;
+	if ( stat( file.c_str(), &info ) != 0 )
+		return false;
+
+	time = info.st_mtime;
+	return true;
+}
+
+std::string Map::bakedFile( const std::string& map )
+{
+	const std::string::size_type dot = map.find_last_of( '.' ), slash = map.find_last_of( '/' );
+	if ( dot == std::string::npos || ( slash != std::string::npos && dot < slash ) )
+		return map + ".bfmap";
+
+	return map.substr( 0, dot ) + ".bfmap";
+}
+
+void Map::bake( const std::string& map )
+{
+	Map baked;
+	baked.m_map->ParseFile( map );
+
+	if ( baked.m_map->HasError() )
+		throw Exception( map + ": " + baked.m_map->GetErrorText() );
+
+	baked.readLayers();
+
+	std::string tmx;
+	baked.m_map->WriteBinary( &tmx );
+
+	Tmx::BinaryWriter game;
+
+	game.WriteInt( baked.m_layerInfo.size() );
+	for ( const LayerInfo& info : baked.m_layerInfo )
+	{
+		game.WriteInt( info.seasons );
+		game.WriteInt( info.upper );
+		game.WriteInt( info.collision );
+	}
+
+	game.WriteInt( baked.m_staticCollision.getWidth() );
+	game.WriteInt( baked.m_staticCollision.getHeight() );
+	game.WriteBytes( baked.m_staticCollision.data(), baked.m_staticCollision.bytes() );
+
+	const auto& tilesets = baked.m_map->GetTilesets();
+	game.WriteInt( tilesets.size() );
+	for ( const Tmx::Tileset * tileset : tilesets )
+	{
+		const std::string image = tilesetImage( *tileset );
+
+		// Tiled records the size of the image, older maps have to have it read
+		sf::Vector2u size( tileset->GetImage()->GetWidth(), tileset->GetImage()->GetHeight() );
+		if ( size.x == 0U || size.y == 0U )
+		{
+			sf::Image file;
+			if ( !file.loadFromFile( image ) )
+				throw Exception( map + ": failed to load tileset image \"" + image + "\"" );
+			size = file.getSize();
+		}
+
+		const std::vector< sf::Vector2i > corners = tileCorners( size.x, size.y );
+
+		game.WriteString( image );
+		game.WriteInt( size.x );
+		game.WriteInt( size.y );
+		game.WriteInt( corners.size() );
+		game.WriteBytes( corners.data(), corners.size() * sizeof( sf::Vector2i ) );
+	}
+
+	std::string section;
+	game.Finish( &section );
+
+	BakeHeader header;
+	std::copy( BAKE_MAGIC, BAKE_MAGIC + sizeof( BAKE_MAGIC ), header.magic );
+	header.version = BAKE_VERSION;
+	header.tmxSize = tmx.size();
+
+	// Written beside the bake and renamed over it, so a game that has the old one mapped keeps reading it
+	const std::string file = bakedFile( map ), temp = file + ".tmp";
+	{
+		std::ofstream out( temp.c_str(), std::ios::binary | std::ios::trunc );
+		out.write( reinterpret_cast< const char * >( &header ), sizeof( header ) );
+		out << tmx << section;
+		out.close();
+
+		if ( !out )
+		{
+			std::remove( temp.c_str() );
+			throw Exception( "failed to write \"" + temp + "\"" );
+		}
+	}
+
+#ifdef _WIN32
+	// rename does not replace files there
+	std::remove( file.c_str() );
+#endif
+	if ( std::rename( temp.c_str(), file.c_str() ) != 0 )
+	{
+		std::remove( temp.c_str() );
+		throw Exception( "failed to replace \"" + file + "\"" );
+	}
+}
+
+bool Map::loadBaked( const std::string& map )
+{
+	const std::string file = bakedFile( map );
+
+	// Maps that were never baked are loaded from the TMX without a word
+	std::time_t bakedTime, sourceTime;
+	if ( !modified( file, bakedTime ) )
+		return false;
+
+	if ( modified( map, sourceTime ) && sourceTime > bakedTime )
+	{
+		Console::singleton() << con::setcerr << "Warning: \"" << map << "\" is newer than its bake, loading the TMX (run --bake)" << con::endl;
+		return false;
+	}
+
+	BakeHeader header;
+	// The mapping is kept for the tiles, which are read in any order
+	if ( !m_baked.Open( file, Tmx::TMX_ACCESS_NORMAL ) || m_baked.GetSize() < sizeof( header ) )
+	{
+		Console::singleton() << con::setcerr << "Warning: could not read \"" << file << "\", loading the TMX" << con::endl;
+		m_baked.Close();
+		return false;
+	}
+
+	std::copy( m_baked.GetData(), m_baked.GetData() + sizeof( header ), reinterpret_cast< char * >( &header ) );
+	if ( !std::equal( BAKE_MAGIC, BAKE_MAGIC + sizeof( BAKE_MAGIC ), header.magic ) || header.version != BAKE_VERSION || header.tmxSize > m_baked.GetSize() - sizeof( header ) )
+	{
+		Console::singleton() << con::setcerr << "Warning: \"" << file << "\" is not a bake of this version, loading the TMX (run --bake)" << con::endl;
+		m_baked.Close();
+		return false;
+	}
+
+	// Read into a map of its own, so the TMX can still be parsed if the bake turns out to be bad
+	std::unique_ptr< Tmx::Map > tmx( new Tmx::Map() );
+	const char * data = m_baked.GetData() + sizeof( header );
+	tmx->ParseBinary( data, header.tmxSize );
+
+	const auto& layers = tmx->GetLayers();
+	const auto& tilesets = tmx->GetTilesets();
+
+	Tmx::BinaryReader game( data + header.tmxSize, m_baked.GetSize() - sizeof( header ) - header.tmxSize );
+	std::vector< LayerInfo > layerInfo;
+	const Tmx::Layer * collision = nullptr;
+
+	if ( !tmx->HasError() && game.ReadCount( 12 ) == (int) layers.size() )
+		for ( unsigned i = 0; i < layers.size(); i++ )
+		{
+			LayerInfo info;
+			info.seasons = (unsigned char) game.ReadInt();
+			info.upper = game.ReadInt() != 0;
+			info.collision = game.ReadInt() != 0;
+			layerInfo.push_back( info );
+
+			if ( info.collision && !collision )
+				collision = layers[ i ];
+		}
+
+	// The bitmap has to fit in the bake, which may be damaged
+	const int width = game.ReadInt(), height = game.ReadInt();
+	const bool sized = width == tmx->GetWidth() && height == tmx->GetHeight() && width >= 0 && height >= 0 && (std::size_t) width * height / 8U <= m_baked.GetSize();
+
+	util::BitGrid grid;
+	if ( sized )
+		grid.reset( width, height );
+	const void * words = sized ? game.ReadBytes( grid.bytes() ) : nullptr;
+
+	// Tileset images, their size when baked and the top left of their tiles
+	std::vector< std::pair< std::string, sf::Vector2u > > images;
+	std::vector< std::vector< sf::Vector2i > > corners;
+	bool stale = false;
+
+	if ( game.ReadCount( 16 ) == (int) tilesets.size() )
+		for ( const Tmx::Tileset * tileset : tilesets )
+		{
+			const std::string image = game.ReadString();
+			const unsigned imageWidth = game.ReadInt(), imageHeight = game.ReadInt();
+			images.push_back( std::make_pair( image, sf::Vector2u( imageWidth, imageHeight ) ) );
+
+			const int count = game.ReadCount( sizeof( sf::Vector2i ) );
+			const void * tiles = game.ReadBytes( count * sizeof( sf::Vector2i ) );
+			corners.push_back( std::vector< sf::Vector2i >( count ) );
+			if ( tiles && count > 0 )
+				std::memcpy( &corners.back()[ 0 ], tiles, count * sizeof( sf::Vector2i ) );
+
+			if ( !tileset->GetSource().empty() && modified( tileset->GetSource(), sourceTime ) && sourceTime > bakedTime )
+				stale = true;
 		}
-	return ret;
+
+	if ( tmx->HasError() || game.HasError() || layerInfo.size() != layers.size() || images.size() != tilesets.size() || words == nullptr )
+	{
+		const std::string error = tmx->HasError() ? tmx->GetErrorText() : game.HasError() ? game.GetErrorText() : "its sections do not match";
+		Console::singleton() << con::setcerr << "Warning: \"" << file << "\" is damaged (" << error << "), loading the TMX (run --bake)" << con::endl;
+		m_baked.Close();
+		return false;
+	}
+
+	if ( stale )
+	{
+		Console::singleton() << con::setcerr << "Warning: a tileset of \"" << map << "\" is newer than its bake, loading the TMX (run --bake)" << con::endl;
+		m_baked.Close();
+		return false;
+	}
+
+	m_map = std::move( tmx );
+	m_layerInfo.swap( layerInfo );
+	m_collision = collision;
+	m_staticCollision.assign( width, height, words );
+
+	m_tileTables.clear();
+	m_tileTables.resize( tilesets.size() );
+	for ( unsigned i = 0; i < tilesets.size(); i++ )
+	{
+		// Tilesets are packed into the shared atlas so maps batch across them
+		const res::AtlasRegion region = res::loadRegion( images[ i ].first );
+
+		// An image that changed size since the bake has its tiles laid out again
+		if ( sf::Vector2u( region.rect.width, region.rect.height ) != images[ i ].second )
+			corners[ i ] = tileCorners( region.rect.width, region.rect.height );
+
+		loadTileTable( m_tileTables[ i ], region, corners[ i ], *tilesets[ i ] );
+	}
+
+	return true;
 }
 
-/***************************************************************************/
+/***************************************************************************/
+
+MapViewer::MapViewer( const Map& map ) :
+	m_map( &map ),
+	m_area( 0.0f, 0.0f, (float) SCREEN_WIDTH, (float) SCREEN_HEIGHT )
+{
+}
+
+void MapViewer::center( const sf::Vector2f& pos )
+{
+	sf::Vector2f p = round( pos );
+	m_area.left = p.x - m_area.width  / 2.0f;
+	m_area.top  = p.y - m_area.height / 2.0f;
+}
+
+const sf::Vector2f MapViewer::center() const
+{
+	return sf::Vector2f( m_area.left - m_area.width / 2.0f, m_area.top - m_area.height / 2.0f );
+}
+
+void MapViewer::dimension( const sf::Vector2f& dim )
+{
+	m_area.width = dim.x;
+	m_area.height = dim.y;
+}
+
+void MapViewer::cache( bool enable )
+{
+	if ( !enable )
+		m_cache.reset();
+	else if ( !m_cache )
+		m_cache = std::make_shared< Cache >();
+}
+
+void MapViewer::getLights( std::vector< gfx::Light >& lights ) const
+{
+	std::vector< Placement > maps;
+	placeMaps( maps );
+
+	for ( const Placement& p : maps )
+		for ( const gfx::Light& light : p.map->getLights() )
+		{
+			gfx::Light l = light;
+			l.position += p.origin - sf::Vector2f( m_area.left, m_area.top );
+
+			sf::FloatRect bounds( l.position.x - l.radius, l.position.y - l.radius, 2.0f * l.radius, 2.0f * l.radius );
+			if ( bounds.intersects( sf::FloatRect( 0.0f, 0.0f, m_area.width, m_area.height ) ) )
+				lights.push_back( l );
+		}
+}
+
+void MapViewer::placeMaps( std::vector< Placement >& maps ) const
+{
+	Placement p = { m_map, sf::Vector2f() };
+	maps.push_back( p );
+}
+
+bool MapViewer::validateCache( const std::vector< Placement >& maps ) const
+{
+	if ( !m_cache )
+		return false;
+
+	Cache& c = *m_cache;
+
+	sf::Vector2f dim( m_area.width, m_area.height );
+	if ( !c.lower.resize( dim ) || !c.upper.resize( dim ) )
+	{
+		Console::singleton() << con::setcerr << "Failed to create the layer cache, falling back to direct rendering" << con::endl;
+		m_cache.reset();
+		return false;
+	}
+
+	// The cached pages belong to other maps or to outdated meshes
+	bool valid = c.maps.size() == maps.size();
+	for ( std::size_t i = 0; valid && i < maps.size(); i++ )
+		valid = c.maps[ i ].first == maps[ i ].map && c.maps[ i ].second == maps[ i ].map->getRevision();
 
-MapViewer::MapViewer( const Map& map ) :
-	m_map( &map ),
-	m_area( 0.0f, 0.0f, (float) SCREEN_WIDTH, (float) SCREEN_HEIGHT )
-{
-}
+	if ( !valid )
+	{
+		c.lower.invalidate();
+		c.upper.invalidate();
 
-void MapViewer::center( const sf::Vector2f& pos )
-{
-	sf::Vector2f p = round( pos );
-	m_area.left = p.x - m_area.width  / 2.0f;
-	m_area.top  = p.y - m_area.height / 2.0f;
+		c.maps.clear();
+		for ( const Placement& p : maps )
+			c.maps.push_back( std::make_pair( p.map, p.map->getRevision() ) );
+	}
+
+	return true;
 }
 
-const sf::Vector2f MapViewer::center() const
+inline void spriteQuad( const sf::Sprite& sprite, sf::Vertex * quad )
 {
-	return sf::Vector2f( m_area.left - m_area.width / 2.0f, m_area.top - m_area.height / 2.0f );
+	const sf::IntRect& r = sprite.getTextureRect();
+	const sf::Transform& t = sprite.getTransform();
+	const float w = (float) std::abs( r.width ), h = (float) std::abs( r.height );
+
+	quad[0] = sf::Vertex( t.transformPoint( 0.0f, 0.0f ), sprite.getColor(), sf::Vector2f( (float) r.left, (float) r.top ) );
+	quad[1] = sf::Vertex( t.transformPoint( w, 0.0f ), sprite.getColor(), sf::Vector2f( (float) ( r.left + r.width ), (float) r.top ) );
+	quad[2] = sf::Vertex( t.transformPoint( w, h ), sprite.getColor(), sf::Vector2f( (float) ( r.left + r.width ), (float) ( r.top + r.height ) ) );
+	quad[3] = sf::Vertex( t.transformPoint( 0.0f, h ), sprite.getColor(), sf::Vector2f( (float) r.left, (float) ( r.top + r.height ) ) );
 }
 
-void MapViewer::dimension( const sf::Vector2f& dim )
+typedef const gfx::TileMesh& ( Map::*MeshGetter )() const;
+
+// Draws one mesh of every map; the area and the states are in the viewed map's coordinates
+inline void drawMeshes( sf::RenderTarget& target, const sf::RenderStates& states, const sf::FloatRect& area, const std::vector< MapViewer::Placement >& maps, MeshGetter mesh )
 {
-	m_area.width = dim.x;
-	m_area.height = dim.y;
+	for ( const MapViewer::Placement& p : maps )
+	{
+		sf::RenderStates local = states;
+		local.transform.translate( p.origin );
+
+		( p.map->*mesh )().draw( target, local, sf::FloatRect( area.left - p.origin.x, area.top - p.origin.y, area.width, area.height ) );
+	}
 }
 
 void MapViewer::draw( sf::RenderTarget& target, sf::RenderStates states ) const
 {
+	gfx::RenderScope scope( "map_viewer" );
 	states.transform *= getTransform();
 
-	sf::FloatRect rect = m_area;
+	const sf::FloatRect& rect = m_area;
+
+	std::vector< Placement > maps, visible;
+	placeMaps( maps );
+
+	bool cached = validateCache( maps );
+
+	// Every map is clipped against the view once
+	for ( const Placement& p : maps )
+	{
+		sf::FloatRect bounds( p.origin.x, p.origin.y, (float) p.map->getWidth() * TILE_WIDTH, (float) p.map->getHeight() * TILE_HEIGHT );
+		if ( rect.intersects( bounds ) )
+			visible.push_back( p );
+	}
+
+	// Advance animated tiles; the cache also holds the tiles around the view, so animate those too
+	const float margin = cached ? (float) gfx::LayerCache::MARGIN + 1.0f : 0.0f;
+	const sf::FloatRect animated( rect.left - margin * TILE_WIDTH, rect.top - margin * TILE_HEIGHT, rect.width + 2.0f * margin * TILE_WIDTH, rect.height + 2.0f * margin * TILE_HEIGHT );
+
+	for ( const Placement& p : cached ? maps : visible )
+	{
+		sf::FloatRect local( animated.left - p.origin.x, animated.top - p.origin.y, animated.width, animated.height );
+
+		sf::FloatRect lower = p.map->getLowerMesh().animate( p.map->getAnimationTime(), local );
+		sf::FloatRect upper = p.map->getUpperMesh().animate( p.map->getAnimationTime(), local );
 
-	sf::IntRect draw;
-	draw.left	= std::max( 0, static_cast< int >( rect.left / TILE_WIDTH ) );
-	draw.top	= std::max( 0, static_cast< int >( rect.top / TILE_HEIGHT ) );
-	draw.width	= static_cast< int >( std::ceil( rect.width / TILE_WIDTH ) + 1 );
-	draw.height = static_cast< int >( std::ceil( rect.height / TILE_HEIGHT ) + 1 );
+		if ( cached && lower.width > 0.0f )
+			m_cache->lower.invalidate( sf::FloatRect( lower.left + p.origin.x, lower.top + p.origin.y, lower.width, lower.height ) );
+		if ( cached && upper.width > 0.0f )
+			m_cache->upper.invalidate( sf::FloatRect( upper.left + p.origin.x, upper.top + p.origin.y, upper.width, upper.height ) );
+	}
 
-	if ( draw.left + draw.width >= (int) m_map->getWidth() )
-		draw.left = m_map->getWidth() - draw.width;
-	if ( draw.top + draw.height >= (int) m_map->getHeight() )
-		draw.top = m_map->getHeight() - draw.height;
+	// Tile meshes are in map coordinates, so offset them by the view area
+	sf::RenderStates meshStates = states;
+	meshStates.transform.translate( -rect.left, -rect.top );
 
 	// Render lower layer
-	renderLayer( target, states, *m_map, m_map->getLowerLayers(), rect, draw );
+	if ( cached )
+		m_cache->lower.draw( target, states, rect, [&]( sf::RenderTarget& t, sf::RenderStates s, const sf::FloatRect& area ) { drawMeshes( t, s, area, maps, &Map::getLowerMesh ); } );
+	else
+		drawMeshes( target, meshStates, rect, visible, &Map::getLowerMesh );
 
-	// Draw objects -- WARNING: UGLY CODE
-	const auto& objects = m_map->getObjects();
-	for ( auto it = objects.begin(); it != objects.end(); ++it )
+	// Gather the visible entities of every map and sort them by their feet (in the viewed map's coordinates)
+	std::vector< Entity >& entities = m_entities;
+	entities.clear();
+
+	for ( const Placement& p : visible )
 	{
-		const sf::FloatRect& objRect = (*it)->getBounds();
-		if ( rect.intersects( objRect ) )
+		// The view area in the coordinates of this map and the offset from them to the screen
+		sf::FloatRect local( rect.left - p.origin.x, rect.top - p.origin.y, rect.width, rect.height );
+		sf::Vector2f offset( -local.left, -local.top );
+
+		const Map::ObjectComponents& components = p.map->getObjectComponents();
+		p.map->getObjectGrid().query( local, [&]( Map::ObjectHandle h )
 		{
-			Map::Object& object = const_cast< Map::Object& >( **it );
-			object.setPosition( objRect.left - rect.left, objRect.top - rect.top );
+			const sf::FloatRect& bounds = components.bounds[ h.index ];
+
+			Entity e;
+			e.key = util::sortKey( components.depth[ h.index ] + p.origin.y );
+			e.texture = nullptr;
+			e.object = p.map->getObject( h );
+			e.offset = offset + sf::Vector2f( bounds.left, bounds.top );
+			entities.push_back( e );
+		} );
 
-			target.draw( **it, states );
+		for ( auto it = m_characters.begin(); it != m_characters.end(); ++it )
+		{
+			const Character& c = **it;
+			const sf::FloatRect bounds = c.getBounds();
 
-			// Reset it
-			object.setPosition( objRect.left, objRect.top );
+			if ( c.getMapID() == p.map->getID() && local.intersects( bounds ) )
+			{
+				sf::Sprite sprite = c.toSprite();
+				if ( !sprite.getTexture() ) continue;
+				sprite.move( offset );
+
+				Entity e;
+				e.key = util::sortKey( bounds.top + bounds.height + p.origin.y );
+				e.texture = sprite.getTexture();
+				e.object = nullptr;
+				spriteQuad( sprite, e.quad );
+				entities.push_back( e );
+			}
 		}
 	}
 
-	// Render character(s)
-	for ( auto it = m_characters.begin(); it != m_characters.end(); ++it )
+	util::radixSort( entities, m_sortScratch, []( const Entity& e ) { return e.key; } );
+
+	// Consecutive sprites sharing a texture are drawn as one batch
+	sf::VertexArray batch( sf::Quads );
+	sf::RenderStates batchStates = states;
+
+	auto flush = [&]()
 	{
-		const Character& c = **it;
-		if ( c.getMapID() == m_map->getID() && rect.intersects( c.getBounds() ) )
+		if ( batch.getVertexCount() > 0 )
+		{
+			gfx::draw( target, batch, batchStates );
+			batch.clear();
+		}
+	};
+
+	for ( const Entity& e : entities )
+		if ( e.texture )
 		{
-			sf::Sprite sprite = c.toSprite();
-			sprite.move( -rect.left, -rect.top );
-			target.draw( sprite, states );
+			if ( e.texture != batchStates.texture )
+			{
+				flush();
+				batchStates.texture = e.texture;
+			}
+
+			for ( int i = 0; i < 4; i++ )
+				batch.append( e.quad[ i ] );
+		}
+		else
+		{
+			flush();
+
+			sf::RenderStates objectStates = states;
+			objectStates.transform.translate( e.offset );
+			e.object->draw( target, objectStates );
+		}
+	flush();
 
-			if ( DEBUG_COLLISION )
+	// Optional: Render the collision box of characters
+	if ( DEBUG_COLLISION )
+		for ( const Placement& p : visible )
+			for ( auto it = m_characters.begin(); it != m_characters.end(); ++it )
 			{
+				const Character& c = **it;
 				sf::FloatRect bounds = c.getBounds();
 
+				if ( c.getMapID() != p.map->getID() )
+					continue;
+
 				sf::RectangleShape col;
-				col.setPosition( bounds.left - rect.left, bounds.top - rect.top );
+				col.setPosition( bounds.left + p.origin.x - rect.left, bounds.top + p.origin.y - rect.top );
 				col.setSize( sf::Vector2f( bounds.width, bounds.height ) );
 				col.setFillColor( sf::Color( 200, 0, 0, 150 ) );
 
 				target.draw( col, states );
 			}
-		}
-	}
 			
 	// Render upper layer
-	renderLayer( target, states, *m_map, m_map->getUpperLayers(), rect, draw );
+	if ( cached )
+		m_cache->upper.draw( target, states, rect, [&]( sf::RenderTarget& t, sf::RenderStates s, const sf::FloatRect& area ) { drawMeshes( t, s, area, maps, &Map::getUpperMesh ); } );
+	else
+		drawMeshes( target, meshStates, rect, visible, &Map::getUpperMesh );
 
 	// Optional: Render the collision layer
-	if ( DEBUG_COLLISION && m_map->getCollisionLayer() )
-	{
-		std::vector< const Tmx::Layer* > t;
-		t.push_back( m_map->getCollisionLayer() );
-		renderLayer( target, states, *m_map, t, rect, draw );
-	}
+	if ( DEBUG_COLLISION )
+		drawMeshes( target, meshStates, rect, visible, &Map::getCollisionMesh );
 }
 
-/***************************************************************************/
+// Blends the tiles of the layers overlapping the target, with the map's origin at origin
+inline void compositeLayers( gfx::Compositor& target, const Map& map, const std::vector< const Tmx::Layer* >& layers, const sf::Vector2i& origin )
+{
+	const auto& tables = map.getTileTables();
+	const sf::Vector2u size = target.getSize();
 
-void MultiMapViewer::draw( sf::RenderTarget& target, sf::RenderStates states ) const
+	const int left = std::max( 0, -origin.x / TILE_WIDTH ), right = std::min( (int) map.getWidth(), ( (int) size.x - origin.x ) / TILE_WIDTH + 1 );
+	const int top = std::max( 0, -origin.y / TILE_HEIGHT ), bottom = std::min( (int) map.getHeight(), ( (int) size.y - origin.y ) / TILE_HEIGHT + 1 );
+
+	for ( const Tmx::Layer * layer : layers )
+		for ( int y = top; y < bottom; y++ )
+		{
+			const Tmx::MapCell * row = layer->GetRow( y );
+
+			for ( int x = left; x < right; x++ )
+			{
+				const int tileset = Tmx::GetMapCellTilesetIndex( row[ x ] );
+				if ( tileset < 0 ) continue;
+
+				const unsigned id = Tmx::GetMapCellId( row[ x ] );
+				const Map::TileTable& table = tables[ tileset ];
+				if ( table.rects.size() <= id ) continue;
+
+				// Animated tiles show their first frame, like a freshly built mesh
+				auto anim = table.animations.find( id );
+				const sf::IntRect& rect = anim != table.animations.end() ? anim->second.rects.front() : table.rects[ id ];
+
+				target.blit( table.region, rect, origin.x + x * TILE_WIDTH, origin.y + y * TILE_HEIGHT, tileFlip( row[ x ] ) );
+			}
+		}
+}
+
+void MapViewer::composite( gfx::Compositor& target ) const
 {
-	const Map& m = map();
-	const sf::FloatRect& area = getViewArea();
-	sf::Vector2f offset;
+	const sf::FloatRect& rect = m_area;
 
-	MapViewer child( *this );
+	std::vector< Placement > maps;
+	placeMaps( maps );
 
-	// Draw west map
-	if ( m.getNeighbor( Left ) &&  area.left < 0 )
-	{
-		offset.x = m.getNeighbor( Left )->getWidth() * TILE_WIDTH + area.left + ( area.width / 2.0f );
-		offset.y = ( area.top + area.height / 2.0f ) + ( m.getNeighborOffset( Left ) * TILE_HEIGHT );
+	std::vector< sf::Vector2i > origins;
+	for ( const Placement& p : maps )
+		origins.push_back( sf::Vector2i( (int) round( p.origin.x - rect.left ), (int) round( p.origin.y - rect.top ) ) );
 
-		child.map( *m.getNeighbor( Left ) );
-		child.center( offset );
-		child.dimension( sf::Vector2f( -area.left, SCREEN_HEIGHT ) );
+	for ( std::size_t i = 0; i < maps.size(); i++ )
+		compositeLayers( target, *maps[ i ].map, maps[ i ].map->getLowerLayers(), origins[ i ] );
 
-		target.draw( child, states );
-	}
-	
-	// Draw east map
-	if ( m.getNeighbor( Right ) && m.getWidth() * TILE_WIDTH <= area.left + area.width )
+	// Objects in the same order as the entity pass
+	struct Entry
 	{
-		offset.x = ( area.left + area.width ) - ( m.getWidth() * TILE_WIDTH );
-		offset.y = ( area.top + area.height / 2.0f ) + ( m.getNeighborOffset( Right ) * TILE_HEIGHT );
+		float depth;
+		const Map::Object * object;
+		sf::Vector2i position;
+	};
 
-		child.map( *m.getNeighbor( Right ) );
-		child.center( offset );
-		child.setPosition( SCREEN_WIDTH - offset.x + child.getViewArea().left, 0.0f );
-		child.dimension( sf::Vector2f( SCREEN_WIDTH - child.getPosition().x, SCREEN_HEIGHT ) );
+	std::vector< Entry > entries;
+	for ( std::size_t i = 0; i < maps.size(); i++ )
+	{
+		const Placement& p = maps[ i ];
+		sf::FloatRect local( rect.left - p.origin.x, rect.top - p.origin.y, rect.width, rect.height );
 
-		target.draw( child, states );
+		const Map::ObjectComponents& components = p.map->getObjectComponents();
+		p.map->getObjectGrid().query( local, [&]( Map::ObjectHandle h )
+		{
+			const sf::FloatRect& bounds = components.bounds[ h.index ];
+			Entry e = { components.depth[ h.index ] + p.origin.y, p.map->getObject( h ), origins[ i ] + sf::Vector2i( (int) bounds.left, (int) bounds.top ) };
+			entries.push_back( e );
+		} );
 	}
 
-	// Draw north map (copy of west, x changed to y and width changed to height)
-	if ( m.getNeighbor( Up ) && area.top < 0 )
-	{
-		offset.x = ( area.left + area.width / 2.0f ) + ( m.getNeighborOffset( Up ) * TILE_WIDTH );
-		offset.y = m.getNeighbor( Up )->getHeight() * TILE_HEIGHT + area.top + ( area.height / 2.0f );
+	std::stable_sort( entries.begin(), entries.end(), []( const Entry& a, const Entry& b ) { return a.depth < b.depth; } );
+	for ( const Entry& e : entries )
+		e.object->composite( target, e.position.x, e.position.y );
+
+	for ( std::size_t i = 0; i < maps.size(); i++ )
+		compositeLayers( target, *maps[ i ].map, maps[ i ].map->getUpperLayers(), origins[ i ] );
+}
+
+/***************************************************************************/
 
-		child.map( *m.getNeighbor( Up ) );
-		child.center( offset );
-		child.dimension( sf::Vector2f( SCREEN_WIDTH, -area.top ) );
+// Origin of a neighbour relative to the map, the inverse of the transitions in Character::update
+inline sf::Vector2f neighborOrigin( const Map& m, Direction d )
+{
+	const Map& n = *m.getNeighbor( d );
+	float offset = (float) m.getNeighborOffset( d );
 
-		target.draw( child, states );
+	switch ( d )
+	{
+	case Up:	return sf::Vector2f( -offset * TILE_WIDTH, -(float) n.getHeight() * TILE_HEIGHT );
+	case Down:	return sf::Vector2f( -offset * TILE_WIDTH, (float) m.getHeight() * TILE_HEIGHT );
+	case Left:	return sf::Vector2f( -(float) n.getWidth() * TILE_WIDTH, -offset * TILE_HEIGHT );
+	case Right:	return sf::Vector2f( (float) m.getWidth() * TILE_WIDTH, -offset * TILE_HEIGHT );
+	default:	return sf::Vector2f();
 	}
+}
 
-	// Draw south map (copy of east, x changed to y and width changed to height)
-	if ( m.getNeighbor( Down ) && m.getHeight() * TILE_HEIGHT <= area.top + area.height )
+void MultiMapViewer::placeMaps( std::vector< Placement >& maps ) const
+{
+	MapViewer::placeMaps( maps );
+
+	// Breadth first: the first step reaches the neighbours, the second the diagonals
+	std::size_t begin = 0;
+	for ( int step = 0; step < 2; step++ )
 	{
-		offset.x = ( area.left + area.width / 2.0f ) + ( m.getNeighborOffset( Up ) * TILE_WIDTH );
-		offset.y = ( area.top + area.height ) - ( m.getHeight() * TILE_HEIGHT );
+		std::size_t end = maps.size();
+		for ( std::size_t i = begin; i < end; i++ )
+			for ( int d = Up; d <= Right; d++ )
+			{
+				const Placement from = maps[ i ];
+				const Map * next = from.map->getNeighbor( (Direction) d );
 
-		child.map( *m.getNeighbor( Down ) );
-		child.center( offset );
-		child.setPosition( 0.0f, SCREEN_HEIGHT - offset.y + child.getViewArea().top );
-		child.dimension( sf::Vector2f( SCREEN_WIDTH, SCREEN_HEIGHT - child.getPosition().y ) );
+				if ( next == nullptr || std::any_of( maps.begin(), maps.end(), [next]( const Placement& p ) { return p.map == next; } ) )
+					continue;
 
-		target.draw( child, states );
+				Placement p = { next, from.origin + neighborOrigin( *from.map, (Direction) d ) };
+				maps.push_back( p );
+			}
+		begin = end;
 	}
+}
+
+sf::Image mapshot( const Map& map, unsigned margin )
+{
+	const sf::Vector2f size( (float) ( map.getWidth() + 2 * margin ) * TILE_WIDTH, (float) ( map.getHeight() + 2 * margin ) * TILE_HEIGHT );
+
+	std::unique_ptr< MapViewer > viewer( margin > 0U ? new MultiMapViewer( map ) : new MapViewer( map ) );
+	viewer->dimension( size );
+	viewer->center( sf::Vector2f( map.getWidth() * TILE_WIDTH / 2.0f, map.getHeight() * TILE_HEIGHT / 2.0f ) );
 
-	// Draw the original map
-	MapViewer::draw( target, states );	
+	gfx::Compositor compositor( (unsigned) size.x, (unsigned) size.y );
+	viewer->composite( compositor );
+	return compositor.getImage();
 }
 
 /***************************************************************************/
@@ -550,7 +1969,8 @@ void MultiMapViewer::draw( sf::RenderTarget& target, sf::RenderStates states ) c
 //
 //		const sf::FloatRect& getBounds() const
 //			Returns the FloatRect of the object's bounds
-//			NOTE: left != getPosition().x and top != getPosition().y
+//			NOTE: getPosition() is the top left of the bounds
+//			NOTE: the bounds, depth and collision shape are components stored by the map
 //
 //	IMPLEMENTABLE METHODS
 //
@@ -559,7 +1979,8 @@ void MultiMapViewer::draw( sf::RenderTarget& target, sf::RenderStates states ) c
 //			Retrieve references to external classes here and load from data from the TMX object
 //
 //		void update( sf::Uint32, const sf::Vector2f & )
-//			Called continiously every frame regardless if the player is inside the object
+//			Called every frame while the object is awake, regardless if the player is inside the object
+//			The default puts the object to sleep, so objects without one cost nothing per frame
 //			NOTE: the coordinate inputted is relative to the object
 //
 //		void onEnter( sf::Uint32, const sf::Vector2f & )
@@ -574,19 +1995,48 @@ void MultiMapViewer::draw( sf::RenderTarget& target, sf::RenderStates states ) c
 //			Called once when the player exits the object
 //			NOTE: the coordinate inputted is relative to the object
 //
+//		void onCharacterEnter( const Character &, const sf::Vector2f & )
+//		void onCharacterExit( const Character &, const sf::Vector2f & )
+//			Called once when a character other than the player enters or exits the object
+//			Characters leaving the map exit every object they were in
+//			NOTE: the coordinate inputted is relative to the object
+//
+//		void onProximityEnter( const Character &, const sf::Vector2f & )
+//		void onProximityExit( const Character &, const sf::Vector2f & )
+//			Called once when a character, the player included, comes within or leaves the
+//			radius given to setProximity() around the object's bounds
+//			NOTE: the coordinate inputted is relative to the object
+//
 //		void onInteract( const sf::Vector2f & )
 //			Called once when the player interacts with the object with the primary key (default: z)
 //			Takes in the absolute coordinate that was interacted with
 //			NOTE: the coordinate inputted is relative to the object
 //
+//		void draw( sf::RenderTarget &, sf::RenderStates ) const [pure virtual]
+//			Draws the object; the states already move it to the top left of its bounds
+//
 //		bool hasCollision( const sf::Vector2f & ) const [pure virtual]
 //			Returns if the position at the inputted absolute coordinate has collision
 //			NOTE: the coordinate inputted is relative to the object
+//			NOTE: only called when the object's collision shape is CollisionShape::Callback
+//
+//	SLEEPING
+//
+//		Objects start awake and can sleep() until woken, for a number of milliseconds or
+//		until an hour of the game clock. The player or a character entering or exiting the
+//		object, coming near it and interacting with it wake it up, as does wake()
+//
+//	COLLISION
+//
+//		Collision is declared with the "collision" TMX property (see parseShape) or, for
+//		scripts, the collision field of the script table, and is tested without calling
+//		into the object. The "solid" property and setSolid() switch it on and off
+//		Characters block each other while their collision is enabled
 //-------------------------------------------------------------------------
 
 /***************************************************************************/
 
-class Field : public Map::Object, res::TextureLoader<>
+class Field : public Map::Object, res::RegionLoader<>
 {
 	static const int FIELD_SIZE = farm::field::WIDTH * farm::field::HEIGHT;
 	std::vector< farm::field::Tile * > highlight;
@@ -603,10 +2053,29 @@ class Field : public Map::Object, res::TextureLoader<>
 		return sf::Vector2i( (unsigned) pos.x / 32U, (unsigned) pos.y / 32U );
 	}
 
+	float getDepth() const
+	{
+		return getBounds().top;
+	}
+
+	~Field()
+	{
+		farm::field::setCollisionListener( nullptr );
+	}
+
 	void load( const Tmx::Object & )
 	{
 		// texture that contains (watered) tilled graphics
-		loadTexture( "data/tilesets/crops.png" );
+		loadRegion( "data/tilesets/crops.png" );
+		
+		// solid field objects go into the map's collision tiles under the field
+		Map & map = getMap();
+		const sf::Vector2i origin( (int) getBounds().left / TILE_WIDTH, (int) getBounds().top / TILE_HEIGHT );
+		
+		farm::field::setCollisionListener( [&map, origin]( unsigned x, unsigned y, unsigned width, unsigned height, bool solid )
+		{
+			map.setCollision( sf::IntRect( origin.x + (int) x, origin.y + (int) y, (int) width, (int) height ), solid );
+		} );
 	}
 	
 	void onInteract( const sf::Vector2f & pos )
@@ -629,20 +2098,18 @@ class Field : public Map::Object, res::TextureLoader<>
 		}
 	}
 	
-	bool hasCollision( const sf::Vector2f & pos ) const
+	bool hasCollision( const sf::Vector2f & ) const
 	{
-		const sf::Vector2i fpos = convert( pos );
-		const farm::field::Tile & tile = farm::field::getTile( fpos.x, fpos.y );
-		return tile.object != nullptr && tile.object->hasCollision();
+		// solid objects are already in the map's collision tiles
+		return false;
 	}
 	
 	void draw( sf::RenderTarget & target, sf::RenderStates states ) const
 	{
 		using namespace bf::farm;
-	
-		states.transform *= getTransform();
 		
-		sf::Sprite sprite( getTexture() );
+		const res::AtlasRegion & region = getRegion();
+		sf::Sprite sprite( *region.texture );
 		const field::Tile * tiles = field::getTiles();
 		
 		// draw tiles
@@ -654,7 +2121,7 @@ class Field : public Map::Object, res::TextureLoader<>
 			// draw till
 			if ( tile.till > 0 )
 			{
-				sprite.setTextureRect( sf::IntRect( tile.water ? 32 : 0, 0, 32, 32 ) );
+				sprite.setTextureRect( sf::IntRect( region.rect.left + ( tile.water ? 32 : 0 ), region.rect.top, 32, 32 ) );
 				target.draw( sprite, states );
 			}
 		}
@@ -664,6 +2131,21 @@ class Field : public Map::Object, res::TextureLoader<>
 		for ( field::Object * obj : objects )
 			target.draw( *obj, states );
 	}
+
+	void composite( gfx::Compositor & target, int x, int y ) const
+	{
+		using namespace bf::farm;
+
+		const res::AtlasRegion & region = getRegion();
+		const field::Tile * tiles = field::getTiles();
+
+		for ( int i = 0; i < FIELD_SIZE; i++ )
+			if ( tiles[i].till > 0 )
+				target.blit( region, sf::IntRect( region.rect.left + ( tiles[i].water ? 32 : 0 ), region.rect.top, 32, 32 ), x + i % field::WIDTH * TILE_WIDTH, y + i / field::WIDTH * TILE_HEIGHT );
+
+		for ( const field::Object * obj : field::getObjects() )
+			obj->composite( target, x + (int) obj->getPosition().x, y + (int) obj->getPosition().y );
+	}
 };
 
 /***************************************************************************/
@@ -673,17 +2155,36 @@ static int lua_addText( lua_State * l );
 static int lua_bounds( lua_State * l );
 static int lua_removeImage( lua_State * l );
 static int lua_removeText( lua_State * l );
+static int lua_setCollision( lua_State * l );
+static int lua_setSolid( lua_State * l );
+static int lua_sleep( lua_State * l );
+static int lua_wake( lua_State * l );
+static int lua_setProximity( lua_State * l );
+static int lua_nearby( lua_State * l );
 
 static const char * SCRIPT_MT = "map.script";
 static const char * SCRIPT_OBJ = "__object";
 
+// Userdata in the OBJECT field of a script table; a handle, as Lua may keep the table after a reload
+struct ScriptRef
+{
+	Map * map;
+	Map::ObjectHandle handle;
+};
+
 static const struct luaL_Reg SCRIPT_LIB [] =
 {
 	{ "addImage",		lua_addImage },
 	{ "addText",		lua_addText },
 	{ "bounds",		lua_bounds },
+	{ "nearby",		lua_nearby },
 	{ "removeImage",	lua_removeImage },
 	{ "removeText",	lua_removeText },
+	{ "setCollision",	lua_setCollision },
+	{ "setProximity",	lua_setProximity },
+	{ "setSolid",		lua_setSolid },
+	{ "sleep",			lua_sleep },
+	{ "wake",			lua_wake },
 	{ NULL, NULL },
 };
 
@@ -708,11 +2209,45 @@ class Script : public Map::Object, public lua::Container
 		return true;
 	}
 	
+	std::vector< sf::IntRect > m_solid; // tiles the script holds solid, released with the object
+
 	~Script()
 	{
+		for ( const sf::IntRect & tiles : m_solid )
+			getMap().setCollision( tiles, false );
 		luaL_unref( m_lua, LUA_REGISTRYINDEX, ref );
 	}
 	
+public:
+	// Marks tiles relative to the object as solid, or clears an area it marked before
+	// Tiles also held by other objects stay solid
+	void setCollision( const sf::IntRect & local, bool solid )
+	{
+		const sf::IntRect tiles( local.left + (int) getBounds().left / TILE_WIDTH, local.top + (int) getBounds().top / TILE_HEIGHT, local.width, local.height );
+		auto it = std::find( m_solid.begin(), m_solid.end(), tiles );
+		
+		if ( solid == ( it != m_solid.end() ) )
+			return;
+		
+		getMap().setCollision( tiles, solid );
+		
+		if ( solid )
+			m_solid.push_back( tiles );
+		else
+			m_solid.erase( it );
+	}
+	
+	// Characters on the map within radius of the bounds
+	template< typename F >
+	void forNearby( float radius, F f ) const
+	{
+		const sf::FloatRect & b = getBounds();
+		const sf::FloatRect area( b.left - radius, b.top - radius, b.width + 2.0f * radius, b.height + 2.0f * radius );
+		getMap().getCharacters().query( area, [&f]( const Character * c, const sf::FloatRect & ) { f( *c ); } );
+	}
+	
+private:
+	
 	void load( const Tmx::Object & object )
 	{
 		const auto & list = object.GetProperties().GetList();
@@ -736,15 +2271,16 @@ class Script : public Map::Object, public lua::Container
 		// register map object functions to the table
 		luaL_setfuncs( l, SCRIPT_LIB, 0 );
 		
-		// create a script ** userdata to reference this object
-		Script ** script = (Script **) lua_newuserdata( l, sizeof( Script * ) );
-		*script = this;
+		// create a ScriptRef userdata to reference this object
+		ScriptRef * script = (ScriptRef *) lua_newuserdata( l, sizeof( ScriptRef ) );
+		script->map = &getMap();
+		script->handle = getHandle();
 		
-		// set the metatable of the script ** userdata
+		// set the metatable of the ScriptRef userdata
 		luaL_newmetatable( l, SCRIPT_MT );
 		lua_setmetatable( l, -2 );
 		
-		// set the script ** userdata to the OBJECT field of the table
+		// set the ScriptRef userdata to the OBJECT field of the table
 		lua_setfield( l, -2, SCRIPT_OBJ );
 		
 		// get table:load and ensure it is a function
@@ -773,15 +2309,93 @@ class Script : public Map::Object, public lua::Container
 		else
 			lua_pop( l, 1 ); // pop table.load leaving table at the top
 		
+		// read the declared collision shape, leaving the table at the top
+		lua_getfield( l, -1, "collision" );
+		try { loadShape( l ); }
+		catch ( ... ) { lua_pop( l, 2 ); throw; }
+		lua_pop( l, 1 );
+		
+		// table.proximity: radius around the bounds to report characters in
+		lua_getfield( l, -1, "proximity" );
+		if ( lua_isnumber( l, -1 ) )
+			setProximity( (float) lua_tonumber( l, -1 ) );
+		lua_pop( l, 1 );
+		
 		// register the table
 		ref = luaL_ref( l, LUA_REGISTRYINDEX );
 	}
 	
+	// table.collision: "none", "rect", "ellipse" or "script", or a polygon as { x1, y1, x2, y2, ... } relative to the bounds
+	// Without one, tables with a hasCollision function get "script" and the others "none"
+	void loadShape( lua_State * l )
+	{
+		CollisionShape shape;
+		
+		if ( lua_isnil( l, -1 ) )
+		{
+			// Scripts that only define hasCollision keep being asked, as they were before shapes
+			lua_getfield( l, -2, "hasCollision" );
+			const bool callback = lua_isfunction( l, -1 );
+			lua_pop( l, 1 );
+
+			if ( !callback )
+				return;
+
+			shape.type = CollisionShape::Callback;
+		}
+		else if ( lua_isstring( l, -1 ) )
+		{
+			const std::string type = lua_tostring( l, -1 );
+			if ( type == "none" )			shape.type = CollisionShape::None;
+			else if ( type == "rect" )		shape.type = CollisionShape::Rect;
+			else if ( type == "ellipse" )	shape.type = CollisionShape::Ellipse;
+			else if ( type == "script" )	shape.type = CollisionShape::Callback;
+			else throw Exception( "unknown collision shape \"" + type + "\"" );
+		}
+		else if ( lua_istable( l, -1 ) )
+		{
+			const int size = (int) lua_rawlen( l, -1 );
+			if ( size < 6 || size % 2 != 0 )
+				throw Exception( "collision polygon needs at least three x, y pairs" );
+			
+			shape.type = CollisionShape::Polygon;
+			for ( int i = 1; i <= size; i += 2 )
+			{
+				lua_rawgeti( l, -1, i );
+				lua_rawgeti( l, -2, i + 1 );
+				shape.points.push_back( sf::Vector2f( (float) lua_tonumber( l, -2 ), (float) lua_tonumber( l, -1 ) ) );
+				lua_pop( l, 2 );
+			}
+		}
+		else
+			throw Exception( "collision must be a string or a table of points" );
+		
+		setShape( shape );
+	}
+	
+	// table:func( name, x, y ) with the character's name and position relative to the object
+	void callCharacter( const char * func, const Character & c, const sf::Vector2f & pos )
+	{
+		lua_State * l = m_lua;
+		if ( !pushTableFunction( l, ref, func ) )
+			return;
+		
+		lua_pushstring( l, c.getName().c_str() );
+		lua_pushnumber( l, pos.x );
+		lua_pushnumber( l, pos.y );
+		
+		if ( lua_pcall( l, 4, 0, 0 ) )
+			throw LuaException( l );
+	}
+	
 	void update( sf::Uint32 ms, const sf::Vector2f & pos )
 	{
 		lua_State * l = m_lua;
 		if ( !pushTableFunction( l, ref, "update" ) )
+		{
+			sleep();
 			return;
+		}
 			
 		lua_pushunsigned( l, ms );
 		lua_pushnumber( l, pos.x );
@@ -833,6 +2447,26 @@ class Script : public Map::Object, public lua::Container
 			throw LuaException( l );
 	}
 	
+	void onCharacterEnter( const Character & c, const sf::Vector2f & pos )
+	{
+		callCharacter( "onCharacterEnter", c, pos );
+	}
+
+	void onCharacterExit( const Character & c, const sf::Vector2f & pos )
+	{
+		callCharacter( "onCharacterExit", c, pos );
+	}
+
+	void onProximityEnter( const Character & c, const sf::Vector2f & pos )
+	{
+		callCharacter( "onProximityEnter", c, pos );
+	}
+
+	void onProximityExit( const Character & c, const sf::Vector2f & pos )
+	{
+		callCharacter( "onProximityExit", c, pos );
+	}
+
 	void onInteract( const sf::Vector2f & pos )
 	{
 		lua_State * l = m_lua;
@@ -868,18 +2502,33 @@ class Script : public Map::Object, public lua::Container
 		return ret;
 	}
 	
-	using lua::Container::draw;
+	void draw( sf::RenderTarget & target, sf::RenderStates states ) const
+	{
+		lua::Container::draw( target, states );
+	}
 };
 
+// The script a table belongs to, raising an error for tables of scripts that have been reloaded
+static Script * checkScript( lua_State * l, int table )
+{
+	lua_getfield( l, table, SCRIPT_OBJ );
+	const ScriptRef * ref = (const ScriptRef *) luaL_checkudata( l, -1, SCRIPT_MT );
+	Map::Object * obj = ref->map->getObject( ref->handle );
+	lua_pop( l, 1 );
+	
+	if ( obj == nullptr )
+		luaL_error( l, "the map object of this table has been unloaded" );
+	return static_cast< Script * >( obj );
+}
+
 static int lua_addImage( lua_State * l )
 {
 	luaL_checktype( l, 1, LUA_TTABLE );
 	lua::Drawable * d = (lua::Drawable *) luaL_checkudata( l, 2, lua::IMAGE_MT ); 
 	
-	lua_getfield( l, 1, SCRIPT_OBJ );
-	Script ** obj = (Script **) luaL_checkudata( l, -1, SCRIPT_MT );
+	Script * obj = checkScript( l, 1 );
 	
-	(*obj)->addChild( d );
+	obj->addChild( d );
 	
 	if ( d->ref == LUA_NOREF )
 	{
@@ -895,10 +2544,9 @@ static int lua_addText( lua_State * l )
 	luaL_checktype( l, 1, LUA_TTABLE );
 	lua::Drawable * d = (lua::Drawable *) luaL_checkudata( l, 2, lua::TEXT_MT );
 	
-	lua_getfield( l, 1, SCRIPT_OBJ );
-	Script ** obj = (Script **) luaL_checkudata( l, -1, SCRIPT_MT );
+	Script * obj = checkScript( l, 1 );
 	
-	(*obj)->addChild( d );
+	obj->addChild( d );
 	
 	if ( d->ref == LUA_NOREF )
 	{
@@ -913,10 +2561,9 @@ static int lua_bounds( lua_State * l )
 {
 	luaL_checktype( l, 1, LUA_TTABLE );
 	
-	lua_getfield( l, 1, SCRIPT_OBJ );
-	Script ** obj = (Script **) luaL_checkudata( l, -1, SCRIPT_MT );
+	Script * obj = checkScript( l, 1 );
 	
-	const sf::FloatRect rect = (*obj)->getBounds();
+	const sf::FloatRect rect = obj->getBounds();
 	lua_pushnumber( l, rect.left );
 	lua_pushnumber( l, rect.top );
 	lua_pushnumber( l, rect.width );
@@ -930,10 +2577,9 @@ static int lua_removeImage( lua_State * l )
 	luaL_checktype( l, 1, LUA_TTABLE );
 	lua::Drawable * d = (lua::Drawable *) luaL_checkudata( l, 2, lua::IMAGE_MT );
 	
-	lua_getfield( l, 1, SCRIPT_OBJ );
-	Script ** obj = (Script **) luaL_checkudata( l, -1, SCRIPT_MT );
+	Script * obj = checkScript( l, 1 );
 	
-	(*obj)->removeChild( d );
+	obj->removeChild( d );
 	
 	luaL_unref( l, LUA_REGISTRYINDEX, d->ref );
 
@@ -945,19 +2591,108 @@ static int lua_removeText( lua_State * l )
 	luaL_checktype( l, 1, LUA_TTABLE );
 	lua::Drawable * d = (lua::Drawable *) luaL_checkudata( l, 2, lua::TEXT_MT );
 	
-	lua_getfield( l, 1, SCRIPT_OBJ );
-	Script ** obj = (Script **) luaL_checkudata( l, -1, SCRIPT_MT );
+	Script * obj = checkScript( l, 1 );
 	
-	(*obj)->removeChild( d );
+	obj->removeChild( d );
 	
 	luaL_unref( l, LUA_REGISTRYINDEX, d->ref );
 
 	return 0;
 }
 
+// table:setCollision( x, y, width, height [, solid] ) -- in tiles relative to the object, solid by default; clearing takes an area set before
+static int lua_setCollision( lua_State * l )
+{
+	luaL_checktype( l, 1, LUA_TTABLE );
+	sf::IntRect tiles( luaL_checkint( l, 2 ), luaL_checkint( l, 3 ), luaL_checkint( l, 4 ), luaL_checkint( l, 5 ) );
+	bool solid = lua_isnoneornil( l, 6 ) || lua_toboolean( l, 6 );
+	
+	Script * obj = checkScript( l, 1 );
+	
+	obj->setCollision( tiles, solid );
+	
+	return 0;
+}
+
+// table:setSolid( bool ) -- switches the object's collision shape on or off
+static int lua_setSolid( lua_State * l )
+{
+	luaL_checktype( l, 1, LUA_TTABLE );
+	bool solid = lua_toboolean( l, 2 );
+	
+	Script * obj = checkScript( l, 1 );
+	
+	obj->setSolid( solid );
+	
+	return 0;
+}
+
+// table:sleep() until woken, table:sleep( ms ) or table:sleep( "HH:MM" ) until that time of day
+static int lua_sleep( lua_State * l )
+{
+	luaL_checktype( l, 1, LUA_TTABLE );
+	
+	Script * obj = checkScript( l, 1 );
+	
+	if ( lua_isnoneornil( l, 2 ) )
+		obj->sleep();
+	else if ( lua_type( l, 2 ) == LUA_TSTRING )
+	{
+		try { obj->sleep( time::Hour( lua_tostring( l, 2 ) ) ); }
+		catch ( std::exception & err ) { return luaL_error( l, "%s", err.what() ); }
+	}
+	else
+		obj->sleep( (sf::Uint32) luaL_checkunsigned( l, 2 ) );
+	
+	return 0;
+}
+
+static int lua_wake( lua_State * l )
+{
+	luaL_checktype( l, 1, LUA_TTABLE );
+	
+	Script * obj = checkScript( l, 1 );
+	
+	obj->wake();
+	
+	return 0;
+}
+
+// table:setProximity( radius ) -- reports characters within radius of the bounds, 0 stops
+static int lua_setProximity( lua_State * l )
+{
+	luaL_checktype( l, 1, LUA_TTABLE );
+	float radius = (float) luaL_checknumber( l, 2 );
+	
+	Script * obj = checkScript( l, 1 );
+	
+	obj->setProximity( radius );
+	
+	return 0;
+}
+
+// table:nearby( [radius] ) -- names of the characters within radius (0 by default) of the bounds
+static int lua_nearby( lua_State * l )
+{
+	luaL_checktype( l, 1, LUA_TTABLE );
+	float radius = (float) luaL_optnumber( l, 2, 0.0 );
+	
+	Script * obj = checkScript( l, 1 );
+	
+	lua_newtable( l );
+	int n = 0;
+	obj->forNearby( radius, [&]( const Character & c )
+	{
+		lua_pushstring( l, c.getName().c_str() );
+		lua_rawseti( l, -2, ++n );
+	} );
+	
+	return 1;
+}
+
 /***************************************************************************/
 
-Map::Object * generateObject( const Tmx::Object & tmxObject )
+Map::Object * generateObject( Map & map, const Tmx::Object & tmxObject )
 {
 	Map::Object * object = nullptr;
 
@@ -967,22 +2702,44 @@ Map::Object * generateObject( const Tmx::Object & tmxObject )
 		std::transform( type.begin(), type.end(), type.begin(), ::tolower );
 		
 		if ( type == "field" )
-			object = new Field();
+			object = map.m_arena.create< Field >();
 		else
-			object = new Script();
+			object = map.m_arena.create< Script >();
 	
-		object->setPosition( (float) tmxObject.GetX(), (float) tmxObject.GetY());
+		const sf::FloatRect bounds = objectBounds( tmxObject );
 
+		object->m_map = &map;
 		object->m_name = tmxObject.GetName();
-		object->m_bounds = sf::FloatRect( (float) tmxObject.GetX(), (float) tmxObject.GetY(), (float) tmxObject.GetWidth(), (float) tmxObject.GetHeight() );
 		object->m_object = &tmxObject;
+		object->m_awake = true;
+		object->m_listed = false;
+		object->m_sleep = 0U;
+
+		// Registered before loading, so scripts can already use their handle and components
+		object->m_handle = map.registerObject( object, bounds );
 
 		object->load( tmxObject );
+
+		// The TMX properties override whatever the object declared while loading
+		const auto& properties = tmxObject.GetProperties().GetList();
+
+		auto find = properties.find( "collision" );
+		if ( find != properties.end() )
+			object->setShape( parseShape( find->second, tmxObject, bounds ) );
+
+		find = properties.find( "solid" );
+		if ( find != properties.end() )
+			object->setSolid( find->second != "false" && find->second != "0" );
+
+		map.m_components.depth[ object->m_handle.index ] = object->getDepth();
+
 		return object;
 	}
 	catch ( ... )
 	{
-		delete object;
+		if ( object != nullptr )
+			map.m_objects.remove( object->m_handle );
+		map.m_arena.destroy( object );
 		throw;
 	}
 }
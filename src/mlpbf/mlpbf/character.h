@@ -20,6 +20,12 @@ namespace bf
 	public:
 		Character( const std::string& spritesheet );
 
+		// Takes the character out of the map it is placed on
+		virtual ~Character();
+
+		// Name of the spritesheet the character was created with
+		const std::string& getName() const { return m_name; }
+
 		void animate( const std::string& anim, bool loop = false ) { m_sheet.animate( anim, loop ); }
 
 		void update( const sf::Time& );
@@ -34,6 +40,7 @@ namespace bf
 		void setPosition( const sf::Vector2f& pos ) { m_pos = pos; }
 		
 		inline void enableCollision( bool b) { m_checkCollision = b; }
+		inline bool isCollisionEnabled() const { return m_checkCollision; }
 
 		void setMap( const std::string& map );
 		void setMap( const std::string& map, const sf::Vector2f& pos );
@@ -44,6 +51,13 @@ namespace bf
 		operator sf::Sprite() const { return toSprite(); }
 
 	private:
+		friend class Map;
+
+		// Keeps the character in the broadphase of the map it is on
+		void place();
+
+	private:
+		std::string m_name;
 		gfx::Spritesheet m_sheet;
 
 		unsigned m_mapID;
@@ -51,5 +65,9 @@ namespace bf
 		std::tuple< Direction, sf::Vector2f, bool > m_move;
 		
 		bool m_checkCollision;
+
+		// The map the character was last placed on, see Map::placeCharacter
+		// Cleared by the map instead when the map is destroyed first
+		mutable Map * m_placedMap;
 	};
 }
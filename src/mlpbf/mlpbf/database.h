@@ -58,5 +58,8 @@ namespace bf
 		// Returns the map of string or integer id
 		bf::Map & getMap( unsigned id );
 		bf::Map & getMap( const std::string & id );
+		
+		// Returns the number of maps, whose integer ids run from zero up to it
+		unsigned getMapCount();
 	}
 }
@@ -3,12 +3,18 @@
 #include <SFML/Graphics/Drawable.hpp>
 #include <SFML/Graphics/Transformable.hpp>
 #include <SFML/System/NonCopyable.hpp>
+#include <functional>
 #include <vector>
 
 namespace bf
 {
 	class Seed;
 
+	namespace gfx
+	{
+		class Compositor;
+	}
+
 	namespace farm
 	{
 		void init();
@@ -32,6 +38,9 @@ namespace bf
 				virtual unsigned getWidth() const = 0;
 				virtual unsigned getHeight() const = 0;
 				
+				// Renders the object on the CPU at (x, y), see Map::Object::composite
+				virtual void composite( gfx::Compositor & target, int x, int y ) const {}
+				
 				using sf::Transformable::getPosition;
 				using sf::Transformable::setPosition;
 				
@@ -62,6 +71,12 @@ namespace bf
 			// Returns the object array -- size param gets set to size of the array
 			const std::vector< Object * > & getObjects();
 			
+			// Called with an area of the field (in tiles) whenever its collision changes
+			typedef std::function< void( unsigned x, unsigned y, unsigned width, unsigned height, bool solid ) > CollisionListener;
+			
+			// Sets the listener and reports the objects already placed to it -- nullptr removes it
+			void setCollisionListener( const CollisionListener & listener );
+			
 			// Places a stone -- size must be [1,3] and area must be empty
 			void placeStone( unsigned x, unsigned y, unsigned size );
 			
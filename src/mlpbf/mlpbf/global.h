@@ -24,6 +24,7 @@ namespace bf
 
 	extern bool DEBUG_COLLISION;
 	extern bool SHOW_FPS;
+	extern bool CACHE_LAYERS;
 
 	void showText( const std::string& message, const std::string& speaker = "" );
 	void showInventory();
@@ -33,4 +34,7 @@ namespace bf
 	
 	void fadeIn( sf::Time );
 	void fadeOut( sf::Time );
+
+	// Records the draws of the next frames shown in the window and prints the statistics to the console
+	void recordRenderStats( unsigned frames );
 }
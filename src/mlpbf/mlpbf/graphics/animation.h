@@ -22,7 +22,7 @@ namespace bf
 		//	reverse:	optional boolean value to play the animation backwards
 		//	flip:		optional boolean value to flip animation (for left-right)
 		//-------------------------------------------------------------------------
-		class Animation : private res::TextureLoader<>
+		class Animation : private res::RegionLoader<>
 		{
 			public:
 				Animation( const TiXmlElement& elem );
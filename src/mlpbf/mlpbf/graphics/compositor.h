@@ -0,0 +1,54 @@
+#pragma once
+
+#include "../resource.h"
+
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/Graphics/Image.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/System/NonCopyable.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bf
+{
+	namespace gfx
+	{
+		//-------------------------------------------------------------------------
+		// Composites images into a pixel buffer without touching OpenGL
+		//
+		// Pixels are blended like sf::BlendAlpha: every channel is src * a + dst * (1 - a),
+		// rounded the same way on every platform, so the result can be used as a golden
+		// image for the GPU renderer at integer positions without scaling
+		//
+		// Atlas regions are drawn from the decoded image they were packed from (see
+		// res::loadImage); the images stay alive as long as the compositor does
+		//-------------------------------------------------------------------------
+		class Compositor : private sf::NonCopyable
+		{
+		public:
+			Compositor( unsigned width, unsigned height, const sf::Color& background = sf::Color::Black );
+
+			sf::Vector2u getSize() const { return sf::Vector2u( m_width, m_height ); }
+
+			// Blends a rect of the image with its top left corner at (x, y)
+			// flip takes the TileMesh::Flip bits, which assume a square rect when flipping diagonally
+			void blit( const sf::Image& image, const sf::IntRect& rect, int x, int y, unsigned flip = 0U );
+
+			// Same as above with rect in the coordinates of the region's atlas texture
+			void blit( const res::AtlasRegion& region, const sf::IntRect& rect, int x, int y, unsigned flip = 0U );
+
+			sf::Image getImage() const;
+
+		private:
+			unsigned m_width, m_height;
+			std::vector< sf::Uint8 > m_pixels, m_row;
+
+			std::unordered_map< std::string, res::ImagePtr > m_images;
+		};
+
+		// Blends count RGBA pixels of src over dst
+		void blendPixels( sf::Uint8 * dst, const sf::Uint8 * src, std::size_t count );
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/Graphics/RenderStates.hpp>
+#include <SFML/Graphics/RenderTexture.hpp>
+#include <SFML/System/NonCopyable.hpp>
+
+#include <functional>
+#include <vector>
+
+namespace bf
+{
+	namespace gfx
+	{
+		//-------------------------------------------------------------------------
+		// Caches static map geometry in a render texture page slightly larger than the view
+		//
+		// The page is addressed as a ring buffer in tile units: a world tile always lands
+		// on the same texels, so when the view scrolls only the newly exposed strips are
+		// redrawn and the rest of the page stays valid. Presenting the view costs at most
+		// four textured quads
+		//
+		// All areas are in map pixel coordinates
+		//-------------------------------------------------------------------------
+		class LayerCache : private sf::NonCopyable
+		{
+		public:
+			// Number of extra tiles kept on each side of the view
+			enum { MARGIN = 2 };
+
+			// Draws the static geometry inside the area into the target
+			typedef std::function< void( sf::RenderTarget&, sf::RenderStates, const sf::FloatRect& ) > Fill;
+
+			LayerCache() : m_cols( 0 ), m_rows( 0 ), m_valid( 0, 0, 0, 0 ) {}
+
+			// Sizes the page for a view of the given dimensions; returns false if the texture could not be created
+			bool resize( const sf::Vector2f& view );
+
+			// Drops the whole page
+			void invalidate();
+
+			// Marks an area to be redrawn the next time it is visible
+			void invalidate( const sf::FloatRect& area );
+
+			// Updates the page around the area and draws the area into the target at (0, 0)
+			void draw( sf::RenderTarget& target, sf::RenderStates states, const sf::FloatRect& area, const Fill& fill );
+
+		private:
+			void redraw( const sf::IntRect& tiles, const Fill& fill );
+
+		private:
+			sf::RenderTexture m_page;
+			int m_cols, m_rows;
+
+			sf::IntRect m_valid; // tiles currently held by the page
+			std::vector< sf::IntRect > m_dirty;
+		};
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/Graphics/RenderStates.hpp>
+#include <SFML/Graphics/RenderTexture.hpp>
+#include <SFML/Graphics/VertexArray.hpp>
+#include <SFML/System/NonCopyable.hpp>
+
+#include <vector>
+
+namespace bf
+{
+	namespace gfx
+	{
+		//-------------------------------------------------------------------------
+		// A point light placed on a map (TMX objects of type "light")
+		//	radius:		distance in pixels at which the light fades out
+		//	color:		colour of the glow
+		//	flicker:	[0, 1] how much the intensity wavers
+		//-------------------------------------------------------------------------
+		struct Light
+		{
+			sf::Vector2f position;
+			float radius;
+			sf::Color color;
+			float flicker;
+		};
+
+		//-------------------------------------------------------------------------
+		// Blends the ambient tint over the screen, cut by lights
+		//
+		// The tint is drawn into a render texture SCALE times smaller than the
+		// screen; every light multiplies its alpha down with a radial fan, then
+		// the page is stretched over the scene with smoothing. Lights also add a
+		// glow of their colour directly onto the scene, scaled by the darkness
+		//
+		// Light positions are in screen pixels
+		//-------------------------------------------------------------------------
+		class Lightmap : private sf::NonCopyable
+		{
+		public:
+			enum { SCALE = 4, SEGMENTS = 16 };
+
+			Lightmap() : m_state( NotCreated ) {}
+
+			void draw( sf::RenderTarget& target, sf::RenderStates states, const sf::Color& ambient, const std::vector< Light >& lights, sf::Uint32 time );
+
+		private:
+			void fan( sf::VertexArray& vertices, const sf::Vector2f& center, float radius, const sf::Color& inner, const sf::Color& outer ) const;
+
+		private:
+			sf::RenderTexture m_page;
+			enum { NotCreated, Created, Failed } m_state;
+
+			sf::VertexArray m_cut, m_glow;
+		};
+	}
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <SFML/Graphics/RenderTarget.hpp>
+#include <SFML/Graphics/RenderWindow.hpp>
+#include <SFML/System/NonCopyable.hpp>
+
+#include <array>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace sf
+{
+	class VertexArray;
+}
+
+namespace bf
+{
+	namespace gfx
+	{
+		//-------------------------------------------------------------------------
+		// A render target that never touches OpenGL and only counts what is drawn into it
+		//
+		// Between beginFrame and endFrame every draw reaching the recorder or a
+		// RecordingWindow is counted. Draws made through gfx::draw are tracked in detail
+		// (vertices, primitive type, texture switches) whatever their target, so render
+		// texture pages filled during the frame are included; draws made by SFML
+		// drawables such as sprites, text and shapes are only counted
+		//
+		// Statistics are grouped by the innermost RenderScope and accumulate until reset
+		//-------------------------------------------------------------------------
+		class RenderRecorder : public sf::RenderTarget
+		{
+		public:
+			struct Stats
+			{
+				Stats() : drawCalls( 0U ), vertices( 0U ), textureSwitches( 0U ), untracked( 0U ) { primitives.fill( 0U ); }
+
+				unsigned drawCalls;
+				unsigned vertices;
+				unsigned textureSwitches;
+				unsigned untracked;
+				std::array< unsigned, sf::Quads + 1 > primitives;
+
+				Stats& operator+=( const Stats& );
+			};
+
+			explicit RenderRecorder( const sf::Vector2u& size );
+
+			sf::Vector2u getSize() const { return m_size; }
+
+			// Clears the statistics
+			void reset();
+
+			// Starts recording a frame, drawing the frame on the recorder or a RecordingWindow is up to the caller
+			void beginFrame();
+			void endFrame();
+
+			// The recorder between beginFrame and endFrame, if any
+			static RenderRecorder * recording();
+
+			void pushScope( const std::string& name );
+			void popScope();
+
+			// Records a draw of vertices into the target (see gfx::draw)
+			void record( const sf::RenderTarget& target, const sf::Vertex* vertices, unsigned count, sf::PrimitiveType type, const sf::RenderStates& states );
+
+			// Counts an activation of a target, which SFML does before every draw
+			void activated( const sf::RenderTarget& target );
+
+			const std::map< std::string, Stats >& getStats() const { return m_stats; }
+			unsigned getFrames() const { return m_frames; }
+
+			// Prints the totals per scope and per frame
+			void report( std::ostream& out ) const;
+
+		private:
+			bool activate( bool );
+			Stats& current();
+
+		private:
+			sf::Vector2u m_size;
+
+			std::map< std::string, Stats > m_stats;
+			std::vector< std::string > m_scopes;
+			unsigned m_frames;
+
+			const sf::Texture * m_texture;         // texture of the last tracked draw
+			const sf::RenderTarget * m_tracked;    // target whose next activation belongs to a recorded draw
+		};
+
+		//-------------------------------------------------------------------------
+		// A window whose draws are also counted while a RenderRecorder is recording
+		//-------------------------------------------------------------------------
+		class RecordingWindow : public sf::RenderWindow
+		{
+		public:
+			RecordingWindow( sf::VideoMode mode, const std::string& title, sf::Uint32 style ) : sf::RenderWindow( mode, title, style ) {}
+
+		private:
+			bool activate( bool active );
+		};
+
+		//-------------------------------------------------------------------------
+		// Groups the draws made during its lifetime under a name while a RenderRecorder is recording
+		//-------------------------------------------------------------------------
+		class RenderScope : private sf::NonCopyable
+		{
+		public:
+			explicit RenderScope( const std::string& name );
+			~RenderScope();
+
+		private:
+			RenderRecorder * m_recorder;
+		};
+
+		// Draws the vertices, recording them in detail while a RenderRecorder is recording
+		void draw( sf::RenderTarget& target, const sf::VertexArray& vertices, const sf::RenderStates& states = sf::RenderStates::Default );
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/Graphics/RenderStates.hpp>
+#include <SFML/Graphics/VertexArray.hpp>
+#include <SFML/Config.hpp>
+
+#include <vector>
+
+namespace sf
+{
+	class RenderTarget;
+	class Texture;
+}
+
+namespace bf
+{
+	namespace gfx
+	{
+		//-------------------------------------------------------------------------
+		// Static geometry for a set of tile layers
+		// The layers are split into square chunks of CHUNK_SIZE tiles and each
+		// chunk keeps one quad batch per texture, so drawing a chunk costs one
+		// draw call per texture instead of one per tile
+		//
+		// Quads must be appended layer by layer (see beginLayer) so overlapping
+		// layers keep their order when they use different textures
+		//
+		// Animated tiles are indexed per chunk; animate() only patches the texture
+		// coordinates of animated tiles in the given area, static chunks cost nothing
+		//-------------------------------------------------------------------------
+		class TileMesh
+		{
+		public:
+			enum { CHUNK_SIZE = 16 };
+
+			enum Flip
+			{
+				FLIP_HORIZONTAL	= 1 << 0,
+				FLIP_VERTICAL	= 1 << 1,
+				FLIP_DIAGONAL	= 1 << 2
+			};
+
+			// Frames of a looping tile animation
+			struct Animation
+			{
+				std::vector< sf::IntRect > rects;	// texture rect of each frame
+				std::vector< sf::Uint32 > ends;		// end of each frame in ms since the start of the loop
+			};
+
+			// Sets the texture coordinates of a quad to show the rect with the given flips
+			static void texCoords( sf::Vertex * quad, const sf::IntRect & rect, unsigned flip );
+
+			TileMesh() : m_width( 0U ), m_height( 0U ), m_layer( 0U ) {}
+
+			// Clears the mesh and sizes it for a map of width x height tiles
+			void reset( unsigned width, unsigned height );
+
+			// Marks the start of a new layer
+			void beginLayer();
+
+			// Adds a tile quad (4 vertices, in map pixel coordinates) at tile x, y
+			// Animated tiles keep a pointer to their animation, which must outlive the mesh
+			void append( unsigned x, unsigned y, const sf::Texture & texture, const sf::Vertex * quad, const Animation * animation = nullptr, unsigned flip = 0U );
+
+			// Shows the frame at time (in ms) for every animated tile intersecting the area
+			// Returns the area of the tiles that changed frame (empty if none did)
+			// Only texture coordinates change, so the mesh stays logically const
+			sf::FloatRect animate( sf::Uint32 time, const sf::FloatRect & area ) const;
+
+			// Draws every chunk intersecting the area (in map pixel coordinates)
+			void draw( sf::RenderTarget & target, sf::RenderStates states, const sf::FloatRect & area ) const;
+
+			bool empty() const { return m_chunks.empty(); }
+
+		private:
+			struct Batch
+			{
+				const sf::Texture * texture;
+				sf::VertexArray vertices;
+				unsigned layer;
+			};
+
+			struct AnimatedTile
+			{
+				const Animation * animation;
+				unsigned batch, vertex; // location of the quad in the chunk
+				unsigned flip;
+				unsigned frame;
+			};
+
+			struct Chunk
+			{
+				std::vector< Batch > batches;
+				std::vector< AnimatedTile > animated;
+			};
+
+			void chunkRange( const sf::FloatRect & area, int & left, int & top, int & right, int & bottom ) const;
+
+		private:
+			mutable std::vector< Chunk > m_chunks;
+			unsigned m_width, m_height; // in chunks
+			unsigned m_layer;
+		};
+	}
+}
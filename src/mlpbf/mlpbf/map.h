@@ -1,60 +1,183 @@
 #pragma once
 
 #include <array>
+#include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include <SFML/Graphics/Drawable.hpp>
+#include <SFML/Graphics/Image.hpp>
 #include <SFML/Graphics/Sprite.hpp>
 #include <SFML/Graphics/Transformable.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+#include <SFML/System/Clock.hpp>
 #include <SFML/System/NonCopyable.hpp>
 #include <Tmx.h>
 
 #include "direction.h"
+#include "resource.h"
+#include "graphics/layer_cache.h"
+#include "graphics/lightmap.h"
+#include "graphics/tile_mesh.h"
 #include "time/season.h"
+#include "utility/arena.h"
+#include "utility/bit_grid.h"
+#include "utility/slot_map.h"
+#include "utility/sort_and_sweep.h"
+#include "utility/spatial_grid.h"
+#include "utility/timing_wheel.h"
 
 namespace bf
 {
 	class Character;
 
+	namespace gfx
+	{
+		class Compositor;
+	}
+
+	namespace time
+	{
+		class Hour;
+	}
+
+	//-------------------------------------------------------------------------
+	// The solid area of a map object, tested natively inside the object's bounds
+	//	None:		never solid
+	//	Rect:		the whole bounds
+	//	Ellipse:	the ellipse filling the bounds
+	//	Polygon:	points relative to the top left of the bounds
+	//	Mask:		pixels of an image placed at the top left of the bounds, solid where mostly opaque
+	//	Callback:	asks the object through hasCollision() (scripts opt in to this)
+	//-------------------------------------------------------------------------
+	struct CollisionShape
+	{
+		enum Type { None, Rect, Ellipse, Polygon, Mask, Callback } type;
+		std::vector< sf::Vector2f > points;
+		res::ImagePtr mask;
+
+		CollisionShape() : type( None ) {}
+
+		bool contains( const sf::FloatRect& bounds, const sf::Vector2f& local ) const;
+	};
+
 	class Map : private sf::NonCopyable
 	{
 	public:
+		Map();
 		~Map();
 	
 		class Object;
+
+		// Stays safe to hold after the object is reloaded, when it no longer finds it
+		typedef util::Handle ObjectHandle;
+
+		// What the collision, trigger and draw passes read about objects, in arrays indexed by
+		// the slot of their handle rather than spread over the objects themselves
+		struct ObjectComponents
+		{
+			std::vector< sf::FloatRect > bounds;	// the top left is the object's position
+			std::vector< float > depth;				// see Map::Object::getDepth
+			std::vector< CollisionShape > shape;
+			std::vector< unsigned char > solid;		// whether the shape is switched on
+		};
+
+		// Texture of a tileset and the texture rect of every tile, indexed by local tile id
+		struct TileTable
+		{
+			std::shared_ptr< sf::Texture > texture;
+			std::vector< sf::IntRect > rects;
+			std::map< unsigned, gfx::TileMesh::Animation > animations; // by local tile id
+			res::AtlasRegion region; // the tileset image, for software rendering
+		};
 	
 		void load( unsigned id, const std::string& );
 		void loadNeighbors();
 		
+		// Replaces an object with a fresh one generated from its TMX object
 		void reloadObject( const std::string & obj );
 
-		void update( sf::Uint32 frameTime, const sf::Vector2f& pos );
+		// nullptr once the object has been removed
+		Map::Object * getObject( ObjectHandle h ) const;
+
+		// A null handle when there is no such object; the first one loaded for duplicate names
+		ObjectHandle findObject( const std::string & name ) const;
+
+		// Updates the awake objects and calls the enter, inside and exit callbacks of the objects
+		// whose bounds the player at pos and the characters on this map moved in or out of
+		void update( sf::Uint32 frameTime, const sf::Vector2f& pos, const std::vector< const Character* >& characters = std::vector< const Character* >() );
 		bool interact( const sf::Vector2f& pos );
 
 		bool checkTileCollision( const sf::Vector2u& ) const;
 		bool checkObjectCollision( const sf::Vector2f& ) const;
 
-		void season( time::Season s ) { m_season = s; }
+		// Whether any tile of the area (in tiles) is solid
+		bool checkTileCollision( const sf::IntRect& tiles ) const;
+
+		// Marks tiles as solid on top of the collision layer, for objects placed at runtime
+		// Each call with solid holds the tiles, and they clear once every hold was released by a call without
+		void setCollision( const sf::IntRect& tiles, bool solid );
+
+		// Result of moving a box through the solid tiles and objects
+		struct Sweep
+		{
+			sf::Vector2f delta;		// movement that was possible, sliding along whatever was hit
+			float time;				// [0, 1] fraction of the movement done before the first contact
+			sf::Vector2f normal;	// normal of the first contact, zero without one
+		};
+
+		// Moves a box (in pixels) by delta one axis at a time, so it slides along walls
+		// Boxes already overlapping something solid are let out of it
+		// Characters on the map other than self with collision enabled block the box too
+		Sweep sweep( const sf::FloatRect& box, const sf::Vector2f& delta, const Character * self = nullptr ) const;
+
+		// Characters on the map, placed by Character::update and removed when they are destroyed
+		// Removing a character gives the objects it was in and near their onCharacterExit and onProximityExit
+		void placeCharacter( const Character& c );
+		void removeCharacter( const Character& c );
+
+		const util::SortAndSweep< const Character* >& getCharacters() const { return m_characters; }
+
+		// Shows the layers of the season; a change rebuilds the meshes and bumps the revision, so cached pages are redrawn
+		void season( time::Season s );
 		time::Season season() const { return m_season; }
 		
 		bool isExterior() const { return m_isExterior; }
 
 	public: // Functions to help with rendering
-		unsigned getWidth() const { return m_map.GetWidth(); }
-		unsigned getHeight() const { return m_map.GetHeight(); }
+		unsigned getWidth() const { return m_map->GetWidth(); }
+		unsigned getHeight() const { return m_map->GetHeight(); }
 
 		unsigned getID() const { return m_mapID; }
 
-		const std::vector< Map::Object * >& getObjects() const { return m_objects; }
+		const util::SlotMap< Map::Object * >& getObjects() const { return m_objects; }
+
+		const ObjectComponents& getObjectComponents() const { return m_components; }
+
+		// Objects bucketed by their bounds, for point and area queries
+		const util::SpatialGrid< ObjectHandle >& getObjectGrid() const { return m_objectGrid; }
+		const std::vector< gfx::Light >& getLights() const { return m_lights; }
 
 		const std::vector< const Tmx::Layer* >& getLowerLayers() const { return m_lower; }
 		const std::vector< const Tmx::Layer* >& getUpperLayers() const { return m_upper; }
 
 		const Tmx::Layer* getCollisionLayer() const { return m_collision; }
 
+		// Indexed by the tileset index of a Tmx::MapCell
+		const std::vector< TileTable >& getTileTables() const { return m_tileTables; }
+
+		const gfx::TileMesh& getLowerMesh() const { return m_lowerMesh; }
+		const gfx::TileMesh& getUpperMesh() const { return m_upperMesh; }
+		const gfx::TileMesh& getCollisionMesh() const { return m_collisionMesh; }
+
+		// Incremented every time the tile meshes are rebuilt
+		unsigned getRevision() const { return m_revision; }
+
+		// Time the animated tiles are at, in milliseconds since the map was created
+		sf::Uint32 getAnimationTime() const { return m_animationClock.getElapsedTime().asMilliseconds(); }
+
 		bf::Map* getNeighbor( Direction d ) { return m_neighbors[ d ].first; }
 		int getNeighborOffset( Direction d ) { return m_neighbors[ d ].second; }
 
@@ -63,32 +186,120 @@ namespace bf
 
 		bool adjustSprite( const Tmx::Layer& layer, sf::Vector2u pos, sf::Sprite& ) const;
 
+	public: // Baking
+		// Compiles a TMX map into its .bfmap, which load() maps in place of the TMX while the
+		// TMX and its tilesets are not newer
+		static void bake( const std::string& map );
+
+		// The .bfmap beside a TMX map
+		static std::string bakedFile( const std::string& map );
+
 	public: // Global variable
 		static Map& global();
 		static Map& global( unsigned id );
 		static Map& global( const std::string& map );
 		
 	private:
-		Tmx::Map m_map;
+		friend Map::Object * generateObject( Map &, const Tmx::Object & );
+
+		// Maps the bake of a TMX map when it is up to date, false to parse the TMX instead
+		bool loadBaked( const std::string& map );
+
+		// Reads how every layer is drawn from its properties and bakes the collision layer
+		void readLayers();
+		void selectLayers();
+		void buildMesh( gfx::TileMesh& mesh, const std::vector< const Tmx::Layer* >& layers ) const;
+
+		ObjectHandle registerObject( Map::Object * obj, const sf::FloatRect& bounds );
+		void addObject( Map::Object * obj );
+		void removeObject( ObjectHandle h );
+
+		// Whether an absolute position is solid for the object
+		bool objectCollision( ObjectHandle h, const sf::Vector2f& pos ) const;
+
+		// Distance the box can move along one axis before touching something solid
+		float sweepTiles( const sf::FloatRect& box, float delta, bool horizontal ) const;
+		float sweepObjects( const sf::FloatRect& box, float delta, bool horizontal, float allowed ) const;
+		float sweepCharacters( const sf::FloatRect& box, float delta, bool horizontal, float allowed, const Character * self ) const;
+
+		// Gives an object onProximityEnter and onProximityExit for characters within radius of its bounds
+		void watchProximity( ObjectHandle h, float radius );
+		void updateProximity();
+
+	private:
+		Tmx::MappedFile m_baked; // m_map reads its tiles from the bake in place, so it has to outlive it
+		std::unique_ptr< Tmx::Map > m_map;
 		unsigned m_mapID;
 
 		time::Season m_season;
 
+		// How a layer is drawn, indexed like the TMX layers
+		struct LayerInfo
+		{
+			unsigned char seasons;	// bit per time::Season the layer is shown in
+			bool upper;				// above the characters
+			bool collision;			// never drawn
+		};
+		std::vector< LayerInfo > m_layerInfo;
+
 		const Tmx::Layer* m_collision;
+		util::BitGrid m_staticCollision;	// baked from the collision layer
+		util::BitGrid m_dynamicCollision;	// set by objects
+		std::vector< sf::Uint16 > m_dynamicHolds;	// objects holding each tile of m_dynamicCollision
 		std::vector< const Tmx::Layer* > m_lower, m_upper;
-		std::unordered_map< const Tmx::Tileset*, std::shared_ptr< sf::Texture > > m_textures;
+		std::vector< TileTable > m_tileTables;
+
+		gfx::TileMesh m_lowerMesh, m_upperMesh, m_collisionMesh;
+		unsigned m_revision;
+		sf::Clock m_animationClock;
 
 		std::array< std::pair< bf::Map*, int >, 4 > m_neighbors;
 
-		// Map Objects
-		std::vector< Map::Object * > m_objects;
-		std::vector< Map::Object * > m_activeObjects;
+		// Map Objects, constructed in the arena so they sit together in memory
+		util::Arena m_arena;
+		util::SlotMap< Map::Object * > m_objects;
+		ObjectComponents m_components;
+		std::unordered_map< std::string, ObjectHandle > m_objectNames;
+		std::unordered_map< std::string, const Tmx::Object * > m_tmxObjects; // by name, to reload objects from
+		util::SpatialGrid< ObjectHandle > m_objectGrid;
+
+		util::SortAndSweep< const Character* > m_characters;
+
+		struct ProximityWatch
+		{
+			ObjectHandle object;
+			float radius;
+			std::vector< const Character* > near; // sorted
+		};
+		std::vector< ProximityWatch > m_proximity;
+
+		std::vector< ObjectHandle > m_activeObjects; // objects the player is inside, sorted
+		std::vector< std::pair< const Character*, std::vector< ObjectHandle > > > m_characterObjects; // same for characters
+
+		// Objects only get update() while awake, sleeping ones wait in a wheel until they are due
+		// Wheel items carry the sleep they were scheduled for, so woken objects leave stale items behind
+		// Handles of removed objects are skipped when they come up
+		typedef std::pair< ObjectHandle, unsigned > Sleeper;
+		std::vector< ObjectHandle > m_awakeObjects;
+		util::TimingWheel< Sleeper > m_sleepers;		// in milliseconds of map updates
+		util::TimingWheel< Sleeper > m_clockSleepers;	// in minutes of the game clock
+		int m_clockMinute;								// time of day of the last update, -1 before the first
+
+		std::vector< gfx::Light > m_lights;
 		
 		bool m_isExterior;
 	};
 	
 	class MapViewer : public sf::Drawable, public sf::Transformable
 	{
+	public:
+		// A map drawn by the viewer and the position of its origin relative to the viewed map (in pixels)
+		struct Placement
+		{
+			const Map * map;
+			sf::Vector2f origin;
+		};
+
 	public:
 		MapViewer( const Map & map );
 		virtual ~MapViewer() {}
@@ -106,22 +317,66 @@ namespace bf
 
 		const sf::FloatRect& getViewArea() const { return m_area; }
 
+		// Renders the static layers through a render texture that is only redrawn when the view scrolls
+		void cache( bool enable );
+		bool cache() const { return m_cache != nullptr; }
+
+		// Appends the lights reaching into the view, in screen coordinates
+		void getLights( std::vector< gfx::Light >& lights ) const;
+
+		// Renders the view on the CPU: tile layers and objects with a software path, no characters or lights
+		void composite( gfx::Compositor& target ) const;
+
 	protected:
 		virtual void draw( sf::RenderTarget&, sf::RenderStates ) const;
 
+		// Lists the maps that make up the viewed world, starting with the viewed map at (0, 0)
+		virtual void placeMaps( std::vector< Placement >& maps ) const;
+
+	private:
+		struct Cache
+		{
+			gfx::LayerCache lower, upper;
+			std::vector< std::pair< const Map *, unsigned > > maps; // maps and mesh revisions in the pages
+		};
+
+		bool validateCache( const std::vector< Placement >& maps ) const;
+
+		// An entry of the entity pass: a sprite quad, or a map object drawn at an offset
+		struct Entity
+		{
+			sf::Uint32 key;
+			const sf::Texture * texture;
+			sf::Vertex quad[ 4 ];
+			const Map::Object * object;
+			sf::Vector2f offset; // screen position of the object's top left
+		};
+
 	private:
 		const Map * m_map;
 		sf::FloatRect m_area;
 
+		mutable std::shared_ptr< Cache > m_cache;
+
+		// Reused every frame to avoid reallocating, each viewer has its own
+		mutable std::vector< Entity > m_entities, m_sortScratch;
+
 		std::vector< const Character* > m_characters;
 	};
 
+	//-------------------------------------------------------------------------
+	// Draws the viewed map stitched together with its neighbours (and theirs,
+	// which covers the diagonals) as one coordinate space
+	//-------------------------------------------------------------------------
 	class MultiMapViewer : public MapViewer
 	{
 	public:
 		MultiMapViewer( const Map & m ) : MapViewer( m ) {}
 
 	private:
-		void draw( sf::RenderTarget&, sf::RenderStates ) const;
+		void placeMaps( std::vector< Placement >& maps ) const;
 	};
+
+	// Renders a whole map on the CPU, surrounded by margin tiles of its neighbours
+	sf::Image mapshot( const Map& map, unsigned margin = 0U );
 }
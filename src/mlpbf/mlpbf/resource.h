@@ -3,6 +3,8 @@
 #include <SFML/Audio/Music.hpp>
 #include <SFML/Audio/SoundBuffer.hpp>
 #include <SFML/Graphics/Font.hpp>
+#include <SFML/Graphics/Image.hpp>
+#include <SFML/Graphics/Rect.hpp>
 #include <SFML/Graphics/Texture.hpp>
 
 #include <array>
@@ -18,15 +20,28 @@ namespace bf
 		void cleanup();
 		
 		typedef std::shared_ptr< sf::Font > 		FontPtr;
+		typedef std::shared_ptr< const sf::Image > 	ImagePtr;
 		typedef std::shared_ptr< sf::Music > 		MusicPtr;
 		typedef std::shared_ptr< sf::SoundBuffer > 	SoundBufferPtr;
 		typedef std::shared_ptr< sf::Texture > 		TexturePtr;
 		
 		FontPtr		loadFont( const std::string & filename );
+		ImagePtr		loadImage( const std::string & filename );	// decoded pixels in system memory
 		MusicPtr		loadMusic( const std::string & filename );
 		SoundBufferPtr	loadSound( const std::string & filename );
 		TexturePtr	loadTexture( const std::string & filename );
 		
+		// An image packed into one of the shared atlas pages
+		// Images too large for a page get a texture of their own and a rect covering all of it
+		struct AtlasRegion
+		{
+			TexturePtr texture;
+			sf::IntRect rect;
+			std::string file; // image the region was loaded from
+		};
+		
+		AtlasRegion	loadRegion( const std::string & filename );
+		
 		template< std::size_t Size = 1 >
 		class FontLoader
 		{
@@ -57,5 +72,21 @@ namespace bf
 			sf::Texture& getTexture( std::size_t index = 0 ) { assert( m_texture[ index ] ); return *m_texture[ index ]; }
 			const sf::Texture& getTexture( std::size_t index = 0 ) const { assert( m_texture[ index ] ); return *m_texture[ index ]; }
 		};
+		
+		template< std::size_t Size = 1 >
+		class RegionLoader
+		{
+			std::array< AtlasRegion, Size > m_region;
+			
+		public:
+			virtual ~RegionLoader() {}
+
+			void loadRegion( const std::string& file, std::size_t index = 0 ) 
+			{ 
+				m_region.at( index ) = res::loadRegion( file );
+			}
+
+			const AtlasRegion& getRegion( std::size_t index = 0 ) const { assert( m_region[ index ].texture ); return m_region[ index ]; }
+		};
 	}
 }
@@ -5,8 +5,10 @@
 #include "../utility/listener/key.h"
 #include "../map.h"
 #include "../ui/clock.h"
+#include "../graphics/lightmap.h"
 
 #include <array>
+#include <SFML/System/Clock.hpp>
 
 namespace bf
 {
@@ -37,6 +39,9 @@ namespace bf
 			MultiMapViewer m_viewer;
 			ui::Clock m_clock;
 
+			mutable gfx::Lightmap m_lightmap;
+			sf::Clock m_lightClock;
+
 			// Movement variables
 			Direction m_dir;
 			bool m_moving;
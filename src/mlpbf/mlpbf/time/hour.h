@@ -1,10 +1,11 @@
 #pragma once
 
+#include "season.h"
 #include <string>
 
 namespace sf
 {
-	class RenderTarget;
+	class Color;
 }
 
 namespace bf
@@ -62,6 +63,7 @@ namespace bf
 		extern const Hour NOON;
 		extern const Hour DUSK;
 
-		void drawHourTint( sf::RenderTarget&, const Hour& );
+		// Colour blended over exterior scenes, looked up from a per-season table of every minute of the day
+		const sf::Color& hourTint( Season, const Hour& );
 	}
 }
\ No newline at end of file
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <SFML/System/NonCopyable.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <vector>
+
+namespace bf
+{
+	namespace util
+	{
+		//-------------------------------------------------------------------------
+		// Hands out memory from large blocks, one after the other
+		//
+		// Freed allocations go on a free list for their size and are reused by the
+		// next allocation of that size; nothing is returned to the heap until the
+		// arena is released, which frees every block at once
+		//
+		// Allocations larger than a block get a block of their own
+		//-------------------------------------------------------------------------
+		class Arena : private sf::NonCopyable
+		{
+		public:
+			enum { ALIGNMENT = 16 };
+
+			explicit Arena( std::size_t blockSize = 16 * 1024 ) : m_blockSize( blockSize ), m_used( blockSize ) {}
+			~Arena() { release(); }
+
+			void * allocate( std::size_t size )
+			{
+				size = round( std::max( size, sizeof( void * ) ) );
+
+				// Reuse a freed allocation of the same size
+				auto free = m_free.find( size );
+				if ( free != m_free.end() && free->second != nullptr )
+				{
+					void * p = free->second;
+					free->second = *static_cast< void ** >( p );
+					return p;
+				}
+
+				const std::size_t total = HEADER + size;
+				char * block;
+
+				if ( total > m_blockSize )
+				{
+					// Keep the block being bumped last
+					block = newBlock( total );
+					if ( m_blocks.size() > 1 )
+						std::swap( m_blocks[ m_blocks.size() - 1 ], m_blocks[ m_blocks.size() - 2 ] );
+				}
+				else
+				{
+					if ( m_used + total > m_blockSize )
+					{
+						newBlock( m_blockSize );
+						m_used = 0U;
+					}
+					block = m_blocks.back() + m_used;
+					m_used += total;
+				}
+
+				*reinterpret_cast< std::size_t * >( block ) = size;
+				return block + HEADER;
+			}
+
+			// p must come from allocate and not have been freed since
+			void deallocate( void * p )
+			{
+				if ( p == nullptr )
+					return;
+
+				const std::size_t size = *reinterpret_cast< std::size_t * >( static_cast< char * >( p ) - HEADER );
+				void *& head = m_free[ size ];
+				*static_cast< void ** >( p ) = head;
+				head = p;
+			}
+
+			// Frees every block without calling any destructors
+			void release()
+			{
+				for ( char * block : m_blocks )
+					std::free( block );
+				m_blocks.clear();
+				m_free.clear();
+				m_used = m_blockSize;
+			}
+
+			template< typename T >
+			T * create()
+			{
+				void * p = allocate( sizeof( T ) );
+				try { return new ( p ) T(); }
+				catch ( ... ) { deallocate( p ); throw; }
+			}
+
+			// Destroys an object made by create, through a pointer to any of its polymorphic bases
+			template< typename T >
+			void destroy( T * p )
+			{
+				if ( p == nullptr )
+					return;
+
+				void * start = dynamic_cast< void * >( p );
+				p->~T();
+				deallocate( start );
+			}
+
+		private:
+			static std::size_t round( std::size_t size ) { return ( size + ALIGNMENT - 1 ) & ~std::size_t( ALIGNMENT - 1 ); }
+
+			char * newBlock( std::size_t size )
+			{
+				char * block = static_cast< char * >( std::malloc( size ) );
+				if ( block == nullptr )
+					throw std::bad_alloc();
+
+				m_blocks.push_back( block );
+				return block;
+			}
+
+		private:
+			enum { HEADER = ALIGNMENT }; // the size of the allocation, padded to keep it aligned
+
+			std::size_t m_blockSize;
+			std::size_t m_used; // bytes taken from the last block
+
+			std::vector< char * > m_blocks;
+			std::map< std::size_t, void * > m_free; // heads of the free lists, linked through the freed memory
+		};
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace bf
+{
+	namespace util
+	{
+		//-------------------------------------------------------------------------
+		// A grid of one bit per cell, packed row by row into 64 bit words
+		//
+		// Cells outside of the grid read as clear and ignore writes
+		// Rectangles are tested and filled a word at a time
+		//-------------------------------------------------------------------------
+		class BitGrid
+		{
+		public:
+			typedef std::uint64_t Word;
+			enum { WORD_BITS = 64 };
+
+			BitGrid() : m_width( 0U ), m_height( 0U ), m_stride( 0U ) {}
+
+			// Resizes the grid and clears every cell
+			void reset( unsigned width, unsigned height )
+			{
+				m_width = width;
+				m_height = height;
+				m_stride = ( width + WORD_BITS - 1 ) / WORD_BITS;
+				m_words.assign( m_stride * height, 0U );
+			}
+
+			void clear() { std::fill( m_words.begin(), m_words.end(), 0U ); }
+
+			// The packed rows, for saving the grid
+			const Word * data() const { return m_words.empty() ? nullptr : &m_words[ 0 ]; }
+			std::size_t bytes() const { return m_words.size() * sizeof( Word ); }
+
+			// Resizes the grid and copies in the rows saved from data(), which need not be aligned
+			void assign( unsigned width, unsigned height, const void * data )
+			{
+				reset( width, height );
+				if ( !m_words.empty() )
+					std::memcpy( &m_words[ 0 ], data, bytes() );
+			}
+
+			unsigned getWidth() const { return m_width; }
+			unsigned getHeight() const { return m_height; }
+
+			bool test( unsigned x, unsigned y ) const
+			{
+				return x < m_width && y < m_height && ( ( m_words[ y * m_stride + x / WORD_BITS ] >> ( x % WORD_BITS ) ) & 1U ) != 0U;
+			}
+
+			void set( unsigned x, unsigned y, bool value = true )
+			{
+				if ( x >= m_width || y >= m_height )
+					return;
+
+				Word& word = m_words[ y * m_stride + x / WORD_BITS ];
+				const Word bit = Word( 1U ) << ( x % WORD_BITS );
+				word = value ? ( word | bit ) : ( word & ~bit );
+			}
+
+			// Whether any cell of the rectangle [left, right) x [top, bottom) is set
+			bool any( unsigned left, unsigned top, unsigned right, unsigned bottom ) const
+			{
+				Span span;
+				if ( !clip( left, top, right, bottom, span ) )
+					return false;
+
+				for ( unsigned y = top; y < bottom; y++ )
+				{
+					const Word * row = &m_words[ y * m_stride ];
+					for ( unsigned i = span.first; i <= span.last; i++ )
+						if ( row[ i ] & span.mask( i ) )
+							return true;
+				}
+				return false;
+			}
+
+			// Sets or clears every cell of the rectangle [left, right) x [top, bottom)
+			void fill( unsigned left, unsigned top, unsigned right, unsigned bottom, bool value )
+			{
+				Span span;
+				if ( !clip( left, top, right, bottom, span ) )
+					return;
+
+				for ( unsigned y = top; y < bottom; y++ )
+				{
+					Word * row = &m_words[ y * m_stride ];
+					for ( unsigned i = span.first; i <= span.last; i++ )
+						row[ i ] = value ? ( row[ i ] | span.mask( i ) ) : ( row[ i ] & ~span.mask( i ) );
+				}
+			}
+
+		private:
+			// The words covering the columns [left, right) of a row and the bits of the partial ones
+			struct Span
+			{
+				unsigned first, last;
+				Word head, tail;
+
+				Word mask( unsigned i ) const { return ( i == first ? head : ~Word( 0U ) ) & ( i == last ? tail : ~Word( 0U ) ); }
+			};
+
+			bool clip( unsigned left, unsigned top, unsigned& right, unsigned& bottom, Span& span ) const
+			{
+				right = std::min( right, m_width );
+				bottom = std::min( bottom, m_height );
+				if ( left >= right || top >= bottom )
+					return false;
+
+				span.first = left / WORD_BITS;
+				span.last = ( right - 1 ) / WORD_BITS;
+				span.head = ~Word( 0U ) << ( left % WORD_BITS );
+				span.tail = ~Word( 0U ) >> ( WORD_BITS - 1 - ( right - 1 ) % WORD_BITS );
+				return true;
+			}
+
+		private:
+			unsigned m_width, m_height, m_stride;
+			std::vector< Word > m_words;
+		};
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <SFML/Config.hpp>
+#include <cstring>
+#include <vector>
+
+namespace bf
+{
+	namespace util
+	{
+		//-------------------------------------------------------------------------
+		// [UTILITY FUNCTION]
+		//	Maps a float to an unsigned key that sorts in the same order
+		//-------------------------------------------------------------------------
+		inline sf::Uint32 sortKey( float f )
+		{
+			sf::Uint32 u;
+			std::memcpy( &u, &f, sizeof( u ) );
+			return ( u & 0x80000000U ) ? ~u : ( u | 0x80000000U );
+		}
+
+		//-------------------------------------------------------------------------
+		// [UTILITY FUNCTION]
+		//	Stable LSD radix sort by an unsigned 32-bit key, one byte per pass
+		//	Passes where every value shares the same byte are skipped
+		//	temp is scratch space so callers can reuse it between frames
+		//-------------------------------------------------------------------------
+		template< typename T, typename Key >
+		void radixSort( std::vector< T >& values, std::vector< T >& temp, Key key )
+		{
+			temp.resize( values.size() );
+
+			for ( unsigned shift = 0; shift < 32; shift += 8 )
+			{
+				std::size_t count[ 256 ] = { 0 };
+				for ( const T& v : values )
+					count[ ( key( v ) >> shift ) & 0xFF ]++;
+
+				if ( !values.empty() && count[ ( key( values.front() ) >> shift ) & 0xFF ] == values.size() )
+					continue;
+
+				std::size_t offset = 0;
+				for ( std::size_t i = 0; i < 256; i++ )
+				{
+					std::size_t c = count[ i ];
+					count[ i ] = offset;
+					offset += c;
+				}
+
+				for ( const T& v : values )
+					temp[ count[ ( key( v ) >> shift ) & 0xFF ]++ ] = v;
+
+				values.swap( temp );
+			}
+		}
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace bf
+{
+	namespace util
+	{
+		//-------------------------------------------------------------------------
+		// Refers to a value in a SlotMap
+		//
+		// The generation changes every time a slot is reused, so handles to removed
+		// values stay invalid instead of finding whatever took their place
+		// Default constructed handles are never valid
+		//-------------------------------------------------------------------------
+		struct Handle
+		{
+			std::uint32_t index;
+			std::uint32_t generation;
+
+			Handle() : index( 0U ), generation( 0U ) {}
+			Handle( std::uint32_t i, std::uint32_t g ) : index( i ), generation( g ) {}
+
+			bool isNull() const { return generation == 0U; }
+
+			bool operator==( const Handle& h ) const { return index == h.index && generation == h.generation; }
+			bool operator!=( const Handle& h ) const { return !( *this == h ); }
+			bool operator<( const Handle& h ) const { return index < h.index || ( index == h.index && generation < h.generation ); }
+		};
+
+		//-------------------------------------------------------------------------
+		// Stores values in reusable slots addressed by generational handles
+		//
+		// Inserting, removing and looking up are O(1); removed slots are reused
+		// before the storage grows
+		//-------------------------------------------------------------------------
+		template< typename T >
+		class SlotMap
+		{
+		public:
+			SlotMap() : m_size( 0U ) {}
+
+			std::size_t size() const { return m_size; }
+			bool empty() const { return m_size == 0U; }
+
+			Handle insert( const T& value )
+			{
+				std::uint32_t index;
+				if ( m_free.empty() )
+				{
+					index = (std::uint32_t) m_slots.size();
+					m_slots.push_back( Slot() );
+				}
+				else
+				{
+					index = m_free.back();
+					m_free.pop_back();
+				}
+
+				Slot& slot = m_slots[ index ];
+				slot.value = value;
+				slot.generation++;
+				slot.alive = true;
+
+				m_size++;
+				return Handle( index, slot.generation );
+			}
+
+			// Does nothing for handles that are not valid
+			void remove( const Handle& h )
+			{
+				if ( !contains( h ) )
+					return;
+
+				Slot& slot = m_slots[ h.index ];
+				slot.value = T();
+				slot.alive = false;
+
+				m_free.push_back( h.index );
+				m_size--;
+			}
+
+			void clear()
+			{
+				for ( std::uint32_t i = 0; i < m_slots.size(); i++ )
+					if ( m_slots[ i ].alive )
+						remove( Handle( i, m_slots[ i ].generation ) );
+			}
+
+			bool contains( const Handle& h ) const
+			{
+				return h.index < m_slots.size() && m_slots[ h.index ].alive && m_slots[ h.index ].generation == h.generation;
+			}
+
+			// nullptr for handles that are not valid
+			T * get( const Handle& h ) { return contains( h ) ? &m_slots[ h.index ].value : nullptr; }
+			const T * get( const Handle& h ) const { return contains( h ) ? &m_slots[ h.index ].value : nullptr; }
+
+			// Calls f( handle, value ) for every value, in slot order
+			template< typename F >
+			void forEach( F f ) const
+			{
+				for ( std::uint32_t i = 0; i < m_slots.size(); i++ )
+					if ( m_slots[ i ].alive )
+						f( Handle( i, m_slots[ i ].generation ), m_slots[ i ].value );
+			}
+
+		private:
+			struct Slot
+			{
+				T value;
+				std::uint32_t generation;
+				bool alive;
+
+				Slot() : value(), generation( 0U ), alive( false ) {}
+			};
+
+		private:
+			std::vector< Slot > m_slots;
+			std::vector< std::uint32_t > m_free;
+			std::size_t m_size;
+		};
+	}
+}
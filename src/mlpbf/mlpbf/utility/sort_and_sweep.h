@@ -0,0 +1,117 @@
+#pragma once
+
+#include <SFML/Graphics/Rect.hpp>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+namespace bf
+{
+	namespace util
+	{
+		//-------------------------------------------------------------------------
+		// Keeps moving boxes sorted by their left edge for overlap queries
+		//
+		// Moving an item re-sorts it with an insertion pass, which is cheap while
+		// items only move a little between updates. A query only looks at the
+		// items whose left edge falls between the area's left edge minus the
+		// widest item and its right edge
+		//-------------------------------------------------------------------------
+		template< typename T >
+		class SortAndSweep
+		{
+		public:
+			SortAndSweep() : m_maxWidth( 0.0f ) {}
+
+			std::size_t size() const { return m_entries.size(); }
+
+			bool contains( const T& item ) const { return m_index.find( item ) != m_index.end(); }
+
+			// Inserts the item or moves it to its new bounds
+			void place( const T& item, const sf::FloatRect& bounds )
+			{
+				std::size_t i;
+
+				auto find = m_index.find( item );
+				if ( find == m_index.end() )
+				{
+					i = m_entries.size();
+					Entry e = { item, bounds };
+					m_entries.push_back( e );
+					m_index.insert( std::make_pair( item, i ) );
+				}
+				else
+				{
+					i = find->second;
+					m_entries[ i ].bounds = bounds;
+				}
+
+				m_maxWidth = std::max( m_maxWidth, bounds.width );
+
+				while ( i > 0 && m_entries[ i ].bounds.left < m_entries[ i - 1 ].bounds.left )
+				{
+					swap( i, i - 1 );
+					i--;
+				}
+				while ( i + 1 < m_entries.size() && m_entries[ i + 1 ].bounds.left < m_entries[ i ].bounds.left )
+				{
+					swap( i, i + 1 );
+					i++;
+				}
+			}
+
+			void remove( const T& item )
+			{
+				auto find = m_index.find( item );
+				if ( find == m_index.end() )
+					return;
+
+				const std::size_t i = find->second;
+				m_index.erase( find );
+				m_entries.erase( m_entries.begin() + i );
+
+				for ( std::size_t j = i; j < m_entries.size(); j++ )
+					m_index[ m_entries[ j ].item ] = j;
+			}
+
+			// Calls f( item, bounds ) for every item, from left to right
+			template< typename F >
+			void forEach( F f ) const
+			{
+				for ( const Entry& e : m_entries )
+					f( e.item, e.bounds );
+			}
+
+			// Calls f( item, bounds ) for every item whose bounds intersect the area, from left to right
+			template< typename F >
+			void query( const sf::FloatRect& area, F f ) const
+			{
+				const float right = area.left + area.width;
+
+				auto it = std::lower_bound( m_entries.begin(), m_entries.end(), area.left - m_maxWidth, []( const Entry& e, float left ) { return e.bounds.left < left; } );
+				for ( ; it != m_entries.end() && it->bounds.left <= right; ++it )
+					if ( it->bounds.intersects( area ) )
+						f( it->item, it->bounds );
+			}
+
+		private:
+			struct Entry
+			{
+				T item;
+				sf::FloatRect bounds;
+			};
+
+			void swap( std::size_t a, std::size_t b )
+			{
+				std::swap( m_entries[ a ], m_entries[ b ] );
+				m_index[ m_entries[ a ].item ] = a;
+				m_index[ m_entries[ b ].item ] = b;
+			}
+
+		private:
+			std::vector< Entry > m_entries; // sorted by left edge
+			std::unordered_map< T, std::size_t > m_index;
+			float m_maxWidth; // of every item placed so far
+		};
+	}
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <SFML/Graphics/Rect.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace bf
+{
+	namespace util
+	{
+		//-------------------------------------------------------------------------
+		// Buckets items by their bounds into a uniform grid of square cells
+		//
+		// Point queries read one cell and rectangle queries the cells they overlap,
+		// so their cost depends on how crowded the area is rather than on the
+		// number of items. Results come in insertion order
+		//
+		// Items outside of the grid area are kept in the border cells
+		//-------------------------------------------------------------------------
+		template< typename T >
+		class SpatialGrid
+		{
+		public:
+			SpatialGrid() : m_cellSize( 1.0f ), m_columns( 0 ), m_rows( 0 ), m_order( 0U ) {}
+
+			// Removes every item and covers width x height with cells of cellSize
+			void reset( float width, float height, float cellSize )
+			{
+				m_cellSize = cellSize;
+				m_columns = std::max( 1, (int) std::ceil( width / cellSize ) );
+				m_rows = std::max( 1, (int) std::ceil( height / cellSize ) );
+
+				m_cells.assign( m_columns * m_rows, std::vector< unsigned >() );
+				m_entries.clear();
+				m_free.clear();
+			}
+
+			void insert( const T& item, const sf::FloatRect& bounds )
+			{
+				unsigned index;
+				if ( m_free.empty() )
+				{
+					index = (unsigned) m_entries.size();
+					m_entries.push_back( Entry() );
+				}
+				else
+				{
+					index = m_free.back();
+					m_free.pop_back();
+				}
+
+				Entry& e = m_entries[ index ];
+				e.item = item;
+				e.bounds = bounds;
+				e.order = m_order++;
+
+				// The newest item always goes last
+				forEachCell( bounds, [index]( std::vector< unsigned >& cell ) { cell.push_back( index ); } );
+			}
+
+			// Removes the item, looking through the cell at the corner of the bounds it was inserted with
+			void remove( const T& item, const sf::FloatRect& bounds )
+			{
+				if ( m_cells.empty() )
+					return;
+
+				for ( unsigned index : m_cells[ row( bounds.top ) * m_columns + column( bounds.left ) ] )
+					if ( m_entries[ index ].item == item )
+					{
+						erase( index );
+						return;
+					}
+			}
+
+			// Calls f( item ) for every item whose bounds contain the point
+			template< typename F >
+			void query( const sf::Vector2f& point, F f ) const
+			{
+				if ( m_cells.empty() )
+					return;
+
+				for ( unsigned index : m_cells[ row( point.y ) * m_columns + column( point.x ) ] )
+					if ( m_entries[ index ].bounds.contains( point ) )
+						f( m_entries[ index ].item );
+			}
+
+			// Calls f( item ) once for every item whose bounds intersect the area
+			// f may query the grid again, the results are gathered into a vector of this call's own
+			template< typename F >
+			void query( const sf::FloatRect& area, F f ) const
+			{
+				if ( m_cells.empty() )
+					return;
+
+				std::vector< unsigned > results;
+
+				const int left = column( area.left ), right = column( area.left + area.width );
+				const int top = row( area.top ), bottom = row( area.top + area.height );
+
+				for ( int y = top; y <= bottom; y++ )
+					for ( int x = left; x <= right; x++ )
+						for ( unsigned index : m_cells[ y * m_columns + x ] )
+							if ( m_entries[ index ].bounds.intersects( area ) )
+								results.push_back( index );
+
+				// Items spanning several cells were found once per cell
+				std::sort( results.begin(), results.end(), [this]( unsigned a, unsigned b ) { return order( a ) < order( b ); } );
+				results.erase( std::unique( results.begin(), results.end() ), results.end() );
+
+				for ( unsigned index : results )
+					f( m_entries[ index ].item );
+			}
+
+		private:
+			struct Entry
+			{
+				T item;
+				sf::FloatRect bounds;
+				unsigned order; // insertion counter, keeps results in insertion order when slots are reused
+			};
+
+			int column( float x ) const { return std::min( std::max( (int) std::floor( x / m_cellSize ), 0 ), m_columns - 1 ); }
+			int row( float y ) const { return std::min( std::max( (int) std::floor( y / m_cellSize ), 0 ), m_rows - 1 ); }
+
+			unsigned order( unsigned index ) const { return m_entries[ index ].order; }
+
+			void erase( unsigned index )
+			{
+				forEachCell( m_entries[ index ].bounds, [index]( std::vector< unsigned >& cell ) { cell.erase( std::find( cell.begin(), cell.end(), index ) ); } );
+
+				m_free.push_back( index );
+			}
+
+			template< typename F >
+			void forEachCell( const sf::FloatRect& bounds, F f )
+			{
+				if ( m_cells.empty() )
+					return;
+
+				const int left = column( bounds.left ), right = column( bounds.left + bounds.width );
+				const int top = row( bounds.top ), bottom = row( bounds.top + bounds.height );
+
+				for ( int y = top; y <= bottom; y++ )
+					for ( int x = left; x <= right; x++ )
+						f( m_cells[ y * m_columns + x ] );
+			}
+
+		private:
+			float m_cellSize;
+			int m_columns, m_rows;
+
+			std::vector< std::vector< unsigned > > m_cells; // entry indices, in insertion order
+			std::vector< Entry > m_entries;
+			std::vector< unsigned > m_free;
+			unsigned m_order;
+		};
+	}
+}
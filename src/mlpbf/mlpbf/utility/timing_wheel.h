@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace bf
+{
+	namespace util
+	{
+		//-------------------------------------------------------------------------
+		// Schedules items for a tick in a hierarchy of wheels of 64 slots
+		//
+		// The first wheel holds the next 64 ticks one slot per tick, every wheel
+		// after it 64 times the span of the previous one. When a wheel comes
+		// around, the next slot of the wheel above is spread over the ones below,
+		// so advancing costs the due items plus one cascade every 64 ticks rather
+		// than a pass over everything scheduled
+		//
+		// Items further away than the last wheel wait in it and are rescheduled
+		// every time it comes around
+		//-------------------------------------------------------------------------
+		template< typename T >
+		class TimingWheel
+		{
+		public:
+			typedef std::uint64_t Tick;
+			enum { SLOT_BITS = 6, SLOTS = 1 << SLOT_BITS, LEVELS = 4 };
+
+			TimingWheel() : m_now( 0U ), m_size( 0U ) {}
+
+			Tick now() const { return m_now; }
+			std::size_t size() const { return m_size; }
+
+			// Items scheduled for now or earlier are due on the next tick
+			void schedule( const T& item, Tick when )
+			{
+				Entry e = { item, std::max( when, m_now + 1U ) };
+				place( e );
+				m_size++;
+			}
+
+			// Drops every item pred( item ) is true for
+			template< typename P >
+			void removeIf( P pred )
+			{
+				for ( auto& level : m_levels )
+					for ( auto& slot : level )
+					{
+						const std::size_t before = slot.size();
+						slot.erase( std::remove_if( slot.begin(), slot.end(), [&pred]( const Entry& e ) { return pred( e.item ); } ), slot.end() );
+						m_size -= before - slot.size();
+					}
+			}
+
+			// Moves time forward, calling f( item ) for every item that becomes due, in tick order
+			// Items f schedules for the ticks being advanced over are called in the same pass
+			template< typename F >
+			void advance( Tick ticks, F f )
+			{
+				const Tick end = m_now + ticks;
+
+				while ( m_now < end )
+				{
+					if ( m_size == 0U )
+					{
+						m_now = end;
+						return;
+					}
+
+					m_now++;
+
+					// Spread the wheels that came around, top down so items fall through every level
+					for ( int level = LEVELS - 1; level > 0; level-- )
+						if ( ( m_now & ( ( Tick( 1U ) << ( level * SLOT_BITS ) ) - 1U ) ) == 0U )
+							cascade( level );
+
+					std::vector< Entry >& slot = m_levels[ 0 ][ m_now & ( SLOTS - 1 ) ];
+					if ( slot.empty() )
+						continue;
+
+					m_due.swap( slot );
+					m_size -= m_due.size();
+					for ( const Entry& e : m_due )
+						f( e.item );
+					m_due.clear();
+				}
+			}
+
+		private:
+			struct Entry
+			{
+				T item;
+				Tick when;
+			};
+
+			// Wheel whose span covers the distance to when, and its slot for when
+			void place( const Entry& e )
+			{
+				const Tick delta = e.when - m_now;
+
+				for ( int level = 0; level < LEVELS; level++ )
+					if ( delta < ( Tick( 1U ) << ( ( level + 1 ) * SLOT_BITS ) ) )
+					{
+						m_levels[ level ][ ( e.when >> ( level * SLOT_BITS ) ) & ( SLOTS - 1 ) ].push_back( e );
+						return;
+					}
+
+				// Too far away: the last slot of the top wheel before it comes around to now
+				m_levels[ LEVELS - 1 ][ ( ( m_now >> ( ( LEVELS - 1 ) * SLOT_BITS ) ) + SLOTS - 1 ) & ( SLOTS - 1 ) ].push_back( e );
+			}
+
+			void cascade( int level )
+			{
+				std::vector< Entry > entries;
+				entries.swap( m_levels[ level ][ ( m_now >> ( level * SLOT_BITS ) ) & ( SLOTS - 1 ) ] );
+
+				for ( const Entry& e : entries )
+					place( e );
+			}
+
+		private:
+			Tick m_now;
+			std::size_t m_size;
+
+			std::array< std::array< std::vector< Entry >, SLOTS >, LEVELS > m_levels;
+			std::vector< Entry > m_due; // scratch for the slot being called
+		};
+	}
+}
@@ -0,0 +1,198 @@
+#include "mlpbf/graphics/render_recorder.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <SFML/Graphics/VertexArray.hpp>
+
+namespace bf
+{
+namespace gfx
+{
+
+static const char * PRIMITIVE_NAMES[] = { "points", "lines", "line strips", "triangles", "triangle strips", "triangle fans", "quads" };
+
+static RenderRecorder * s_recording = nullptr;
+
+/***************************************************************************/
+
+RenderRecorder::Stats& RenderRecorder::Stats::operator+=( const Stats& s )
+{
+	drawCalls		+= s.drawCalls;
+	vertices		+= s.vertices;
+	textureSwitches	+= s.textureSwitches;
+	untracked		+= s.untracked;
+
+	for ( std::size_t i = 0; i < primitives.size(); i++ )
+		primitives[ i ] += s.primitives[ i ];
+
+	return *this;
+}
+
+/***************************************************************************/
+
+RenderRecorder::RenderRecorder( const sf::Vector2u& size ) :
+	m_size( size ),
+	m_frames( 0U ),
+	m_texture( nullptr ),
+	m_tracked( nullptr )
+{
+	initialize();
+	reset();
+}
+
+void RenderRecorder::reset()
+{
+	m_stats.clear();
+	m_frames = 0U;
+	m_texture = nullptr;
+	m_tracked = nullptr;
+}
+
+void RenderRecorder::beginFrame()
+{
+	m_frames++;
+	m_texture = nullptr;
+	m_tracked = nullptr;
+	s_recording = this;
+}
+
+void RenderRecorder::endFrame()
+{
+	if ( s_recording == this )
+		s_recording = nullptr;
+}
+
+RenderRecorder * RenderRecorder::recording()
+{
+	return s_recording;
+}
+
+void RenderRecorder::pushScope( const std::string& name )
+{
+	m_scopes.push_back( name );
+}
+
+void RenderRecorder::popScope()
+{
+	if ( !m_scopes.empty() )
+		m_scopes.pop_back();
+}
+
+RenderRecorder::Stats& RenderRecorder::current()
+{
+	return m_stats[ m_scopes.empty() ? "other" : m_scopes.back() ];
+}
+
+void RenderRecorder::record( const sf::RenderTarget& target, const sf::Vertex* vertices, unsigned count, sf::PrimitiveType type, const sf::RenderStates& states )
+{
+	// sf::RenderTarget skips empty draws without activating
+	if ( !vertices || count == 0 )
+		return;
+
+	Stats& s = current();
+	s.drawCalls++;
+	s.vertices += count;
+	s.primitives[ type ]++;
+
+	if ( states.texture != m_texture )
+	{
+		s.textureSwitches++;
+		m_texture = states.texture;
+	}
+
+	m_tracked = &target;
+}
+
+void RenderRecorder::activated( const sf::RenderTarget& target )
+{
+	// Activations of other targets (render texture pages) are not reported, so a tracked draw into one never pairs up here
+	if ( m_tracked != &target )
+	{
+		Stats& s = current();
+		s.drawCalls++;
+		s.untracked++;
+	}
+
+	m_tracked = nullptr;
+}
+
+bool RenderRecorder::activate( bool )
+{
+	// Every draw, clear and state change activates the target first; refusing keeps OpenGL out of it
+	if ( s_recording == this )
+		activated( *this );
+
+	return false;
+}
+
+void RenderRecorder::report( std::ostream& out ) const
+{
+	const unsigned frames = std::max( m_frames, 1U );
+
+	Stats total;
+	for ( const auto& entry : m_stats )
+		total += entry.second;
+
+	auto print = [&]( const std::string& name, const Stats& s )
+	{
+		out << std::left << std::setw( 12 ) << name
+			<< " draws: " << s.drawCalls / frames
+			<< " (untracked " << s.untracked / frames << ")"
+			<< " vertices: " << s.vertices / frames
+			<< " texture switches: " << s.textureSwitches / frames;
+
+		for ( std::size_t i = 0; i < s.primitives.size(); i++ )
+			if ( s.primitives[ i ] > 0 )
+				out << " " << PRIMITIVE_NAMES[ i ] << ": " << s.primitives[ i ] / frames;
+		out << std::endl;
+	};
+
+	out << "Render statistics per frame over " << m_frames << " frame(s)" << std::endl;
+	for ( const auto& entry : m_stats )
+		print( entry.first, entry.second );
+	print( "total", total );
+}
+
+/***************************************************************************/
+
+bool RecordingWindow::activate( bool active )
+{
+	if ( s_recording )
+		s_recording->activated( *this );
+
+	return setActive( active );
+}
+
+/***************************************************************************/
+
+RenderScope::RenderScope( const std::string& name ) :
+	m_recorder( s_recording )
+{
+	if ( m_recorder )
+		m_recorder->pushScope( name );
+}
+
+RenderScope::~RenderScope()
+{
+	if ( m_recorder )
+		m_recorder->popScope();
+}
+
+/***************************************************************************/
+
+void draw( sf::RenderTarget& target, const sf::VertexArray& vertices, const sf::RenderStates& states )
+{
+	if ( vertices.getVertexCount() == 0 )
+		return;
+
+	if ( s_recording )
+		s_recording->record( target, &vertices[ 0 ], vertices.getVertexCount(), vertices.getPrimitiveType(), states );
+
+	target.draw( vertices, states );
+}
+
+/***************************************************************************/
+
+} // namespace gfx
+
+} // namespace bf
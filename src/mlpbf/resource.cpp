@@ -1,12 +1,16 @@
 #include "mlpbf/resource.h"
 #include "mlpbf/exception.h"
 
+#include <algorithm>
 #include <cassert>
+#include <climits>
 #include <memory>
 #include <unordered_map>
 #include <string>
 #include <sstream>
+#include <SFML/Graphics/Image.hpp>
 #include <SFML/System/NonCopyable.hpp>
+#include <vector>
 
 namespace bf
 {
@@ -16,6 +20,7 @@ namespace res
 /***************************************************************************/
 
 class TextureLoadException : public Exception { public: TextureLoadException( const std::string & file ) throw() { *this << "Failed to load texture \"" << file << "\""; } };
+class ImageLoadException : public Exception { public: ImageLoadException( const std::string & file ) { *this << "Failed to load image \"" << file << "\""; } };
 class FontLoadException : public Exception { public: FontLoadException( const std::string & file ) { *this << "Failed to load font \"" << file << "\""; } };
 class SoundLoadException : public Exception { public: SoundLoadException( const std::string & file ) { *this << "Failed to load sound \"" << file << "\""; } };
 class MusicLoadException : public Exception { public: MusicLoadException( const std::string & file ) { *this << "Failed to load music \"" << file << "\""; } };
@@ -68,6 +73,17 @@ class FontManager : public ResourceManager< sf::Font >
 	}
 } * g_FontManager = NULL;
 
+class ImageManager : public ResourceManager< const sf::Image >
+{
+	std::shared_ptr< const sf::Image > _load( const std::string & file ) const
+	{
+		std::shared_ptr< sf::Image > res( new sf::Image() );
+		if ( !res->loadFromFile( file ) )
+			throw ImageLoadException( file );
+		return res;
+	}
+} * g_ImageManager = NULL;
+
 class MusicManager : public ResourceManager< sf::Music >
 {
 	std::shared_ptr< sf::Music > _load( const std::string & file ) const
@@ -103,25 +119,222 @@ class TextureManager : public ResourceManager< sf::Texture >
 
 /***************************************************************************/
 
+//-------------------------------------------------------------------------
+// Packs small and medium images into large texture pages with a skyline
+// (bottom-left) packer so sprites from different files can share a texture
+//
+// Every image is surrounded by PADDING pixels copied from its own edge so
+// filtering and rounding never sample a neighbouring image
+// Packed images stay in their page until cleanup
+//-------------------------------------------------------------------------
+class AtlasManager : private sf::NonCopyable
+{
+	enum
+	{
+		PAGE_SIZE = 2048,
+		MAX_REGION = 1024,
+		PADDING = 1
+	};
+
+	struct Node
+	{
+		int x, y, width;
+	};
+
+	struct Page
+	{
+		TexturePtr texture;
+		std::vector< Node > skyline; // sorted by x, covers the whole page width
+	};
+
+public:
+	AtlasRegion load( const std::string & file )
+	{
+		auto find = m_regions.find( file );
+		if ( find != m_regions.end() )
+			return find->second;
+
+		// Decoded through the image cache, so a software renderer holding the image shares it
+		const ImagePtr decoded = g_ImageManager->load( file );
+		const sf::Image & image = *decoded;
+
+		const int width = (int) image.getSize().x, height = (int) image.getSize().y;
+		const int size = pageSize();
+
+		AtlasRegion region;
+		region.file = file;
+		if ( width > MAX_REGION || height > MAX_REGION || width + 2 * PADDING > size || height + 2 * PADDING > size )
+		{
+			region.texture = TexturePtr( new sf::Texture() );
+			if ( !region.texture->loadFromImage( image ) )
+				throw TextureLoadException( file );
+			region.rect = sf::IntRect( 0, 0, width, height );
+		}
+		else
+		{
+			const int w = width + 2 * PADDING, h = height + 2 * PADDING;
+
+			sf::Vector2i pos;
+			Page * page = nullptr;
+			for ( Page & p : m_pages )
+				if ( insert( p, w, h, pos ) )
+				{
+					page = &p;
+					break;
+				}
+
+			if ( page == nullptr )
+			{
+				m_pages.push_back( Page() );
+				page = &m_pages.back();
+
+				page->texture = TexturePtr( new sf::Texture() );
+				if ( !page->texture->create( size, size ) )
+					throw TextureLoadException( file );
+
+				Node node = { 0, 0, size };
+				page->skyline.push_back( node );
+
+				insert( *page, w, h, pos );
+			}
+
+			page->texture->update( extrude( image ), pos.x, pos.y );
+
+			region.texture = page->texture;
+			region.rect = sf::IntRect( pos.x + PADDING, pos.y + PADDING, width, height );
+		}
+
+		m_regions.insert( std::make_pair( file, region ) );
+		return region;
+	}
+
+private:
+	static int pageSize()
+	{
+		return (int) std::min< unsigned >( PAGE_SIZE, sf::Texture::getMaximumSize() );
+	}
+
+	// Returns the image with its border pixels repeated PADDING times on every side
+	static sf::Image extrude( const sf::Image & image )
+	{
+		const int width = (int) image.getSize().x, height = (int) image.getSize().y;
+
+		sf::Image padded;
+		padded.create( width + 2 * PADDING, height + 2 * PADDING );
+
+		for ( int y = 0; y < height + 2 * PADDING; y++ )
+			for ( int x = 0; x < width + 2 * PADDING; x++ )
+			{
+				int sx = std::min( std::max( x - PADDING, 0 ), width - 1 );
+				int sy = std::min( std::max( y - PADDING, 0 ), height - 1 );
+				padded.setPixel( x, y, image.getPixel( sx, sy ) );
+			}
+
+		return padded;
+	}
+
+	// Finds the lowest spot for a w x h rectangle and raises the skyline over it
+	static bool insert( Page & page, int w, int h, sf::Vector2i & pos )
+	{
+		std::vector< Node > & nodes = page.skyline;
+		const int size = pageSize();
+
+		int best = -1, bestBottom = INT_MAX, bestWidth = INT_MAX;
+		for ( std::size_t i = 0; i < nodes.size(); i++ )
+		{
+			const int x = nodes[ i ].x;
+			if ( x + w > size )
+				break;
+
+			// the rectangle rests on the highest node under it
+			int y = 0, covered = 0;
+			for ( std::size_t j = i; covered < w; j++ )
+			{
+				y = std::max( y, nodes[ j ].y );
+				covered += nodes[ j ].width;
+			}
+
+			if ( y + h > size )
+				continue;
+
+			if ( y + h < bestBottom || ( y + h == bestBottom && nodes[ i ].width < bestWidth ) )
+			{
+				best = (int) i;
+				bestBottom = y + h;
+				bestWidth = nodes[ i ].width;
+				pos = sf::Vector2i( x, y );
+			}
+		}
+
+		if ( best < 0 )
+			return false;
+
+		Node node = { pos.x, pos.y + h, w };
+		nodes.insert( nodes.begin() + best, node );
+
+		// Shrink or remove the nodes now covered by the new one
+		for ( std::size_t i = best + 1; i < nodes.size(); )
+		{
+			const Node & prev = nodes[ i - 1 ];
+			Node & cur = nodes[ i ];
+
+			const int overlap = prev.x + prev.width - cur.x;
+			if ( overlap <= 0 )
+				break;
+
+			cur.x += overlap;
+			cur.width -= overlap;
+
+			if ( cur.width > 0 )
+				break;
+			nodes.erase( nodes.begin() + i );
+		}
+
+		// Merge neighbouring nodes at the same height
+		for ( std::size_t i = 0; i + 1 < nodes.size(); )
+			if ( nodes[ i ].y == nodes[ i + 1 ].y )
+			{
+				nodes[ i ].width += nodes[ i + 1 ].width;
+				nodes.erase( nodes.begin() + i + 1 );
+			}
+			else
+				i++;
+
+		return true;
+	}
+
+private:
+	std::vector< Page > m_pages;
+	std::unordered_map< std::string, AtlasRegion > m_regions;
+} * g_AtlasManager = NULL;
+
+/***************************************************************************/
+
 void init()
 {
 	g_FontManager		= new FontManager();
+	g_ImageManager		= new ImageManager();
 	g_MusicManager		= new MusicManager();
 	g_SoundManager		= new SoundManager();
 	g_TextureManager	= new TextureManager();
+	g_AtlasManager		= new AtlasManager();
 }
 
 void cleanup()
 {
 	delete g_FontManager;
+	delete g_ImageManager;
 	delete g_MusicManager;
 	delete g_SoundManager;
 	delete g_TextureManager;
+	delete g_AtlasManager;
 	
 	g_FontManager 		= NULL;
+	g_ImageManager		= NULL;
 	g_MusicManager 	= NULL;
 	g_SoundManager 	= NULL;
 	g_TextureManager 	= NULL;
+	g_AtlasManager		= NULL;
 }
 
 /***************************************************************************/
@@ -132,6 +345,12 @@ FontPtr loadFont( const std::string & str )
 	return g_FontManager->load( str );
 }
 
+ImagePtr loadImage( const std::string & str )
+{
+	assert( g_ImageManager != NULL );
+	return g_ImageManager->load( str );
+}
+
 MusicPtr loadMusic( const std::string & str )
 {
 	assert( g_MusicManager != NULL );
@@ -150,6 +369,12 @@ TexturePtr loadTexture( const std::string & str )
 	return g_TextureManager->load( str );
 }
 
+AtlasRegion loadRegion( const std::string & str )
+{
+	assert( g_AtlasManager != NULL );
+	return g_AtlasManager->load( str );
+}
+
 /***************************************************************************/
 
 } // namespace res
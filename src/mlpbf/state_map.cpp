@@ -2,7 +2,9 @@
 
 #include "mlpbf/global.h"
 #include "mlpbf/console.h"
+#include "mlpbf/database.h"
 #include "mlpbf/direction.h"
+#include "mlpbf/graphics/render_recorder.h"
 #include "mlpbf/player.h"
 #include "mlpbf/map.h"
 
@@ -309,6 +311,11 @@ void state::Map::update( const sf::Time& time )
 	// Update time
 	Time::singleton().update();
 
+	// Seasonal layers follow the date, however it was changed; maps already in the season skip this
+	const time::Season season = Time::singleton().getDate().getSeason();
+	for ( unsigned i = 0; i < db::getMapCount(); i++ )
+		db::getMap( i ).season( season );
+
 	// Move the player depending on the input
 	player.update( time );
 
@@ -323,19 +330,30 @@ void state::Map::update( const sf::Time& time )
 		m_viewer.map( bf::Map::global( player.getMapID() ) );
 
 	// Center the map on the player
+	if ( m_viewer.cache() != CACHE_LAYERS )
+		m_viewer.cache( CACHE_LAYERS );
 	m_viewer.center( player.getPosition() );
 
 	// Update the current map
-	map.update( time.asMilliseconds(), player.getPosition() );
+	map.update( time.asMilliseconds(), player.getPosition(), std::vector< const Character* >( 1, rarity ) );
 }
 
 void state::Map::draw( sf::RenderTarget& target, sf::RenderStates states ) const
 {
+	gfx::RenderScope scope( "state_map" );
+
 	target.draw( m_viewer, states );
 	
-	//TODO: check if exterior
+	// Day/night tint, lit by the lights in view
 	if ( m_viewer.map().isExterior() )
-		time::drawHourTint( target, Time::singleton().getHour() );
+	{
+		const Time& t = Time::singleton();
+
+		std::vector< gfx::Light > lights;
+		m_viewer.getLights( lights );
+
+		m_lightmap.draw( target, states, time::hourTint( t.getDate().getSeason(), t.getHour() ), lights, m_lightClock.getElapsedTime().asMilliseconds() );
+	}
 
 	//DEBUG
 	if ( DEBUG_COLLISION )
@@ -0,0 +1,157 @@
+#include "mlpbf/graphics/tile_mesh.h"
+#include "mlpbf/graphics/render_recorder.h"
+#include "mlpbf/global.h"
+
+#include <algorithm>
+#include <cmath>
+#include <SFML/Graphics/RenderTarget.hpp>
+
+namespace bf
+{
+namespace gfx
+{
+
+/***************************************************************************/
+
+void TileMesh::reset( unsigned width, unsigned height )
+{
+	m_width  = ( width  + CHUNK_SIZE - 1 ) / CHUNK_SIZE;
+	m_height = ( height + CHUNK_SIZE - 1 ) / CHUNK_SIZE;
+	m_layer  = 0U;
+
+	m_chunks.clear();
+	m_chunks.resize( m_width * m_height );
+}
+
+void TileMesh::beginLayer()
+{
+	m_layer++;
+}
+
+void TileMesh::texCoords( sf::Vertex * quad, const sf::IntRect & rect, unsigned flip )
+{
+	// Corners in quad order: top-left, top-right, bottom-right, bottom-left
+	static const float CORNERS[ 4 ][ 2 ] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f } };
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		float u = CORNERS[ i ][ 0 ], v = CORNERS[ i ][ 1 ];
+
+		// Tiled applies the diagonal flip first, so the texture lookup undoes them in reverse
+		if ( flip & FLIP_VERTICAL )		v = 1.0f - v;
+		if ( flip & FLIP_HORIZONTAL )	u = 1.0f - u;
+		if ( flip & FLIP_DIAGONAL )		std::swap( u, v );
+
+		quad[ i ].texCoords = sf::Vector2f( rect.left + u * rect.width, rect.top + v * rect.height );
+	}
+}
+
+void TileMesh::append( unsigned x, unsigned y, const sf::Texture & texture, const sf::Vertex * quad, const Animation * animation, unsigned flip )
+{
+	Chunk & chunk = m_chunks[ ( y / CHUNK_SIZE ) * m_width + ( x / CHUNK_SIZE ) ];
+	std::vector< Batch > & batches = chunk.batches;
+
+	// tiles of the same layer never overlap, so any batch of this layer with the same texture can take the quad
+	auto find = std::find_if( batches.rbegin(), batches.rend(), [&]( const Batch & b ) { return b.layer == m_layer && b.texture == &texture; } );
+
+	Batch * batch = nullptr;
+	if ( find != batches.rend() )
+		batch = &*find;
+	else if ( !batches.empty() && batches.back().texture == &texture )
+	{
+		// the last batch is drawn after everything else in the chunk, so it can be extended by a later layer
+		batch = &batches.back();
+		batch->layer = m_layer;
+	}
+	else
+	{
+		batches.push_back( Batch() );
+		batch = &batches.back();
+		batch->texture = &texture;
+		batch->vertices.setPrimitiveType( sf::Quads );
+		batch->layer = m_layer;
+	}
+
+	if ( animation && !animation->rects.empty() && animation->ends.back() > 0 )
+	{
+		AnimatedTile tile = { animation, (unsigned) ( batch - &batches[ 0 ] ), batch->vertices.getVertexCount(), flip, 0U };
+		chunk.animated.push_back( tile );
+	}
+
+	for ( int i = 0; i < 4; i++ )
+		batch->vertices.append( quad[i] );
+}
+
+void TileMesh::chunkRange( const sf::FloatRect & area, int & left, int & top, int & right, int & bottom ) const
+{
+	const float chunkWidth  = static_cast< float >( CHUNK_SIZE * TILE_WIDTH );
+	const float chunkHeight = static_cast< float >( CHUNK_SIZE * TILE_HEIGHT );
+
+	left   = std::max( 0, static_cast< int >( std::floor( area.left / chunkWidth ) ) );
+	top    = std::max( 0, static_cast< int >( std::floor( area.top / chunkHeight ) ) );
+	right  = std::min( (int) m_width,  static_cast< int >( std::ceil( ( area.left + area.width ) / chunkWidth ) ) );
+	bottom = std::min( (int) m_height, static_cast< int >( std::ceil( ( area.top + area.height ) / chunkHeight ) ) );
+}
+
+sf::FloatRect TileMesh::animate( sf::Uint32 time, const sf::FloatRect & area ) const
+{
+	int left, top, right, bottom;
+	chunkRange( area, left, top, right, bottom );
+
+	float minX = 0.0f, minY = 0.0f, maxX = 0.0f, maxY = 0.0f;
+	bool changed = false;
+
+	for ( int y = top; y < bottom; y++ )
+		for ( int x = left; x < right; x++ )
+		{
+			Chunk & chunk = m_chunks[ y * m_width + x ];
+			for ( AnimatedTile & tile : chunk.animated )
+			{
+				const Animation & anim = *tile.animation;
+
+				sf::Uint32 t = time % anim.ends.back();
+				unsigned frame = std::upper_bound( anim.ends.begin(), anim.ends.end(), t ) - anim.ends.begin();
+				if ( frame == tile.frame )
+					continue;
+
+				tile.frame = frame;
+
+				sf::Vertex * quad = &chunk.batches[ tile.batch ].vertices[ tile.vertex ];
+				texCoords( quad, anim.rects[ frame ], tile.flip );
+
+				const sf::Vector2f& a = quad[ 0 ].position, & b = quad[ 2 ].position;
+				if ( !changed )
+				{
+					minX = a.x; minY = a.y; maxX = b.x; maxY = b.y;
+					changed = true;
+				}
+				else
+				{
+					minX = std::min( minX, a.x ); minY = std::min( minY, a.y );
+					maxX = std::max( maxX, b.x ); maxY = std::max( maxY, b.y );
+				}
+			}
+		}
+
+	return sf::FloatRect( minX, minY, maxX - minX, maxY - minY );
+}
+
+void TileMesh::draw( sf::RenderTarget & target, sf::RenderStates states, const sf::FloatRect & area ) const
+{
+	int left, top, right, bottom;
+	chunkRange( area, left, top, right, bottom );
+
+	for ( int y = top; y < bottom; y++ )
+		for ( int x = left; x < right; x++ )
+			for ( const Batch & batch : m_chunks[ y * m_width + x ].batches )
+			{
+				states.texture = batch.texture;
+				gfx::draw( target, batch.vertices, states );
+			}
+}
+
+/***************************************************************************/
+
+} // namespace gfx
+
+} // namespace bf
@@ -4,13 +4,13 @@
 #include "mlpbf/exception.h"
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cctype>
 #include <sstream>
 #include <iomanip>
 
-#include <SFML/Graphics/RectangleShape.hpp>
-#include <SFML/Graphics/RenderTarget.hpp>
+#include <SFML/Graphics/Color.hpp>
 
 namespace bf
 {
@@ -416,6 +416,8 @@ static sf::Color transitionColor( const sf::Color& a, const sf::Color& b, float
 	return sf::Color( ampA.r + ampB.r, ampA.g + ampB.g, ampA.b + ampB.b, ampA.a + ampB.a );
 }
 
+const static int MINUTES_PER_DAY = 24 * 60;
+
 static sf::Color tintColor( const Hour& hour )
 {
 	const Vector2H*  period = nullptr;
@@ -477,17 +479,23 @@ static sf::Color tintColor( const Hour& hour )
 	return transitionColor( *color1, *color2, mult );
 }
 
-void drawHourTint( sf::RenderTarget& target, const Hour& hour )
+typedef std::array< std::array< sf::Color, MINUTES_PER_DAY >, 4 > TintTable;
+
+static TintTable buildTintTable()
 {
-	float width = static_cast< float >( SCREEN_WIDTH );
-	float height = static_cast< float >( SCREEN_HEIGHT );
+	TintTable table;
 
-	sf::Color color = tintColor( hour );
+	for ( int season = Spring; season <= Winter; season++ )
+		for ( int minute = 0; minute < MINUTES_PER_DAY; minute++ )
+			table[ season ][ minute ] = tintColor( Hour( minute / 60, minute % 60 ) );
 
-	sf::RectangleShape rect( sf::Vector2f( width, height ) );
-	rect.setFillColor( color );
+	return table;
+}
 
-	target.draw( rect );
+const sf::Color& hourTint( Season season, const Hour& hour )
+{
+	static const TintTable TABLE = buildTintTable();
+	return TABLE[ season ][ hour.get24Hour() * 60 + hour.getMinute() ];
 }
 
 /***************************************************************************/
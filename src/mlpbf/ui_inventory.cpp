@@ -30,14 +30,14 @@ static const sf::Time INV_MOVE_TIME = sf::milliseconds( 350 );
 
 /***************************************************************************/
 
-class Tile : public sf::Drawable, public sf::Transformable, res::TextureLoader< 2 >
+class Tile : public sf::Drawable, public sf::Transformable, res::RegionLoader< 2 >
 {
 public:
 	Tile( const Item* item ) :
 		m_highlight( false ), m_item( item )
 	{
-		loadTexture( TILE_BG_INNER, TILE_INNER );
-		loadTexture( TILE_BG_OUTER, TILE_OUTER );
+		loadRegion( TILE_BG_INNER, TILE_INNER );
+		loadRegion( TILE_BG_OUTER, TILE_OUTER );
 	}
 
 	const Item* getItem() const
@@ -66,10 +66,12 @@ private:
 		states.transform *= getTransform();
 
 		// Draw the outer
-		target.draw( sf::Sprite( getTexture( TILE_OUTER ) ), states );
+		const res::AtlasRegion & outer = getRegion( TILE_OUTER );
+		target.draw( sf::Sprite( *outer.texture, outer.rect ), states );
 
 		// Draw the inner
-		sf::Sprite inner( getTexture( TILE_INNER ) );
+		const res::AtlasRegion & region = getRegion( TILE_INNER );
+		sf::Sprite inner( *region.texture, region.rect );
 		inner.setPosition( 2.0f, 2.0f );
 		inner.setColor( sf::Color( 255, 255, 255, m_highlight ? 200 : 100 ) );
 
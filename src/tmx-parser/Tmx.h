@@ -27,6 +27,7 @@
 //-----------------------------------------------------------------------------
 #pragma once
 
+#include "TmxBinary.h"
 #include "TmxMap.h"
 #include "TmxTileset.h"
 #include "TmxTile.h"
@@ -37,4 +38,5 @@
 #include "TmxPolygon.h"
 #include "TmxPolyline.h"
 #include "TmxPropertySet.h"
-#include "TmxUtil.h"
\ No newline at end of file
+#include "TmxUtil.h"
+#include "TmxXmlReader.h"
\ No newline at end of file
@@ -0,0 +1,268 @@
+//-----------------------------------------------------------------------------
+// TmxBinary.cpp
+//
+// Copyright (c) 2010-2012, Tamir Atias
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL TAMIR ATIAS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Tamir Atias
+#include <string.h>
+
+#include "TmxBinary.h"
+
+namespace Tmx 
+{
+	// Every value is aligned to this many bytes, from the start of the data.
+	static const size_t alignment = 4;
+
+	// Written in the byte order of the machine, reads back differently on an other one.
+	static const unsigned byteOrderMark = 0x01020304;
+
+	static const char magic[4] = { 'T', 'M', 'X', 'B' };
+
+	// Magic, version, byte order, number of strings and size of the string table.
+	static const size_t headerSize = 20;
+
+	static size_t Pad(size_t size) 
+	{
+		return (size + alignment - 1) & ~(alignment - 1);
+	}
+
+	static void AppendUnsigned(std::string &out, unsigned value) 
+	{
+		out.append((const char *)&value, sizeof(value));
+	}
+
+	BinaryWriter::BinaryWriter() 
+		: body()
+		, strings()
+		, string_ids()
+	{
+	}
+
+	void BinaryWriter::WriteInt(int value) 
+	{
+		body.append((const char *)&value, sizeof(value));
+	}
+
+	void BinaryWriter::WriteFloat(float value) 
+	{
+		body.append((const char *)&value, sizeof(value));
+	}
+
+	void BinaryWriter::WriteDouble(double value) 
+	{
+		body.append((const char *)&value, sizeof(value));
+	}
+
+	void BinaryWriter::WriteString(const std::string &value) 
+	{
+		std::map< std::string, int >::iterator find = string_ids.find(value);
+		if (find == string_ids.end()) 
+		{
+			find = string_ids.insert(std::make_pair(value, (int)strings.size())).first;
+			strings.push_back(&find->first);
+		}
+
+		WriteInt(find->second);
+	}
+
+	void BinaryWriter::WriteBytes(const void *data, size_t size) 
+	{
+		body.append((const char *)data, size);
+		body.append(Pad(size) - size, '\0');
+	}
+
+	void BinaryWriter::Finish(std::string *out) const 
+	{
+		std::string table;
+		for (size_t i = 0; i < strings.size(); ++i) 
+		{
+			AppendUnsigned(table, strings[i]->size());
+			table += *strings[i];
+		}
+		table.append(Pad(table.size()) - table.size(), '\0');
+
+		out->assign(magic, sizeof(magic));
+		AppendUnsigned(*out, TMX_BINARY_VERSION);
+		AppendUnsigned(*out, byteOrderMark);
+		AppendUnsigned(*out, strings.size());
+		AppendUnsigned(*out, table.size());
+		*out += table;
+		*out += body;
+	}
+
+	BinaryReader::BinaryReader(const char *_data, size_t size) 
+		: data(_data)
+		, end(_data + size)
+		, strings()
+		, error_text()
+	{
+		const char *header = Take(headerSize);
+		if (!header || memcmp(header, magic, sizeof(magic)) != 0) 
+		{
+			SetError("This is not a binary map.");
+			return;
+		}
+
+		unsigned version, byteOrder, stringCount, tableSize;
+		memcpy(&version, header + 4, sizeof(version));
+		memcpy(&byteOrder, header + 8, sizeof(byteOrder));
+		memcpy(&stringCount, header + 12, sizeof(stringCount));
+		memcpy(&tableSize, header + 16, sizeof(tableSize));
+
+		if (version != TMX_BINARY_VERSION) 
+		{
+			SetError("The binary map was written by an other version.");
+			return;
+		}
+
+		if (byteOrder != byteOrderMark) 
+		{
+			SetError("The binary map was written in an other byte order.");
+			return;
+		}
+
+		// The values follow the string table.
+		const char *table = Take(tableSize);
+		if (!table || tableSize % alignment != 0) 
+		{
+			SetError("The string table of the binary map is damaged.");
+			return;
+		}
+
+		const char *tableEnd = table + tableSize;
+		strings.reserve(stringCount < tableSize / 4 ? stringCount : tableSize / 4);
+
+		for (unsigned i = 0; i < stringCount; ++i) 
+		{
+			unsigned length;
+			if ((size_t)(tableEnd - table) < sizeof(length)) 
+			{
+				SetError("The string table of the binary map is damaged.");
+				return;
+			}
+
+			memcpy(&length, table, sizeof(length));
+			table += sizeof(length);
+
+			if ((size_t)(tableEnd - table) < length) 
+			{
+				SetError("The string table of the binary map is damaged.");
+				return;
+			}
+
+			strings.push_back(std::string(table, length));
+			table += length;
+		}
+	}
+
+	int BinaryReader::ReadInt() 
+	{
+		int value = 0;
+		const char *p = Take(sizeof(value));
+		if (p) 
+		{
+			memcpy(&value, p, sizeof(value));
+		}
+		return value;
+	}
+
+	float BinaryReader::ReadFloat() 
+	{
+		float value = 0.0f;
+		const char *p = Take(sizeof(value));
+		if (p) 
+		{
+			memcpy(&value, p, sizeof(value));
+		}
+		return value;
+	}
+
+	double BinaryReader::ReadDouble() 
+	{
+		double value = 0.0;
+		const char *p = Take(sizeof(value));
+		if (p) 
+		{
+			memcpy(&value, p, sizeof(value));
+		}
+		return value;
+	}
+
+	const std::string &BinaryReader::ReadString() 
+	{
+		static const std::string empty;
+
+		const int index = ReadInt();
+		if (HasError()) 
+		{
+			return empty;
+		}
+
+		if (index < 0 || (size_t)index >= strings.size()) 
+		{
+			SetError("A string of the binary map is not in its string table.");
+			return empty;
+		}
+
+		return strings[index];
+	}
+
+	const void *BinaryReader::ReadBytes(size_t size) 
+	{
+		// The padding is taken with the bytes, sizes past the end fail before they are padded.
+		return Take(size <= (size_t)(end - data) ? Pad(size) : size);
+	}
+
+	int BinaryReader::ReadCount(size_t itemSize) 
+	{
+		const int count = ReadInt();
+		if (count < 0 || (itemSize > 0 && (size_t)count > (size_t)(end - data) / itemSize)) 
+		{
+			SetError("A count of the binary map is larger than the map.");
+			return 0;
+		}
+		return count;
+	}
+
+	const char *BinaryReader::Take(size_t size) 
+	{
+		if (HasError() || (size_t)(end - data) < size) 
+		{
+			SetError("The binary map ends early.");
+			return NULL;
+		}
+
+		const char *p = data;
+		data += size;
+		return p;
+	}
+
+	void BinaryReader::SetError(const char *text) 
+	{
+		// Keep the first error, later ones follow from it.
+		if (error_text.empty()) 
+		{
+			error_text = text;
+		}
+	}
+};
@@ -0,0 +1,120 @@
+//-----------------------------------------------------------------------------
+// TmxBinary.h
+//
+// Copyright (c) 2010-2012, Tamir Atias
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL TAMIR ATIAS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Tamir Atias
+#pragma once
+
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Tmx 
+{
+	//-------------------------------------------------------------------------
+	// Version of the binary map format, maps written by an other version
+	// are refused rather than read.
+	//-------------------------------------------------------------------------
+	enum { TMX_BINARY_VERSION = 1 };
+
+	//-------------------------------------------------------------------------
+	// Writes a map in the binary format read by BinaryReader.
+	// Values are 32 bits in the byte order of the machine writing them and
+	// every string is stored once, in a table in front of the values.
+	//-------------------------------------------------------------------------
+	class BinaryWriter 
+	{
+	public:
+		BinaryWriter();
+
+		void WriteInt(int value);
+		void WriteFloat(float value);
+		void WriteDouble(double value);
+
+		// Write the index of a string in the string table.
+		void WriteString(const std::string &value);
+
+		// Write raw bytes, padded so the next value stays aligned.
+		void WriteBytes(const void *data, size_t size);
+
+		// Get the header, the string table and the values.
+		void Finish(std::string *out) const;
+
+	private:
+		std::string body;
+
+		std::vector< const std::string* > strings;
+		std::map< std::string, int > string_ids;
+	};
+
+	//-------------------------------------------------------------------------
+	// Reads the values written by a BinaryWriter back, in the same order.
+	// Raw bytes are read in place, so the data must outlive what they were
+	// read into. Reading past the end or a damaged value sets an error and
+	// gives zeroes from then on.
+	//-------------------------------------------------------------------------
+	class BinaryReader 
+	{
+	private:
+		// Prevent copy constructor.
+		BinaryReader(const BinaryReader &_reader);
+
+	public:
+		BinaryReader(const char *data, size_t size);
+
+		int ReadInt();
+		float ReadFloat();
+		double ReadDouble();
+
+		// Read a string from the string table.
+		const std::string &ReadString();
+
+		// Read raw bytes in place, NULL on error.
+		const void *ReadBytes(size_t size);
+
+		// Read the number of items that follow, each taking at least itemSize bytes.
+		// Counts the rest of the data cannot hold are errors.
+		int ReadCount(size_t itemSize);
+
+		// Set an error found in the values that were read, the first one is kept.
+		void SetError(const char *text);
+
+		// Get whether there was an error or not.
+		bool HasError() const { return !error_text.empty(); }
+
+		// Get an error string containing the error in text format.
+		const std::string &GetErrorText() const { return error_text; }
+
+	private:
+		// Take size bytes off the data, NULL past the end.
+		const char *Take(size_t size);
+
+		const char *data;
+		const char *end;
+
+		std::vector< std::string > strings;
+		std::string error_text;
+	};
+};
@@ -25,9 +25,9 @@
 //
 // Author: Tamir Atias
 //-----------------------------------------------------------------------------
-#include <tinyxml.h>
-
+#include "TmxBinary.h"
 #include "TmxImage.h"
+#include "TmxXmlReader.h"
 
 namespace Tmx 
 {	
@@ -41,20 +41,30 @@ namespace Tmx
 	Image::~Image() 
 	{}
 
-	void Image::Parse(const TiXmlNode *imageNode) 
+	void Image::Parse(XmlReader &reader) 
 	{
-		const TiXmlElement* imageElem = imageNode->ToElement();
-		
 		// Read all the attribute into member variables.
-		source = imageElem->Attribute("source");
+		reader.Attribute("source", &source);
+
+		reader.Attribute("width", &width);
+		reader.Attribute("height", &height);
 
-		imageElem->Attribute("width", &width);
-		imageElem->Attribute("height", &height);
+		reader.Attribute("trans", &transparent_color);
+	}
 
-		const char *trans = imageElem->Attribute("trans");
-		if (trans) 
-		{
-			transparent_color = trans;
-		}
+	void Image::WriteBinary(BinaryWriter &writer) const 
+	{
+		writer.WriteString(source);
+		writer.WriteInt(width);
+		writer.WriteInt(height);
+		writer.WriteString(transparent_color);
+	}
+
+	void Image::ParseBinary(BinaryReader &reader) 
+	{
+		source = reader.ReadString();
+		width = reader.ReadInt();
+		height = reader.ReadInt();
+		transparent_color = reader.ReadString();
 	}
 };
@@ -29,10 +29,12 @@
 
 #include <string>
 
-class TiXmlNode;
-
 namespace Tmx 
 {
+	class BinaryReader;
+	class BinaryWriter;
+	class XmlReader;
+
 	//-------------------------------------------------------------------------
 	// An image within a tileset.
 	//-------------------------------------------------------------------------
@@ -43,7 +45,13 @@ namespace Tmx
 		~Image();
 
 		// Parses an image element.
-		void Parse(const TiXmlNode *imageNode);
+		void Parse(XmlReader &reader);
+
+		// Write the image in the binary format.
+		void WriteBinary(BinaryWriter &writer) const;
+
+		// Read the image back from the binary format.
+		void ParseBinary(BinaryReader &reader);
 
 		// Get the path to the file of the image (relative to the map)
 		const std::string &GetSource() const { return source; }
@@ -25,15 +25,19 @@
 //
 // Author: Tamir Atias
 //-----------------------------------------------------------------------------
-#include <tinyxml.h>
-#include <zlib.h>
+#include <algorithm>
+#include <new>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <vector>
 
+#include "TmxBinary.h"
 #include "TmxLayer.h"
 #include "TmxUtil.h"
 #include "TmxMap.h"
 #include "TmxTileset.h"
+#include "TmxXmlReader.h"
 
 namespace Tmx 
 {
@@ -45,241 +49,319 @@ namespace Tmx
 		, opacity(1.0f)
 		, visible(true)
 		, properties()
+		, cells()
+		, cell_data(NULL)
 		, encoding(TMX_ENCODING_XML)
 		, compression(TMX_COMPRESSION_NONE)
 	{
-		// Set the map to null to specify that it is not yet allocated.
-		tile_map = NULL;
 	}
 
 	Layer::~Layer() 
 	{
-		// If the tile map is allocated, delete it from the memory.
-		if (tile_map)
+	}
+
+	void Layer::Parse(XmlReader &reader) 
+	{
+		const int depth = reader.GetDepth();
+
+		// Read the attributes.
+		reader.Attribute("name", &name);
+
+		reader.Attribute("width", &width);
+		reader.Attribute("height", &height);
+
+		double opacityValue;
+		if (reader.Attribute("opacity", &opacityValue)) 
+		{
+			opacity = (float)opacityValue;
+		}
+
+		int visibleValue;
+		if (reader.Attribute("visible", &visibleValue)) 
 		{
-			delete [] tile_map;
-			tile_map = NULL;
+			visible = visibleValue != 0; // to prevent visual c++ from complaining..
+		}
+
+		// Every layer is read at the size of the map, which was checked.
+		if (width != map->GetWidth() || height != map->GetHeight())
+		{
+			reader.SetError("The size of a layer does not match the map.");
+			width = 0;
+			height = 0;
+			return;
+		}
+
+		// The gids are decoded into the cells, then turned into cells in place.
+		try
+		{
+			cells.assign(width * height, 0);
+		}
+		catch (const std::bad_alloc &)
+		{
+			reader.SetError("A layer is too large to load.");
+			width = 0;
+			height = 0;
+			return;
+		}
+
+		while (reader.NextChild(depth)) 
+		{
+			// Read the properties.
+			if (reader.IsNamed("properties")) 
+			{
+				properties.Parse(reader);
+			}
+			else if (reader.IsNamed("data"))
+			{
+				ParseData(reader);
+			}
 		}
+
+		SetTiles();
+		cell_data = cells.empty() ? NULL : &cells[0];
 	}
 
-	void Layer::Parse(const TiXmlNode *layerNode) 
+	void Layer::WriteBinary(BinaryWriter &writer) const 
 	{
-		const TiXmlElement *layerElem = layerNode->ToElement();
-	
-		// Read the attributes.
-		name = layerElem->Attribute("name");
+		writer.WriteString(name);
+		writer.WriteInt(width);
+		writer.WriteInt(height);
+		writer.WriteFloat(opacity);
+		writer.WriteInt(visible);
+
+		properties.WriteBinary(writer);
+
+		writer.WriteInt(encoding);
+		writer.WriteInt(compression);
 
-		layerElem->Attribute("width", &width);
-		layerElem->Attribute("height", &height);
+		// The cells are written as they are, tileset indices included.
+		writer.WriteBytes(cell_data, (size_t)width * height * sizeof(MapCell));
+	}
+
+	void Layer::ParseBinary(BinaryReader &reader) 
+	{
+		name = reader.ReadString();
 
-		const char *opacityStr = layerElem->Attribute("opacity");
-		if (opacityStr) 
+		// The rest of the data has to hold the cells.
+		width = reader.ReadCount(0);
+		height = reader.ReadCount(width * sizeof(MapCell));
+
+		// Every layer is read at the size of the map.
+		if (width != map->GetWidth() || height != map->GetHeight())
 		{
-			opacity = (float)atof(opacityStr);
+			reader.SetError("The size of a layer of the binary map does not match the map.");
 		}
 
-		const char *visibleStr = layerElem->Attribute("visible");
-		if (visibleStr) 
+		opacity = reader.ReadFloat();
+		visible = reader.ReadInt() != 0;
+
+		properties.ParseBinary(reader);
+
+		encoding = (LayerEncodingType)reader.ReadInt();
+		compression = (LayerCompressionType)reader.ReadInt();
+
+		const size_t size = (size_t)width * height * sizeof(MapCell);
+		const void *data = reader.ReadBytes(size);
+
+		cells.clear();
+		cell_data = NULL;
+
+		if (!data)
 		{
-			visible = atoi(visibleStr) != 0; // to prevent visual c++ from complaining..
+			width = 0;
+			height = 0;
+		}
+		else if ((size_t)data % sizeof(MapCell) == 0)
+		{
+			// Use the cells where they are.
+			cell_data = (const MapCell *)data;
+		}
+		else if (size > 0)
+		{
+			cells.resize(width * height);
+			memcpy(&cells[0], data, size);
+			cell_data = &cells[0];
 		}
 
-		// Read the properties.
-		const TiXmlNode *propertiesNode = layerNode->FirstChild("properties");
-		if (propertiesNode) 
+		// Damaged cells would point past the tilesets.
+		const int tilesetCount = map->GetNumTilesets();
+		for (size_t i = 0; cell_data && i < (size_t)width * height; ++i)
 		{
-			properties.Parse(propertiesNode);
+			if (GetMapCellTilesetIndex(cell_data[i]) >= tilesetCount)
+			{
+				reader.SetError("A tile of the binary map is in a tileset it does not have.");
+				break;
+			}
 		}
+	}
 
-		// Allocate memory for reading the tiles.
-		tile_map = new MapTile[width * height];
+	MapTile Layer::GetTile(int x, int y) const
+	{
+		const MapCell cell = cell_data[y * width + x];
+		const int tilesetIndex = GetMapCellTilesetIndex(cell);
 
-		const TiXmlNode *dataNode = layerNode->FirstChild("data");
-		const TiXmlElement *dataElem = dataNode->ToElement();
+		return MapTile(cell, tilesetIndex != -1 ? map->GetTileset(tilesetIndex) : NULL);
+	}
 
-		const char *encodingStr = dataElem->Attribute("encoding");
-		const char *compressionStr = dataElem->Attribute("compression");
+	void Layer::ParseData(XmlReader &reader) 
+	{
+		std::string encodingStr;
+		std::string compressionStr;
 
 		// Check for encoding.
-		if (encodingStr) 
+		if (reader.Attribute("encoding", &encodingStr)) 
 		{
-			if (!strcmp(encodingStr, "base64")) 
+			if (encodingStr == "base64") 
 			{
 				encoding = TMX_ENCODING_BASE64;
 			} 
-			else if (!strcmp(encodingStr, "csv")) 
+			else if (encodingStr == "csv") 
 			{
 				encoding = TMX_ENCODING_CSV;
 			}
 		}
 
 		// Check for compression.
-		if (compressionStr) 
+		if (reader.Attribute("compression", &compressionStr)) 
 		{
-			if (!strcmp(compressionStr, "gzip")) 
+			if (compressionStr == "gzip") 
 			{
 				compression = TMX_COMPRESSION_GZIP;
 			} 
-			else if (!strcmp(compressionStr, "zlib")) 
+			else if (compressionStr == "zlib") 
 			{
 				compression = TMX_COMPRESSION_ZLIB;
 			}
 		}
-		
+
 		// Decode.
+		const char *text;
+		size_t length;
+
 		switch (encoding) 
 		{
 		case TMX_ENCODING_XML:
-			ParseXML(dataNode);
+			ParseXML(reader);
 			break;
 
 		case TMX_ENCODING_BASE64:
-			ParseBase64(dataElem->GetText());
+			reader.ReadText(&text, &length);
+			ParseBase64(text, length);
 			break;
 
 		case TMX_ENCODING_CSV:
-			ParseCSV(dataElem->GetText());
+			reader.ReadText(&text, &length);
+			ParseCSV(text, length);
 			break;
 		}
-
-		// Set every tile's tileset.
-		for ( int i = 0; i < width * height; i++ )
-		{
-			MapTile& tile = tile_map[i];
-			if (tile.tilesetId != -1)
-				tile.tileset = map->GetTileset(tile.tilesetId);
-		}
 	}
 
-	void Layer::ParseXML(const TiXmlNode *dataNode) 
+	void Layer::ParseXML(XmlReader &reader) 
 	{
-		const TiXmlNode *tileNode = dataNode->FirstChild("tile");
+		const int depth = reader.GetDepth();
 		int tileCount = 0;
+		std::string gidText;
 
-		while (tileNode) 
+		while (reader.NextChild(depth)) 
 		{
-			const TiXmlElement *tileElem = tileNode->ToElement();
-			
-			unsigned gid = 0;
-
-			// Read the Global-ID of the tile.
-			const char* gidText = tileElem->Attribute("gid");
-
-			// Convert to an unsigned.
-			sscanf(gidText, "%u", &gid);
-
-			// Find the tileset index.
-			const int tilesetIndex = map->FindTilesetIndex(gid);
-			if (tilesetIndex != -1)
+			if (!reader.IsNamed("tile") || tileCount >= width * height)
 			{
-				// If valid, set up the map tile with the tileset.
-				const Tmx::Tileset* tileset = map->GetTileset(tilesetIndex);
-				tile_map[tileCount] = MapTile(gid, tileset->GetFirstGid(), tilesetIndex);
+				continue;
 			}
-			else
+
+			// Read the Global-ID of the tile.
+			if (reader.Attribute("gid", &gidText))
 			{
-				// Otherwise, make it null.
-				tile_map[tileCount] = MapTile(gid, 0, -1);
+				cells[tileCount] = (unsigned)strtoul(gidText.c_str(), NULL, 10);
 			}
 
-			tileNode = dataNode->IterateChildren("tile", tileNode);
 			tileCount++;
 		}
 	}
 
-	void Layer::ParseBase64(const std::string &innerText) 
+	void Layer::ParseBase64(const char *innerText, size_t length) 
 	{
-		const std::string &text = Util::DecodeBase64(innerText);
+		if (!innerText || cells.empty())
+		{
+			return;
+		}
 
-		// Temporary array of gids to be converted to map tiles.
-		unsigned *out = 0;
+		// The data is an array of little-endian 32-bit gids, decoded straight into place.
+		const size_t size = cells.size() * sizeof(MapCell);
 
-		if (compression == TMX_COMPRESSION_ZLIB) 
+		if (compression == TMX_COMPRESSION_NONE) 
 		{
-			// Use zlib to uncompress the layer into the temporary array of tiles.
-			uLongf outlen = width * height * 4;
-			out = (unsigned *)malloc(outlen);
-			uncompress(
-				(Bytef*)out, &outlen, 
-				(const Bytef*)text.c_str(), text.size());
-	
-		} 
-		else if (compression == TMX_COMPRESSION_GZIP) 
+			Util::DecodeBase64(innerText, length, &cells[0], size);
+		}
+		else
 		{
-			// Use the utility class for decompressing (which uses zlib)
-			out = (unsigned *)Util::DecompressGZIP(
-				text.c_str(), 
-				text.size(), 
-				width * height * 4);
-		} 
-		else 
+			// Decode the compressed stream, then inflate it into the cells in one go.
+			std::vector< char > compressed(length / 4 * 3 + 3);
+			const size_t compressedSize = Util::DecodeBase64(innerText, length, &compressed[0], compressed.size());
+
+			if (!Util::Inflate(&compressed[0], compressedSize, &cells[0], size))
+			{
+				std::fill(cells.begin(), cells.end(), 0);
+			}
+		}
+
+		// Assemble each gid from its bytes, so big-endian machines read them right too.
+		// Where the bytes are already in order this compiles down to a copy.
+		for (size_t i = 0; i < cells.size(); ++i)
 		{
-			out = (unsigned *)malloc(text.size());
-		
-			// Copy every gid into the temporary array since
-			// the decoded string is an array of 32-bit integers.
-			memcpy(out, text.c_str(), text.size());
+			const unsigned char *bytes = (const unsigned char *)&cells[i];
+			cells[i] = (MapCell)bytes[0] | ((MapCell)bytes[1] << 8) | ((MapCell)bytes[2] << 16) | ((MapCell)bytes[3] << 24);
 		}
+	}
 
-		// Convert the gids to map tiles.
-		for (int x = 0; x < width; x++)
+	void Layer::ParseCSV(const char *innerText, size_t length) 
+	{
+		const char *p = innerText;
+		const char *end = innerText + length;
+		int tileCount = 0;
+
+		// Read every run of digits as a gid, whatever separates them.
+		while (p && tileCount < width * height)
 		{
-			for (int y = 0; y < height; y++)
+			while (p < end && (*p < '0' || *p > '9'))
 			{
-				unsigned gid = out[y * width + x];
-
-				// Find the tileset index.
-				const int tilesetIndex = map->FindTilesetIndex(gid);
-				if (tilesetIndex != -1)
-				{
-					// If valid, set up the map tile with the tileset.
-					const Tmx::Tileset* tileset = map->GetTileset(tilesetIndex);
-					tile_map[y * width + x] = MapTile(gid, tileset->GetFirstGid(), tilesetIndex);
-				}
-				else
-				{
-					// Otherwise, make it null.
-					tile_map[y * width + x] = MapTile(gid, 0, -1);
-				}
+				p++;
+			}
+
+			if (p == end)
+			{
+				break;
+			}
+
+			unsigned gid = 0;
+			while (p < end && *p >= '0' && *p <= '9')
+			{
+				gid = gid * 10 + (unsigned)(*p++ - '0');
 			}
-		}
 
-		// Free the temporary array from memory.
-		free(out);
+			cells[tileCount++] = gid;
+		}
 	}
 
-	void Layer::ParseCSV(const std::string &innerText) 
+	void Layer::SetTiles()
 	{
-		// Duplicate the string for use with C stdio.
-		char *csv = strdup(innerText.c_str());
-		
-		// Iterate through every token of ';' in the CSV string.
-		char *pch = strtok(csv, ",");
-		int tileCount = 0;
-		
-		while (pch) 
+		for (size_t i = 0; i < cells.size(); i++)
 		{
-			unsigned gid;
-			sscanf(pch, "%u", &gid);
+			const unsigned gid = cells[i];
 
 			// Find the tileset index.
 			const int tilesetIndex = map->FindTilesetIndex(gid);
 			if (tilesetIndex != -1)
 			{
-				// If valid, set up the map tile with the tileset.
+				// If valid, pack the id within the tileset.
 				const Tmx::Tileset* tileset = map->GetTileset(tilesetIndex);
-				tile_map[tileCount] = MapTile(gid, tileset->GetFirstGid(), tilesetIndex);
+				cells[i] = MakeMapCell(gid, tilesetIndex, (gid & ~FlippedFlags) - tileset->GetFirstGid());
 			}
 			else
 			{
 				// Otherwise, make it null.
-				tile_map[tileCount] = MapTile(gid, 0, -1);
+				cells[i] = MakeMapCell(gid, -1, 0);
 			}
-
-			pch = strtok(NULL, ",");
-			tileCount++;
 		}
-
-		free(csv);
 	}
 };
@@ -28,14 +28,16 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "TmxPropertySet.h"
 #include "TmxMapTile.h"
 
-class TiXmlNode;
-
 namespace Tmx 
 {
+	class BinaryReader;
+	class BinaryWriter;
+	class XmlReader;
 	class Map;
 
 	//-------------------------------------------------------------------------
@@ -73,7 +75,14 @@ namespace Tmx
 		~Layer();
 
 		// Parse a layer node.
-		void Parse(const TiXmlNode *layerNode);
+		void Parse(XmlReader &reader);
+
+		// Write the layer in the binary format.
+		void WriteBinary(BinaryWriter &writer) const;
+
+		// Read the layer back from the binary format.
+		// The cells are read in place when they are aligned.
+		void ParseBinary(BinaryReader &reader);
 
 		// Get the name of the layer.
 		const std::string &GetName() const { return name; }
@@ -91,25 +100,31 @@ namespace Tmx
 		const Tmx::PropertySet &GetProperties() const { return properties; }
 
 		// Pick a specific tile from the list.
-		unsigned GetTileId(int x, int y) const { return tile_map[y * width + x].id; }
+		unsigned GetTileId(int x, int y) const { return GetMapCellId(cell_data[y * width + x]); }
 
 		// Get the tileset index for a tileset from the list.
-		int GetTileTilesetIndex(int x, int y) const { return tile_map[y * width + x].tilesetId; }
+		int GetTileTilesetIndex(int x, int y) const { return GetMapCellTilesetIndex(cell_data[y * width + x]); }
 
 		// Get whether a tile is flipped horizontally.
 		bool IsTileFlippedHorizontally(int x, int y) const 
-		{ return tile_map[y * width + x].flippedHorizontally; }
+		{ return (cell_data[y * width + x] & FlippedHorizontallyFlag) != 0; }
 
 		// Get whether a tile is flipped vertically.
 		bool IsTileFlippedVertically(int x, int y) const 
-		{ return tile_map[y * width + x].flippedVertically; }
+		{ return (cell_data[y * width + x] & FlippedVerticallyFlag) != 0; }
 
 		// Get whether a tile is flipped diagonally.
 		bool IsTileFlippedDiagonally(int x, int y) const
-		{ return tile_map[y * width + x].flippedDiagonally; }
+		{ return (cell_data[y * width + x] & FlippedDiagonallyFlag) != 0; }
+
+		// Get a tile specific to the map, unpacked with its tileset.
+		Tmx::MapTile GetTile(int x, int y) const;
 
-		// Get a tile specific to the map.
-		const Tmx::MapTile& GetTile(int x, int y) const { return tile_map[y * width + x]; }
+		// Get the packed cell of a tile.
+		Tmx::MapCell GetTileRaw(int x, int y) const { return cell_data[y * width + x]; }
+
+		// Get the width packed cells of a row.
+		const Tmx::MapCell *GetRow(int y) const { return &cell_data[y * width]; }
 
 		// Get the type of encoding that was used for parsing the layer data.
 		// See: LayerEncodingType
@@ -120,9 +135,13 @@ namespace Tmx
 		Tmx::LayerCompressionType GetCompression() const { return compression; }
 
 	private:
-		void ParseXML(const TiXmlNode *dataNode);
-		void ParseBase64(const std::string &innerText);
-		void ParseCSV(const std::string &innerText);
+		void ParseData(XmlReader &reader);
+		void ParseXML(XmlReader &reader);
+		void ParseBase64(const char *innerText, size_t length);
+		void ParseCSV(const char *innerText, size_t length);
+
+		// Turn the gids the data was decoded to into cells, in place.
+		void SetTiles();
 
 		const Tmx::Map *map;
 
@@ -136,7 +155,10 @@ namespace Tmx
 
 		Tmx::PropertySet properties;
 
-		Tmx::MapTile *tile_map;
+		std::vector< Tmx::MapCell > cells;
+
+		// The cells, either in the vector or read in place.
+		const Tmx::MapCell *cell_data;
 
 		Tmx::LayerEncodingType encoding;
 		Tmx::LayerCompressionType compression;
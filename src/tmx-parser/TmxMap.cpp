@@ -25,13 +25,18 @@
 //
 // Author: Tamir Atias
 //-----------------------------------------------------------------------------
-#include <tinyxml.h>
+#include <algorithm>
+#include <limits.h>
 #include <stdio.h>
+#include <utility>
 
+#include "TmxBinary.h"
 #include "TmxMap.h"
 #include "TmxTileset.h"
 #include "TmxLayer.h"
 #include "TmxObjectGroup.h"
+#include "TmxUtil.h"
+#include "TmxXmlReader.h"
 
 using std::vector;
 using std::string;
@@ -50,6 +55,8 @@ namespace Tmx
 		, layers()
 		, object_groups()
 		, tilesets() 
+		, first_gids()
+		, first_gid_tilesets()
 		, has_error(false)
 		, error_code(0)
 		, error_text()
@@ -113,14 +120,11 @@ namespace Tmx
 			file_path = "";
 		}
 
-		char* fileText;
-		int fileSize;
-
-		// Open the file for reading.
-		FILE *file = fopen(fileName.c_str(), "rb");
+		// Map the file into memory, it is read in place.
+		MappedFile file;
 
 		// Check if the file could not be opened.
-		if (!file) 
+		if (!file.Open(fileName)) 
 		{
 			has_error = true;
 			error_code = TMX_COULDNT_OPEN;
@@ -128,13 +132,8 @@ namespace Tmx
 			return;
 		}
 		
-		// Find out the file size.
-		fseek(file, 0, SEEK_END);
-		fileSize = ftell(file);
-		fseek(file, 0, SEEK_SET);
-		
 		// Check if the file size is valid.
-		if (fileSize <= 0)
+		if (file.GetSize() == 0)
 		{
 			has_error = true;
 			error_code = TMX_INVALID_FILE_SIZE;
@@ -142,46 +141,138 @@ namespace Tmx
 			return;
 		}
 
-		// Allocate memory for the file and read it into the memory.
-		fileText = new char[fileSize];
-		fread(fileText, 1, fileSize, file);
+		XmlReader reader(file.GetData(), file.GetSize());
+		Parse(reader);
+	}
+
+	void Map::ParseText(const string &text) 
+	{
+		XmlReader reader(text.data(), text.size());
+		Parse(reader);
+	}
+
+	void Map::ParseBinary(const char *data, size_t size) 
+	{
+		BinaryReader reader(data, size);
+
+		file_name = reader.ReadString();
+		file_path = reader.ReadString();
+
+		version = reader.ReadDouble();
+		orientation = (MapOrientation)reader.ReadInt();
+
+		width = reader.ReadInt();
+		height = reader.ReadInt();
+		tile_width = reader.ReadInt();
+		tile_height = reader.ReadInt();
 
-		fclose(file);
+		properties.ParseBinary(reader);
 
-		// Copy the contents into a C++ string and delete it from memory.
-		std::string text(fileText, fileText+fileSize);
-		delete [] fileText;
+		// Each count is followed by that many items of at least as many values.
+		const int tilesetCount = reader.ReadCount(40);
+		for (int i = 0; i < tilesetCount; ++i) 
+		{
+			Tileset *tileset = new Tileset();
+			tileset->ParseBinary(reader);
+			tilesets.push_back(tileset);
+		}
+
+		// The cells were written with their tileset indices, which this only serves to look up again.
+		IndexTilesets();
+
+		const int layerCount = reader.ReadCount(32);
+		for (int i = 0; i < layerCount; ++i) 
+		{
+			Layer *layer = new Layer(this);
+			layer->ParseBinary(reader);
+			layers.push_back(layer);
+		}
 
-		ParseText(text);		
+		const int objectGroupCount = reader.ReadCount(20);
+		for (int i = 0; i < objectGroupCount; ++i) 
+		{
+			ObjectGroup *objectGroup = new ObjectGroup();
+			objectGroup->ParseBinary(reader);
+			object_groups.push_back(objectGroup);
+		}
+
+		// Check for reading errors.
+		if (reader.HasError()) 
+		{
+			has_error = true;
+			error_code = TMX_PARSING_ERROR;
+			error_text = reader.GetErrorText();
+		}
 	}
 
-	void Map::ParseText(const string &text) 
+	void Map::WriteBinary(string *out) const 
 	{
-		// Create a tiny xml document and use it to parse the text.
-		TiXmlDocument doc;
-		doc.Parse(text.c_str());
-	
-		// Check for parsing errors.
-		if (doc.Error()) 
+		BinaryWriter writer;
+
+		writer.WriteString(file_name);
+		writer.WriteString(file_path);
+
+		writer.WriteDouble(version);
+		writer.WriteInt(orientation);
+
+		writer.WriteInt(width);
+		writer.WriteInt(height);
+		writer.WriteInt(tile_width);
+		writer.WriteInt(tile_height);
+
+		properties.WriteBinary(writer);
+
+		writer.WriteInt(tilesets.size());
+		for (size_t i = 0; i < tilesets.size(); ++i) 
+		{
+			tilesets[i]->WriteBinary(writer);
+		}
+
+		writer.WriteInt(layers.size());
+		for (size_t i = 0; i < layers.size(); ++i) 
+		{
+			layers[i]->WriteBinary(writer);
+		}
+
+		writer.WriteInt(object_groups.size());
+		for (size_t i = 0; i < object_groups.size(); ++i) 
+		{
+			object_groups[i]->WriteBinary(writer);
+		}
+
+		writer.Finish(out);
+	}
+
+	void Map::Parse(XmlReader &reader) 
+	{
+		// Find the root element.
+		XmlReader::NodeType node;
+		do
+		{
+			node = reader.Next();
+		}
+		while (node == XmlReader::XML_TEXT);
+
+		if (node != XmlReader::XML_START || !reader.IsNamed("map")) 
 		{
 			has_error = true;
 			error_code = TMX_PARSING_ERROR;
-			error_text = doc.ErrorDesc();
+			error_text = reader.HasError() ? reader.GetErrorText() : "There is no map element.";
 			return;
 		}
 
-		TiXmlNode *mapNode = doc.FirstChild("map");
-		TiXmlElement* mapElem = mapNode->ToElement();
+		const int depth = reader.GetDepth();
 
 		// Read the map attributes.
-		mapElem->Attribute("version", &version);
-		mapElem->Attribute("width", &width);
-		mapElem->Attribute("height", &height);
-		mapElem->Attribute("tilewidth", &tile_width);
-		mapElem->Attribute("tileheight", &tile_height);
+		reader.Attribute("version", &version);
+		reader.Attribute("width", &width);
+		reader.Attribute("height", &height);
+		reader.Attribute("tilewidth", &tile_width);
+		reader.Attribute("tileheight", &tile_height);
 
 		// Read the orientation
-		std::string orientationStr = mapElem->Attribute("orientation");
+		std::string orientationStr;
+		reader.Attribute("orientation", &orientationStr);
 
 		if (!orientationStr.compare("orthogonal")) 
 		{
@@ -192,84 +283,109 @@ namespace Tmx
 			orientation = TMX_MO_ISOMETRIC;
 		}
 
-		// Read the map properties.
-		const TiXmlNode *propertiesNode = mapElem->FirstChild("properties");
-		if (propertiesNode) 
+		// The layers are allocated at the size of the map, so it has to be sane.
+		if (width <= 0 || height <= 0 || width > INT_MAX / height)
 		{
-			properties.Parse(propertiesNode);
+			reader.SetError("The size of the map is invalid.");
 		}
 
-		// Iterate through all of the tileset elements.
-		const TiXmlNode *tilesetNode = mapNode->FirstChild("tileset");
-		while (tilesetNode) 
+		// Read the children in the order of the file. 
+		// Tiled writes the tilesets before the layers that use them.
+		while (reader.NextChild(depth)) 
 		{
-			// Allocate a new tileset and parse it.
-			Tileset *tileset = new Tileset();
-			tileset->Parse(tilesetNode->ToElement());
-
-			// Add the tileset to the list.
-			tilesets.push_back(tileset);
-
-			tilesetNode = mapNode->IterateChildren("tileset", tilesetNode);
-		}
+			// Read the map properties.
+			if (reader.IsNamed("properties")) 
+			{
+				properties.Parse(reader);
+			}
+			else if (reader.IsNamed("tileset")) 
+			{
+				// Allocate a new tileset and parse it.
+				Tileset *tileset = new Tileset();
+				tileset->Parse(reader);
 
-		// Iterate through all of the layer elements.
-		TiXmlNode *layerNode = mapNode->FirstChild("layer");
-		while (layerNode) 
-		{
-			// Allocate a new layer and parse it.
-			Layer *layer = new Layer(this);
-			layer->Parse(layerNode);
+				// Add the tileset to the list.
+				tilesets.push_back(tileset);
 
-			// Add the layer to the list.
-			layers.push_back(layer);
+				// The layers look up the tileset of every tile.
+				IndexTilesets();
+			}
+			else if (reader.IsNamed("layer")) 
+			{
+				// Allocate a new layer and parse it.
+				Layer *layer = new Layer(this);
+				layer->Parse(reader);
 
-			layerNode = mapNode->IterateChildren("layer", layerNode);
+				// Add the layer to the list.
+				layers.push_back(layer);
+			}
+			else if (reader.IsNamed("objectgroup")) 
+			{
+				// Allocate a new object group and parse it.
+				ObjectGroup *objectGroup = new ObjectGroup();
+				objectGroup->Parse(reader);
+			
+				// Add the object group to the list.
+				object_groups.push_back(objectGroup);
+			}
 		}
 
-		// Iterate through all of the objectgroup elements.
-		TiXmlNode *objectGroupNode = mapNode->FirstChild("objectgroup");
-		while (objectGroupNode) 
+		// Check for parsing errors.
+		if (reader.HasError()) 
 		{
-			// Allocate a new object group and parse it.
-			ObjectGroup *objectGroup = new ObjectGroup();
-			objectGroup->Parse(objectGroupNode);
-		
-			// Add the object group to the list.
-			object_groups.push_back(objectGroup);
-
-			objectGroupNode = mapNode->IterateChildren("objectgroup", objectGroupNode);
+			has_error = true;
+			error_code = TMX_PARSING_ERROR;
+			error_text = reader.GetErrorText();
 		}
 	}
 
 	int Map::FindTilesetIndex(int gid) const
 	{
 		// Clean up the flags from the gid (thanks marwes91).
-		gid &= ~(FlippedHorizontallyFlag | FlippedVerticallyFlag | FlippedDiagonallyFlag);
+		const unsigned id = (unsigned)gid & ~(FlippedHorizontallyFlag | FlippedVerticallyFlag | FlippedDiagonallyFlag);
 
-		for (int i = tilesets.size() - 1; i > -1; --i) 
+		if (first_gids.empty())
 		{
-			// If the gid beyond the tileset gid return its index.
-			if (gid >= tilesets[i]->GetFirstGid()) 
-			{
-				return i;
-			}
+			return -1;
 		}
-		
-		return -1;
+
+		// Narrow down to the last first gid not above the id, 
+		// with a conditional move rather than a branch per step.
+		const unsigned *base = &first_gids[0];
+		size_t count = first_gids.size();
+
+		while (count > 1)
+		{
+			const size_t half = count / 2;
+			base = (base[half] <= id) ? base + half : base;
+			count -= half;
+		}
+
+		return *base <= id ? first_gid_tilesets[base - &first_gids[0]] : -1;
 	}
 
 	const Tileset *Map::FindTileset(int gid) const 
 	{
-		for (int i = tilesets.size() - 1; i > -1; --i) 
+		const int index = FindTilesetIndex(gid);
+		return index != -1 ? tilesets[index] : NULL;
+	}
+
+	void Map::IndexTilesets()
+	{
+		// Later tilesets win over earlier ones with the same first gid, as they did.
+		std::vector< std::pair< unsigned, int > > order;
+		for (int i = 0; i < (int)tilesets.size(); ++i)
 		{
-			// If the gid beyond the tileset gid return it.
-			if (gid >= tilesets[i]->GetFirstGid()) 
-			{
-				return tilesets[i];
-			}
+			order.push_back(std::make_pair((unsigned)tilesets[i]->GetFirstGid(), i));
+		}
+		std::sort(order.begin(), order.end());
+
+		first_gids.clear();
+		first_gid_tilesets.clear();
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			first_gids.push_back(order[i].first);
+			first_gid_tilesets.push_back(order[i].second);
 		}
-		
-		return NULL;
 	}
 };
@@ -27,6 +27,7 @@
 //-----------------------------------------------------------------------------
 #pragma once
 
+#include <stddef.h>
 #include <vector>
 #include <string>
 
@@ -37,6 +38,7 @@ namespace Tmx
 	class Layer;
 	class ObjectGroup;
 	class Tileset;
+	class XmlReader;
 
 	//-------------------------------------------------------------------------
 	// Error in handling of the Map class.
@@ -47,7 +49,7 @@ namespace Tmx
 		TMX_COULDNT_OPEN = 0x01,
 
 		// There was an error in parsing the TMX file.
-		// This is being caused by TinyXML parsing problems.
+		// This is being caused by malformed XML or a missing map element.
 		TMX_PARSING_ERROR = 0x02,
 		
 		// The size of the file is invalid.
@@ -81,13 +83,20 @@ namespace Tmx
 		Map();
 		~Map();
 
-		// Read a file and parse it.
+		// Map a file into memory and parse it in place.
 		// Note: use '/' instead of '\\' as it is using '/' to find the path.
 		void ParseFile(const std::string &fileName);
 		
 		// Parse text containing TMX formatted XML.
 		void ParseText(const std::string &text);
 
+		// Read a map written by WriteBinary.
+		// The data is read in place and must stay valid as long as the map.
+		void ParseBinary(const char *data, size_t size);
+
+		// Write the map in the binary format.
+		void WriteBinary(std::string *out) const;
+
 		// Get the filename used to read the map.
 		const std::string &GetFilename() { return file_name; }
 
@@ -131,6 +140,7 @@ namespace Tmx
 		const std::vector< Tmx::ObjectGroup* > &GetObjectGroups() const { return object_groups; }
 
 		// Find the tileset index for a tileset using a tile gid.
+		// A binary search over the first gids of the tilesets.
 		int FindTilesetIndex(int gid) const;
 
 		// Find a tileset for a specific gid.
@@ -158,6 +168,13 @@ namespace Tmx
 		const Tmx::PropertySet &GetProperties() { return properties; }
 
 	private:
+		// Read the map element and everything in it, 
+		// decoding each layer as soon as it is read.
+		void Parse(XmlReader &reader);
+
+		// Sort the first gids of the tilesets for FindTilesetIndex.
+		void IndexTilesets();
+
 		std::string file_name;
 		std::string file_path;
 
@@ -173,6 +190,10 @@ namespace Tmx
 		std::vector< Tmx::ObjectGroup* > object_groups;
 		std::vector< Tmx::Tileset* > tilesets;
 
+		// First gids of the tilesets in ascending order, and the index of each tileset.
+		std::vector< unsigned > first_gids;
+		std::vector< int > first_gid_tilesets;
+
 		bool has_error;
 		unsigned char error_code;
 		std::string error_text;
@@ -37,9 +37,44 @@ namespace Tmx
 	const unsigned FlippedHorizontallyFlag = 0x80000000;
 	const unsigned FlippedVerticallyFlag   = 0x40000000;
 	const unsigned FlippedDiagonallyFlag   = 0x20000000;
+	const unsigned FlippedFlags = FlippedHorizontallyFlag | FlippedVerticallyFlag | FlippedDiagonallyFlag;
+
+	//-------------------------------------------------------------------------
+	// A tile of a layer packed into 32 bits: the flip flags in the top three
+	// bits, like a gid, then 8 bits of tileset index and 21 bits of id within
+	// the tileset. Tiles of no tileset have the index MapCellNoTileset.
+	//-------------------------------------------------------------------------
+	typedef unsigned MapCell;
+
+	const unsigned MapCellIdBits = 21;
+	const unsigned MapCellIdMask = (1U << MapCellIdBits) - 1;
+	const unsigned MapCellNoTileset = 0xFF;
+	const MapCell MapCellEmpty = MapCellNoTileset << MapCellIdBits;
+
+	// Pack a tile, which has no tileset when the index or id do not fit.
+	inline MapCell MakeMapCell(unsigned flags, int tilesetIndex, unsigned id)
+	{
+		if (tilesetIndex < 0 || tilesetIndex >= (int)MapCellNoTileset || id > MapCellIdMask)
+		{
+			return (flags & FlippedFlags) | MapCellEmpty;
+		}
+
+		return (flags & FlippedFlags) | ((unsigned)tilesetIndex << MapCellIdBits) | id;
+	}
+
+	// Get the tileset index of a cell, -1 for none.
+	inline int GetMapCellTilesetIndex(MapCell cell)
+	{
+		const unsigned index = (cell >> MapCellIdBits) & 0xFF;
+		return index == MapCellNoTileset ? -1 : (int)index;
+	}
+
+	// Get the id within the tileset of a cell.
+	inline unsigned GetMapCellId(MapCell cell) { return cell & MapCellIdMask; }
 
 	//-------------------------------------------------------------------------
 	// Struct to store information about a specific tile in the map layer.
+	// Layers store MapCells, this is what they unpack them to.
 	//-------------------------------------------------------------------------
 	struct MapTile 
 	{
@@ -66,6 +101,16 @@ namespace Tmx
 			id -= _tilesetFirstGid;
 		}
 
+		// Unpack a cell of a layer.
+		MapTile(MapCell cell, const Tileset *_tileset)
+			: tilesetId(GetMapCellTilesetIndex(cell))
+			, tileset(_tileset)
+			, id(GetMapCellId(cell))
+			, flippedHorizontally((cell & FlippedHorizontallyFlag) != 0)
+			, flippedVertically((cell & FlippedVerticallyFlag) != 0)
+			, flippedDiagonally((cell & FlippedDiagonallyFlag) != 0)
+		{}
+
 		// Tileset id.
 		int tilesetId;
 
@@ -25,11 +25,11 @@
 //
 // Author: Tamir Atias
 //-----------------------------------------------------------------------------
-#include <tinyxml.h>
-
+#include "TmxBinary.h"
 #include "TmxObject.h"
 #include "TmxPolygon.h"
 #include "TmxPolyline.h"
+#include "TmxXmlReader.h"
 
 namespace Tmx 
 {
@@ -43,6 +43,7 @@ namespace Tmx
 		, gid(0)
 		, polygon(0)
 		, polyline(0)
+		, ellipse(false)
 		, properties() 
 	{}
 
@@ -60,48 +61,105 @@ namespace Tmx
 		}
 	}
 
-	void Object::Parse(const TiXmlNode *objectNode) 
+	void Object::Parse(XmlReader &reader) 
 	{
-		const TiXmlElement *objectElem = objectNode->ToElement();
+		const int depth = reader.GetDepth();
 
 		// Read the attributes of the object.
-		const char *tempName = objectElem->Attribute("name");
-		const char *tempType = objectElem->Attribute("type");
-		
-		if (tempName) name = tempName;
-		if (tempType) type = tempType;
+		reader.Attribute("name", &name);
+		reader.Attribute("type", &type);
 		
-		objectElem->Attribute("x", &x);
-		objectElem->Attribute("y", &y);
-		objectElem->Attribute("width", &width);
-		objectElem->Attribute("height", &height);
-		objectElem->Attribute("gid", &gid);
-
-		// Read the Polygon and Polyline of the object if there are any.
-		const TiXmlNode *polygonNode = objectNode->FirstChild("polygon");
-		if (polygonNode)
+		reader.Attribute("x", &x);
+		reader.Attribute("y", &y);
+		reader.Attribute("width", &width);
+		reader.Attribute("height", &height);
+		reader.Attribute("gid", &gid);
+
+		ellipse = false;
+
+		while (reader.NextChild(depth)) 
 		{
-			if (polygon != 0)
-				delete polygon;
+			// Read the Polygon and Polyline of the object if there are any.
+			if (reader.IsNamed("polygon"))
+			{
+				if (polygon != 0)
+					delete polygon;
 
-			polygon = new Polygon();
-			polygon->Parse(polygonNode);
+				polygon = new Polygon();
+				polygon->Parse(reader);
+			}
+			else if (reader.IsNamed("polyline"))
+			{
+				if (polyline != 0)
+					delete polyline;
+
+				polyline = new Polyline();
+				polyline->Parse(reader);
+			}
+			// An ellipse has no data of its own, it fills the bounds.
+			else if (reader.IsNamed("ellipse"))
+			{
+				ellipse = true;
+			}
+			// Read the properties of the object.
+			else if (reader.IsNamed("properties"))
+			{
+				properties.Parse(reader);
+			}
 		}
-		const TiXmlNode *polylineNode = objectNode->FirstChild("polyline");
-		if (polylineNode)
-		{
-			if (polyline != 0)
-				delete polyline;
+	}
 
-			polyline = new Polyline();
-			polyline->Parse(polylineNode);
+	void Object::WriteBinary(BinaryWriter &writer) const 
+	{
+		writer.WriteString(name);
+		writer.WriteString(type);
+
+		writer.WriteInt(x);
+		writer.WriteInt(y);
+		writer.WriteInt(width);
+		writer.WriteInt(height);
+		writer.WriteInt(gid);
+
+		writer.WriteInt(polygon != 0);
+		if (polygon != 0)
+			polygon->WriteBinary(writer);
+
+		writer.WriteInt(polyline != 0);
+		if (polyline != 0)
+			polyline->WriteBinary(writer);
+
+		writer.WriteInt(ellipse);
+
+		properties.WriteBinary(writer);
+	}
+
+	void Object::ParseBinary(BinaryReader &reader) 
+	{
+		name = reader.ReadString();
+		type = reader.ReadString();
+
+		x = reader.ReadInt();
+		y = reader.ReadInt();
+		width = reader.ReadInt();
+		height = reader.ReadInt();
+		gid = reader.ReadInt();
+
+		if (reader.ReadInt())
+		{
+			delete polygon;
+			polygon = new Polygon();
+			polygon->ParseBinary(reader);
 		}
 
-		// Read the properties of the object.
-		const TiXmlNode *propertiesNode = objectNode->FirstChild("properties");
-		if (propertiesNode) 
+		if (reader.ReadInt())
 		{
-			properties.Parse(propertiesNode);
+			delete polyline;
+			polyline = new Polyline();
+			polyline->ParseBinary(reader);
 		}
+
+		ellipse = reader.ReadInt() != 0;
+
+		properties.ParseBinary(reader);
 	}
 };
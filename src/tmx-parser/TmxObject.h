@@ -31,10 +31,11 @@
 
 #include "TmxPropertySet.h"
 
-class TiXmlNode;
-
 namespace Tmx 
 {
+	class BinaryReader;
+	class BinaryWriter;
+	class XmlReader;
 	class Polygon;
 	class Polyline;
 
@@ -48,7 +49,13 @@ namespace Tmx
 		~Object();
 
 		// Parse an object node.
-		void Parse(const TiXmlNode *objectNode);
+		void Parse(XmlReader &reader);
+
+		// Write the object in the binary format.
+		void WriteBinary(BinaryWriter &writer) const;
+
+		// Read the object back from the binary format.
+		void ParseBinary(BinaryReader &reader);
 	
 		// Get the name of the object.
 		const std::string &GetName() const { return name; }
@@ -77,6 +84,9 @@ namespace Tmx
 		// Get the Polyline.
 		const Tmx::Polyline *GetPolyline() const { return polyline; }
 
+		// Returns true if the object is an ellipse filling its bounds.
+		bool IsEllipse() const { return ellipse; }
+
 		// Get the property set.
 		const Tmx::PropertySet &GetProperties() const { return properties; }
 
@@ -92,6 +102,7 @@ namespace Tmx
 
 		Tmx::Polygon *polygon;
 		Tmx::Polyline *polyline;
+		bool ellipse;
 
 		Tmx::PropertySet properties;
 	};
@@ -25,10 +25,10 @@
 //
 // Author: Tamir Atias
 //-----------------------------------------------------------------------------
-#include <tinyxml.h>
-
+#include "TmxBinary.h"
 #include "TmxObjectGroup.h"
 #include "TmxObject.h"
+#include "TmxXmlReader.h"
 
 namespace Tmx 
 {
@@ -36,6 +36,7 @@ namespace Tmx
 		: name()
 		, width(0)
 		, height(0)
+		, visible(1)
 	{}
 
 	ObjectGroup::~ObjectGroup() 
@@ -47,29 +48,62 @@ namespace Tmx
 		}
 	}
 
-	void ObjectGroup::Parse(const TiXmlNode *objectGroupNode) 
+	void ObjectGroup::Parse(XmlReader &reader) 
 	{
-		const TiXmlElement *objectGroupElem = objectGroupNode->ToElement();
+		const int depth = reader.GetDepth();
 
 		// Read the object group attributes.
-		name = objectGroupElem->Attribute("name");
+		reader.Attribute("name", &name);
 		
-		objectGroupElem->Attribute("width", &width);
-		objectGroupElem->Attribute("height", &height);
-		objectGroupElem->Attribute("visible", &visible);
+		reader.Attribute("width", &width);
+		reader.Attribute("height", &height);
+		reader.Attribute("visible", &visible);
 
 		// Iterate through all of the object elements.
-		const TiXmlNode *objectNode = objectGroupNode->FirstChild("object");
-		while (objectNode) 
+		while (reader.NextChild(depth)) 
 		{
+			if (!reader.IsNamed("object"))
+			{
+				continue;
+			}
+
 			// Allocate a new object and parse it.
 			Object *object = new Object();
-			object->Parse(objectNode);
+			object->Parse(reader);
 			
 			// Add the object to the list.
 			objects.push_back(object);
+		}
+	}
 
-			objectNode = objectGroupNode->IterateChildren("object", objectNode);
+	void ObjectGroup::WriteBinary(BinaryWriter &writer) const 
+	{
+		writer.WriteString(name);
+		writer.WriteInt(width);
+		writer.WriteInt(height);
+		writer.WriteInt(visible);
+
+		writer.WriteInt(objects.size());
+		for (std::size_t i = 0; i < objects.size(); i++) 
+		{
+			objects[i]->WriteBinary(writer);
+		}
+	}
+
+	void ObjectGroup::ParseBinary(BinaryReader &reader) 
+	{
+		name = reader.ReadString();
+		width = reader.ReadInt();
+		height = reader.ReadInt();
+		visible = reader.ReadInt();
+
+		// Eleven values each, at the least.
+		const int objectCount = reader.ReadCount(44);
+		for (int i = 0; i < objectCount; i++) 
+		{
+			Object *object = new Object();
+			object->ParseBinary(reader);
+			objects.push_back(object);
 		}
 	}
 
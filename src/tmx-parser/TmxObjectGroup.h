@@ -30,10 +30,11 @@
 #include <string>
 #include <vector>
 
-class TiXmlNode;
-
 namespace Tmx 
 {
+	class BinaryReader;
+	class BinaryWriter;
+	class XmlReader;
 	class Object;
 	
 	//-------------------------------------------------------------------------
@@ -47,7 +48,13 @@ namespace Tmx
 		~ObjectGroup();
 
 		// Parse an objectgroup node.
-		void Parse(const TiXmlNode *objectGroupNode);
+		void Parse(XmlReader &reader);
+
+		// Write the object group in the binary format.
+		void WriteBinary(BinaryWriter &writer) const;
+
+		// Read the object group back from the binary format.
+		void ParseBinary(BinaryReader &reader);
 
 		// Get the name of the object group.
 		const std::string &GetName() const { return name; }
@@ -31,10 +31,12 @@
 
 #include "TmxPoint.h"
 
-class TiXmlNode;
-
 namespace Tmx
 {
+	class BinaryReader;
+	class BinaryWriter;
+	class XmlReader;
+
 	//-------------------------------------------------------------------------
 	// Class to store a Polygon of an Object.
 	//-------------------------------------------------------------------------
@@ -44,7 +46,13 @@ namespace Tmx
 		Polygon();
 
 		// Parse the polygon node.
-		void Parse(const TiXmlNode *polygonNode);
+		void Parse(XmlReader &reader);
+
+		// Write the polygon in the binary format.
+		void WriteBinary(BinaryWriter &writer) const;
+
+		// Read the polygon back from the binary format.
+		void ParseBinary(BinaryReader &reader);
 
 		// Get one of the vertices.
 		const Tmx::Point &GetPoint(int index) const { return points[index]; }
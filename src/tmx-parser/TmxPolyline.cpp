@@ -25,9 +25,14 @@
 //
 // Author: Tamir Atias
 //-----------------------------------------------------------------------------
-#include <tinyxml.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
 
+#include "TmxBinary.h"
 #include "TmxPolyline.h"
+#include "TmxXmlReader.h"
 
 namespace Tmx 
 {
@@ -36,9 +41,12 @@ namespace Tmx
 	{
 	}
 
-	void Polyline::Parse(const TiXmlNode *polylineNode)
+	void Polyline::Parse(XmlReader &reader)
 	{
-		char *pointsLine = strdup(polylineNode->ToElement()->Attribute("points"));
+		std::string pointsText;
+		reader.Attribute("points", &pointsText);
+
+		char *pointsLine = strdup(pointsText.c_str());
 		
 		char *token = strtok(pointsLine, " ");
 		while (token)
@@ -53,4 +61,25 @@ namespace Tmx
 
 		free(pointsLine);
 	}
+
+	void Polyline::WriteBinary(BinaryWriter &writer) const
+	{
+		writer.WriteInt(points.size());
+		for (size_t i = 0; i < points.size(); ++i)
+		{
+			writer.WriteInt(points[i].x);
+			writer.WriteInt(points[i].y);
+		}
+	}
+
+	void Polyline::ParseBinary(BinaryReader &reader)
+	{
+		const int count = reader.ReadCount(sizeof(Point));
+		points.resize(count);
+		for (int i = 0; i < count; ++i)
+		{
+			points[i].x = reader.ReadInt();
+			points[i].y = reader.ReadInt();
+		}
+	}
 }
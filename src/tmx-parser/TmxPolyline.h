@@ -31,10 +31,12 @@
 
 #include "TmxPoint.h"
 
-class TiXmlNode;
-
 namespace Tmx
 {
+	class BinaryReader;
+	class BinaryWriter;
+	class XmlReader;
+
 	//-------------------------------------------------------------------------
 	// Class to store a Polyline of an Object.
 	//-------------------------------------------------------------------------
@@ -44,7 +46,13 @@ namespace Tmx
 		Polyline();
 
 		// Parse the polyline node.
-		void Parse(const TiXmlNode *polylineNode);
+		void Parse(XmlReader &reader);
+
+		// Write the polyline in the binary format.
+		void WriteBinary(BinaryWriter &writer) const;
+
+		// Read the polyline back from the binary format.
+		void ParseBinary(BinaryReader &reader);
 
 		// Get one of the vertices.
 		const Tmx::Point &GetPoint(int index) const { return points[index]; }
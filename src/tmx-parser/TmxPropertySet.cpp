@@ -25,9 +25,9 @@
 //
 // Author: Tamir Atias
 //-----------------------------------------------------------------------------
-#include <tinyxml.h>
-
+#include "TmxBinary.h"
 #include "TmxPropertySet.h"
+#include "TmxXmlReader.h"
 
 using std::string;
 using std::map;
@@ -38,24 +38,51 @@ namespace Tmx
 	PropertySet::PropertySet() : properties()  
 	{}
 
-	void PropertySet::Parse(const TiXmlNode *propertiesNode) 
+	void PropertySet::Parse(XmlReader &reader) 
 	{
-		// Iterate through all of the property nodes.
-		const TiXmlNode *propertyNode = propertiesNode->FirstChild("property");
+		// Iterate through all of the property elements.
+		const int depth = reader.GetDepth();
 		string propertyName;
 		string propertyValue;
 
-		while (propertyNode) 
+		while (reader.NextChild(depth)) 
 		{
-			const TiXmlElement* propertyElem = propertyNode->ToElement();
+			if (!reader.IsNamed("property"))
+			{
+				continue;
+			}
 
 			// Read the attributes of the property and add it to the map
-			propertyName = string(propertyElem->Attribute("name"));
-			propertyValue = string(propertyElem->Attribute("value"));
+			propertyName.clear();
+			propertyValue.clear();
+			reader.Attribute("name", &propertyName);
+			reader.Attribute("value", &propertyValue);
 			properties[propertyName] = propertyValue;
-			
-			propertyNode = propertiesNode->IterateChildren(
-				"property", propertyNode);
+		}
+	}
+
+	void PropertySet::WriteBinary(BinaryWriter &writer) const 
+	{
+		writer.WriteInt(properties.size());
+
+		map< string, string >::const_iterator iter;
+		for (iter = properties.begin(); iter != properties.end(); ++iter) 
+		{
+			writer.WriteString(iter->first);
+			writer.WriteString(iter->second);
+		}
+	}
+
+	void PropertySet::ParseBinary(BinaryReader &reader) 
+	{
+		// A name and a value each.
+		const int count = reader.ReadCount(8);
+
+		for (int i = 0; i < count; ++i) 
+		{
+			// The properties were written in order, so each goes at the end.
+			const string &propertyName = reader.ReadString();
+			properties.insert(properties.end(), std::make_pair(propertyName, reader.ReadString()));
 		}
 	}
 
@@ -30,10 +30,12 @@
 #include <map>
 #include <string>
 
-class TiXmlNode;
-
 namespace Tmx 
 {
+	class BinaryReader;
+	class BinaryWriter;
+	class XmlReader;
+
 	//-----------------------------------------------------------------------------
 	// This class contains a map of properties.
 	//-----------------------------------------------------------------------------
@@ -43,7 +45,13 @@ namespace Tmx
 		PropertySet();
 
 		// Parse a node containing all the property nodes.
-		void Parse(const TiXmlNode *propertiesNode);
+		void Parse(XmlReader &reader);
+
+		// Write the property set in the binary format.
+		void WriteBinary(BinaryWriter &writer) const;
+
+		// Read the property set back from the binary format.
+		void ParseBinary(BinaryReader &reader);
 	
 		// Get a numeric property (integer).
 		int GetNumericProperty(const std::string &name) const;
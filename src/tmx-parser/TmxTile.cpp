@@ -25,31 +25,81 @@
 //
 // Author: Tamir Atias
 //-----------------------------------------------------------------------------
-#include <tinyxml.h>
-
+#include "TmxBinary.h"
 #include "TmxTile.h"
+#include "TmxXmlReader.h"
 
 namespace Tmx 
 {
-	Tile::Tile() : properties()
+	Tile::Tile() : id(0), animation(), properties()
 	{}
 
 	Tile::~Tile() 
 	{}
 
-	void Tile::Parse(const TiXmlNode *tileNode) 
+	void Tile::Parse(XmlReader &reader) 
 	{
-		const TiXmlElement *tileElem = tileNode->ToElement();
+		const int depth = reader.GetDepth();
 
 		// Parse the attributes.
-		tileElem->Attribute("id", &id);
+		reader.Attribute("id", &id);
+
+		animation.clear();
+
+		while (reader.NextChild(depth)) 
+		{
+			// Parse the properties if any.
+			if (reader.IsNamed("properties"))
+			{
+				properties.Parse(reader);
+			}
+			// Parse the animation if any.
+			else if (reader.IsNamed("animation"))
+			{
+				const int animationDepth = reader.GetDepth();
+				while (reader.NextChild(animationDepth)) 
+				{
+					if (!reader.IsNamed("frame"))
+					{
+						continue;
+					}
+
+					AnimationFrame frame = { 0, 0 };
+					reader.Attribute("tileid", &frame.tileId);
+					reader.Attribute("duration", &frame.duration);
+
+					animation.push_back(frame);
+				}
+			}
+		}
+	}
+
+	void Tile::WriteBinary(BinaryWriter &writer) const 
+	{
+		writer.WriteInt(id);
 
-		// Parse the properties if any.
-		const TiXmlNode *propertiesNode = tileNode->FirstChild("properties");
-		
-		if (propertiesNode) 
+		writer.WriteInt(animation.size());
+		for (size_t i = 0; i < animation.size(); ++i) 
 		{
-			properties.Parse(propertiesNode);
+			writer.WriteInt(animation[i].tileId);
+			writer.WriteInt(animation[i].duration);
 		}
+
+		properties.WriteBinary(writer);
+	}
+
+	void Tile::ParseBinary(BinaryReader &reader) 
+	{
+		id = reader.ReadInt();
+
+		const int frameCount = reader.ReadCount(sizeof(AnimationFrame));
+		animation.resize(frameCount);
+		for (int i = 0; i < frameCount; ++i) 
+		{
+			animation[i].tileId = reader.ReadInt();
+			animation[i].duration = reader.ReadInt();
+		}
+
+		properties.ParseBinary(reader);
 	}
 };
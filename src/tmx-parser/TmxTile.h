@@ -27,10 +27,28 @@
 //-----------------------------------------------------------------------------
 #pragma once
 
+#include <vector>
+
 #include "TmxPropertySet.h"
 
 namespace Tmx 
 {
+	class BinaryReader;
+	class BinaryWriter;
+	class XmlReader;
+
+	//-------------------------------------------------------------------------
+	// A frame of a tile animation.
+	//-------------------------------------------------------------------------
+	struct AnimationFrame
+	{
+		// Id of the tile shown during the frame. (relative to the tileset)
+		int tileId;
+
+		// Duration of the frame in milliseconds.
+		int duration;
+	};
+
 	//-------------------------------------------------------------------------
 	// Class to contain information about every tile in the tileset/tiles 
 	// element.
@@ -45,7 +63,13 @@ namespace Tmx
 		~Tile();
 	
 		// Parse a tile node.
-		void Parse(const TiXmlNode *tileNode);
+		void Parse(XmlReader &reader);
+
+		// Write the tile in the binary format.
+		void WriteBinary(BinaryWriter &writer) const;
+
+		// Read the tile back from the binary format.
+		void ParseBinary(BinaryReader &reader);
 		
 		// Get the Id. (relative to the tilset)
 		int GetId() const { return id; }
@@ -53,9 +77,17 @@ namespace Tmx
 		// Get a set of properties regarding the tile.
 		const Tmx::PropertySet &GetProperties() const { return properties; }
 
+		// Get the animation frames of the tile. (empty if not animated)
+		const std::vector< Tmx::AnimationFrame > &GetAnimation() const { return animation; }
+
+		// Returns true if the tile has an animation.
+		bool IsAnimated() const { return !animation.empty(); }
+
 	private:
 		int id;
 
+		std::vector< Tmx::AnimationFrame > animation;
+
 		Tmx::PropertySet properties;
 	};
 };
\ No newline at end of file
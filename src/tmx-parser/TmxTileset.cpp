@@ -25,11 +25,12 @@
 //
 // Author: Tamir Atias
 //-----------------------------------------------------------------------------
-#include <tinyxml.h>
-
+#include "TmxBinary.h"
 #include "TmxTileset.h"
 #include "TmxImage.h"
 #include "TmxTile.h"
+#include "TmxUtil.h"
+#include "TmxXmlReader.h"
 
 using std::vector;
 using std::string;
@@ -71,73 +72,133 @@ namespace Tmx
 		}
 	}
 
-	void Tileset::Parse(const TiXmlNode *tilesetNode) 
+	void Tileset::Parse(XmlReader &reader) 
 	{
-		const TiXmlElement *tilesetElem = tilesetNode->ToElement();
-
 		// Will always be present
-		tilesetElem->Attribute("firstgid", &first_gid);
+		reader.Attribute("firstgid", &first_gid);
 
-		// Check if external source, and if so adjust
-		const char* sourceFile = tilesetElem->Attribute("source");
-		if ( sourceFile )
+		// Check if external source, and if so read the tileset from it instead
+		if (reader.Attribute("source", &source))
 		{
-			source = sourceFile;
+			MappedFile file;
+			if (!file.Open(source))
+			{
+				return;
+			}
+
+			XmlReader sourceReader(file.GetData(), file.GetSize());
 
-			// Open the tileset file
-			TiXmlDocument xmlSource;
-			xmlSource.LoadFile( sourceFile );
+			XmlReader::NodeType node;
+			do
+			{
+				node = sourceReader.Next();
+			}
+			while (node == XmlReader::XML_TEXT);
 
-			// Clone the XML and set the elem so it can continue as normal
-			tilesetNode = xmlSource.RootElement()->Clone();
-			tilesetElem = tilesetNode->ToElement();
+			if (node == XmlReader::XML_START)
+			{
+				ParseElement(sourceReader);
+			}
+			return;
 		}
 
+		ParseElement(reader);
+	}
+
+	void Tileset::ParseElement(XmlReader &reader) 
+	{
+		const int depth = reader.GetDepth();
+
 		// Read all the attributes into local variables.
 		
-		tilesetElem->Attribute("tilewidth", &tile_width);
-		tilesetElem->Attribute("tileheight", &tile_height);
-		tilesetElem->Attribute("margin", &margin);
-		tilesetElem->Attribute("spacing", &spacing);
+		reader.Attribute("tilewidth", &tile_width);
+		reader.Attribute("tileheight", &tile_height);
+		reader.Attribute("margin", &margin);
+		reader.Attribute("spacing", &spacing);
 
-		name = tilesetElem->Attribute("name");
+		reader.Attribute("name", &name);
 
-		// Parse the image.
-		const TiXmlNode *imageNode = tilesetNode->FirstChild("image");
-		
-		if (imageNode) 
+		while (reader.NextChild(depth)) 
 		{
-			image = new Image();
-			image->Parse(imageNode);
+			// Parse the image.
+			if (reader.IsNamed("image"))
+			{
+				delete image;
+				image = new Image();
+				image->Parse(reader);
+			}
+			// Parse every tile element.
+			else if (reader.IsNamed("tile"))
+			{
+				// Allocate a new tile and parse it.
+				Tile *tile = new Tile();
+				tile->Parse(reader);
+
+				// Add the tile to the collection.
+				tiles.push_back(tile);
+			}
+			// Parse the properties if any.
+			else if (reader.IsNamed("properties"))
+			{
+				properties.Parse(reader);
+			}
 		}
+	}
 
-		// Iterate through all of the tile elements and parse each.
-		const TiXmlNode *tileNode = tilesetNode->FirstChild("tile");
-		while (tileNode)
-		{
-			// Allocate a new tile and parse it.
-			Tile *tile = new Tile();
-			tile->Parse(tileNode);
+	void Tileset::WriteBinary(BinaryWriter &writer) const 
+	{
+		writer.WriteInt(first_gid);
+		writer.WriteString(name);
+		writer.WriteString(source);
 
-			// Add the tile to the collection.
-			tiles.push_back(tile);
+		writer.WriteInt(tile_width);
+		writer.WriteInt(tile_height);
+		writer.WriteInt(margin);
+		writer.WriteInt(spacing);
 
-			tileNode = tilesetNode->IterateChildren("tile", tileNode);
+		writer.WriteInt(image != NULL);
+		if (image) 
+		{
+			image->WriteBinary(writer);
 		}
-		
-		// Parse the properties if any.
-		const TiXmlNode *propertiesNode = tilesetNode->FirstChild("properties");
-		
-		if (propertiesNode) 
+
+		writer.WriteInt(tiles.size());
+		for (size_t i = 0; i < tiles.size(); ++i) 
+		{
+			tiles[i]->WriteBinary(writer);
+		}
+
+		properties.WriteBinary(writer);
+	}
+
+	void Tileset::ParseBinary(BinaryReader &reader) 
+	{
+		first_gid = reader.ReadInt();
+		name = reader.ReadString();
+		source = reader.ReadString();
+
+		tile_width = reader.ReadInt();
+		tile_height = reader.ReadInt();
+		margin = reader.ReadInt();
+		spacing = reader.ReadInt();
+
+		if (reader.ReadInt()) 
 		{
-			properties.Parse(propertiesNode);
+			delete image;
+			image = new Image();
+			image->ParseBinary(reader);
 		}
 
-		// Clean up the source file (if applciable)
-		if ( sourceFile ) 
+		// An id and two counts each.
+		const int tileCount = reader.ReadCount(12);
+		for (int i = 0; i < tileCount; ++i) 
 		{
-			delete tilesetNode;
+			Tile *tile = new Tile();
+			tile->ParseBinary(reader);
+			tiles.push_back(tile);
 		}
+
+		properties.ParseBinary(reader);
 	}
 
 	const Tile *Tileset::GetTile(int index) const 
@@ -32,10 +32,11 @@
 
 #include "TmxPropertySet.h"
 
-class TiXmlNode;
-
 namespace Tmx 
 {
+	class BinaryReader;
+	class BinaryWriter;
+	class XmlReader;
 	class Image;
 	class Tile;
 
@@ -51,7 +52,13 @@ namespace Tmx
 		~Tileset();
 
 		// Parse a tileset element.
-		void Parse(const TiXmlNode *tilesetNode);
+		void Parse(XmlReader &reader);
+
+		// Write the tileset in the binary format.
+		void WriteBinary(BinaryWriter &writer) const;
+
+		// Read the tileset back from the binary format.
+		void ParseBinary(BinaryReader &reader);
 
 		// Returns the global id of the first tile.
 		int GetFirstGid() const { return first_gid; }
@@ -88,6 +95,9 @@ namespace Tmx
 		const Tmx::PropertySet &GetProperties() const { return properties; }
 
 	private:
+		// Parse the attributes and children of a tileset element.
+		void ParseElement(XmlReader &reader);
+
 		int first_gid;
 		
 		std::string name;
@@ -25,9 +25,17 @@
 //
 // Author: Tamir Atias
 //-----------------------------------------------------------------------------
+#include <stdio.h>
 #include <stdlib.h>
 #include <zlib.h>
 
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
 #include "TmxUtil.h"
 #include "base64.h"
 
@@ -37,71 +45,152 @@ namespace Tmx {
 		return base64_decode(str);
 	}
 
-	char *Util::DecompressGZIP(const char *data, int dataSize, int expectedSize) 
+	size_t Util::DecodeBase64(const char *str, size_t length, void *out, size_t outSize)
+	{
+		return base64_decode(str, length, (unsigned char *)out, outSize);
+	}
+
+	bool Util::Inflate(const void *data, size_t dataSize, void *out, size_t outSize)
 	{
-		int bufferSize = expectedSize;
-		int ret;
 		z_stream strm;
-		char *out = (char*)malloc(bufferSize);
 
 		strm.zalloc = Z_NULL;
 		strm.zfree = Z_NULL;
 		strm.opaque = Z_NULL;
-		strm.next_in = (Bytef*)data;
-		strm.avail_in = dataSize;
-		strm.next_out = (Bytef*)out;
-		strm.avail_out = bufferSize;
+		strm.next_in = (Bytef *)data;
+		strm.avail_in = (uInt)dataSize;
+		strm.next_out = (Bytef *)out;
+		strm.avail_out = (uInt)outSize;
+
+		// Detect either header.
+		if (inflateInit2(&strm, 15 + 32) != Z_OK)
+		{
+			return false;
+		}
+
+		// The output is already the right size, so the whole stream is inflated at once.
+		const int ret = inflate(&strm, Z_FINISH);
+		const bool filled = ret == Z_STREAM_END && strm.total_out == outSize;
 
-		ret = inflateInit2(&strm, 15 + 32);
+		inflateEnd(&strm);
+		return filled;
+	}
+
+	char *Util::DecompressGZIP(const char *data, int dataSize, int expectedSize) 
+	{
+		char *out = (char *)malloc(expectedSize);
 
-		if (ret != Z_OK) 
+		if (out && !Inflate(data, dataSize, out, expectedSize))
 		{
 			free(out);
 			return NULL;
 		}
 
-		do 
+		return out;
+	}
+
+	MappedFile::MappedFile() 
+		: data(NULL)
+		, size(0)
+	{
+	}
+
+	MappedFile::~MappedFile() 
+	{
+		Close();
+	}
+
+#ifndef _WIN32
+	bool MappedFile::Open(const std::string &fileName, MappedFileAccess access) 
+	{
+		Close();
+
+		const int fd = open(fileName.c_str(), O_RDONLY);
+		if (fd == -1)
 		{
-			ret = inflate(&strm, Z_SYNC_FLUSH);
+			return false;
+		}
 
-			switch (ret) 
+		struct stat info;
+		if (fstat(fd, &info) == -1)
+		{
+			close(fd);
+			return false;
+		}
+
+		size = (size_t)info.st_size;
+		if (size > 0)
+		{
+			void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping == MAP_FAILED)
 			{
-				case Z_NEED_DICT:
-				case Z_STREAM_ERROR:
-					ret = Z_DATA_ERROR;
-				case Z_DATA_ERROR:
-				case Z_MEM_ERROR:
-					inflateEnd(&strm);
-					free(out);
-					return NULL;
+				size = 0;
+				close(fd);
+				return false;
 			}
 
-			if (ret != Z_STREAM_END) 
+			// Files read front to back once can have the pages behind the reader dropped.
+			if (access == TMX_ACCESS_SEQUENTIAL)
 			{
-				out = (char *) realloc(out, bufferSize * 2);
-
-				if (!out) 
-				{
-					inflateEnd(&strm);
-					free(out);
-					return NULL;
-				}
-
-				strm.next_out = (Bytef *)(out + bufferSize);
-				strm.avail_out = bufferSize;
-				bufferSize *= 2;
+				madvise(mapping, size, MADV_SEQUENTIAL);
 			}
+			data = (const char *)mapping;
 		}
-		while (ret != Z_STREAM_END);
 
-		if (strm.avail_in != 0) 
+		// The mapping stays valid without the descriptor.
+		close(fd);
+		return true;
+	}
+
+	void MappedFile::Close() 
+	{
+		if (data)
 		{
-			free(out);
-			return NULL;
+			munmap((void *)data, size);
 		}
 
-		inflateEnd(&strm);
+		data = NULL;
+		size = 0;
+	}
+#else
+	bool MappedFile::Open(const std::string &fileName, MappedFileAccess access) 
+	{
+		Close();
 
-		return out;
+		FILE *file = fopen(fileName.c_str(), "rb");
+		if (!file)
+		{
+			return false;
+		}
+
+		fseek(file, 0, SEEK_END);
+		const long fileSize = ftell(file);
+		fseek(file, 0, SEEK_SET);
+
+		if (fileSize > 0)
+		{
+			char *buffer = (char *)malloc(fileSize);
+			if (!buffer || fread(buffer, 1, fileSize, file) != (size_t)fileSize)
+			{
+				free(buffer);
+				fclose(file);
+				return false;
+			}
+
+			data = buffer;
+			size = (size_t)fileSize;
+		}
+
+		fclose(file);
+		return true;
+	}
+
+	void MappedFile::Close() 
+	{
+		free((void *)data);
+
+		data = NULL;
+		size = 0;
 	}
+#endif
 };
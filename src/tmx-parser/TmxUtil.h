@@ -27,6 +27,7 @@
 //-----------------------------------------------------------------------------
 #pragma once
 
+#include <stddef.h>
 #include <string>
 
 namespace Tmx 
@@ -37,7 +38,59 @@ namespace Tmx
 		// Decode a base-64 encoded string.
 		static std::string DecodeBase64(const std::string &str);
 
-		// Decompress a gzip encoded byte array.
+		// Decode base-64 text straight into a buffer.
+		// Returns the number of bytes written, at most outSize.
+		static size_t DecodeBase64(const char *str, size_t length, void *out, size_t outSize);
+
+		// Inflate a zlib or gzip stream into a buffer in a single call.
+		// Fails unless the stream fills exactly outSize bytes.
+		static bool Inflate(const void *data, size_t dataSize, void *out, size_t outSize);
+
+		// Decompress a gzip encoded byte array of exactly expectedSize bytes.
+		// Returns NULL when it is not, the array must be freed with free().
 		static char* DecompressGZIP(const char *data, int dataSize, int expectedSize);
 	};
+
+	//-------------------------------------------------------------------------
+	// How a mapped file is going to be read.
+	//-------------------------------------------------------------------------
+	enum MappedFileAccess 
+	{
+		// Read front to back once, pages behind the reader can be dropped.
+		TMX_ACCESS_SEQUENTIAL,
+
+		// Kept mapped and read in any order, paged as the system sees fit.
+		TMX_ACCESS_NORMAL
+	};
+
+	//-------------------------------------------------------------------------
+	// A whole file mapped read-only into memory.
+	// Where files cannot be mapped, it is read into memory instead.
+	//-------------------------------------------------------------------------
+	class MappedFile 
+	{
+	private:
+		// Prevent copy constructor.
+		MappedFile(const MappedFile &_file);
+
+	public:
+		MappedFile();
+		~MappedFile();
+
+		// Map a file, returns false if it could not be opened.
+		bool Open(const std::string &fileName, MappedFileAccess access = TMX_ACCESS_SEQUENTIAL);
+
+		// Unmap the file.
+		void Close();
+
+		// Get the contents of the file, NULL when it is empty.
+		const char *GetData() const { return data; }
+
+		// Get the size of the file.
+		size_t GetSize() const { return size; }
+
+	private:
+		const char *data;
+		size_t size;
+	};
 };
\ No newline at end of file
@@ -0,0 +1,545 @@
+//-----------------------------------------------------------------------------
+// TmxXmlReader.cpp
+//
+// Copyright (c) 2010-2012, Tamir Atias
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL TAMIR ATIAS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Tamir Atias
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TmxXmlReader.h"
+
+namespace Tmx 
+{
+	static bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+	}
+
+	static bool IsNameEnd(char c)
+	{
+		return IsSpace(c) || c == '=' || c == '>' || c == '/';
+	}
+
+	// Find a string within [from, to), NULL if it is not there.
+	static const char *Find(const char *from, const char *to, const char *str)
+	{
+		const size_t length = strlen(str);
+
+		while (to - from >= (ptrdiff_t)length)
+		{
+			const char *found = (const char *)memchr(from, str[0], to - from - length + 1);
+			if (!found)
+			{
+				return NULL;
+			}
+
+			if (!memcmp(found, str, length))
+			{
+				return found;
+			}
+
+			from = found + 1;
+		}
+
+		return NULL;
+	}
+
+	static bool StartsWith(const char *from, const char *to, const char *str)
+	{
+		const size_t length = strlen(str);
+		return to - from >= (ptrdiff_t)length && !memcmp(from, str, length);
+	}
+
+	// Append a character reference to a string, UTF-8 encoded.
+	static void AppendCodePoint(std::string *out, unsigned long c)
+	{
+		if (c < 0x80)
+		{
+			*out += (char)c;
+		}
+		else if (c < 0x800)
+		{
+			*out += (char)(0xC0 | (c >> 6));
+			*out += (char)(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000)
+		{
+			*out += (char)(0xE0 | (c >> 12));
+			*out += (char)(0x80 | ((c >> 6) & 0x3F));
+			*out += (char)(0x80 | (c & 0x3F));
+		}
+		else
+		{
+			*out += (char)(0xF0 | (c >> 18));
+			*out += (char)(0x80 | ((c >> 12) & 0x3F));
+			*out += (char)(0x80 | ((c >> 6) & 0x3F));
+			*out += (char)(0x80 | (c & 0x3F));
+		}
+	}
+
+	XmlReader::XmlReader(const char *text, size_t length)
+		: begin(text)
+		, cursor(text)
+		, end(text + length)
+		, type(XML_NONE)
+		, depth(0)
+		, pending_end(false)
+		, name_begin(text)
+		, name_end(text)
+		, attributes()
+		, text_begin(text)
+		, text_end(text)
+		, open()
+		, error_text()
+	{
+	}
+
+	XmlReader::NodeType XmlReader::Next()
+	{
+		if (type == XML_ERROR || type == XML_END_OF_DOCUMENT)
+		{
+			return type;
+		}
+
+		// The end of an empty element tag.
+		if (pending_end)
+		{
+			pending_end = false;
+			attributes.clear();
+			return type = XML_END;
+		}
+
+		while (cursor < end)
+		{
+			if (*cursor != '<')
+			{
+				// Text, unless there is nothing but whitespace before the next tag.
+				const char *start = cursor;
+				const char *tag = (const char *)memchr(cursor, '<', end - cursor);
+				cursor = tag ? tag : end;
+
+				for (const char *c = start; c < cursor; ++c)
+				{
+					if (!IsSpace(*c))
+					{
+						text_begin = start;
+						text_end = cursor;
+						depth = (int)open.size();
+						return type = XML_TEXT;
+					}
+				}
+
+				continue;
+			}
+
+			if (StartsWith(cursor, end, "<!--"))
+			{
+				const char *close = Find(cursor + 4, end, "-->");
+				if (!close)
+				{
+					return Error("Unterminated comment.");
+				}
+
+				cursor = close + 3;
+			}
+			else if (StartsWith(cursor, end, "<![CDATA["))
+			{
+				const char *close = Find(cursor + 9, end, "]]>");
+				if (!close)
+				{
+					return Error("Unterminated CDATA section.");
+				}
+
+				text_begin = cursor + 9;
+				text_end = close;
+				cursor = close + 3;
+				depth = (int)open.size();
+				return type = XML_TEXT;
+			}
+			else if (StartsWith(cursor, end, "<?"))
+			{
+				const char *close = Find(cursor + 2, end, "?>");
+				if (!close)
+				{
+					return Error("Unterminated declaration.");
+				}
+
+				cursor = close + 2;
+			}
+			else if (StartsWith(cursor, end, "<!"))
+			{
+				const char *close = (const char *)memchr(cursor, '>', end - cursor);
+				if (!close)
+				{
+					return Error("Unterminated declaration.");
+				}
+
+				cursor = close + 1;
+			}
+			else
+			{
+				return ReadTag();
+			}
+		}
+
+		if (!open.empty())
+		{
+			return Error("Unexpected end of the document.");
+		}
+
+		return type = XML_END_OF_DOCUMENT;
+	}
+
+	XmlReader::NodeType XmlReader::ReadTag()
+	{
+		const bool isEnd = cursor + 1 < end && cursor[1] == '/';
+		cursor += isEnd ? 2 : 1;
+
+		// Read the name.
+		name_begin = cursor;
+		while (cursor < end && !IsNameEnd(*cursor))
+		{
+			++cursor;
+		}
+		name_end = cursor;
+
+		if (name_begin == name_end)
+		{
+			return Error("Missing element name.");
+		}
+
+		attributes.clear();
+
+		if (isEnd)
+		{
+			while (cursor < end && IsSpace(*cursor))
+			{
+				++cursor;
+			}
+
+			if (cursor == end || *cursor != '>')
+			{
+				return Error("Malformed end tag.");
+			}
+			++cursor;
+
+			if (open.empty() || 
+				open.back().second - open.back().first != name_end - name_begin ||
+				memcmp(open.back().first, name_begin, name_end - name_begin))
+			{
+				return Error("Mismatched end tag.");
+			}
+
+			depth = (int)open.size();
+			open.pop_back();
+			return type = XML_END;
+		}
+
+		// Read the attributes up to the end of the tag.
+		for (;;)
+		{
+			while (cursor < end && IsSpace(*cursor))
+			{
+				++cursor;
+			}
+
+			if (cursor == end)
+			{
+				return Error("Unterminated start tag.");
+			}
+
+			if (*cursor == '>')
+			{
+				++cursor;
+				open.push_back(std::make_pair(name_begin, name_end));
+				depth = (int)open.size();
+				return type = XML_START;
+			}
+
+			if (*cursor == '/')
+			{
+				if (cursor + 1 == end || cursor[1] != '>')
+				{
+					return Error("Malformed empty element tag.");
+				}
+
+				cursor += 2;
+				depth = (int)open.size() + 1;
+				pending_end = true;
+				return type = XML_START;
+			}
+
+			Attr attr;
+			attr.name_begin = cursor;
+			while (cursor < end && !IsNameEnd(*cursor))
+			{
+				++cursor;
+			}
+			attr.name_end = cursor;
+
+			while (cursor < end && IsSpace(*cursor))
+			{
+				++cursor;
+			}
+
+			if (attr.name_begin == attr.name_end || cursor == end || *cursor != '=')
+			{
+				return Error("Malformed attribute.");
+			}
+			++cursor;
+
+			while (cursor < end && IsSpace(*cursor))
+			{
+				++cursor;
+			}
+
+			if (cursor == end || (*cursor != '"' && *cursor != '\''))
+			{
+				return Error("Unquoted attribute value.");
+			}
+
+			const char *close = (const char *)memchr(cursor + 1, *cursor, end - cursor - 1);
+			if (!close)
+			{
+				return Error("Unterminated attribute value.");
+			}
+
+			attr.value_begin = cursor + 1;
+			attr.value_end = close;
+			attributes.push_back(attr);
+
+			cursor = close + 1;
+		}
+	}
+
+	bool XmlReader::NextChild(int parentDepth)
+	{
+		for (;;)
+		{
+			switch (Next())
+			{
+			case XML_START:
+				if (depth == parentDepth + 1)
+				{
+					return true;
+				}
+				break;
+
+			case XML_END:
+				if (depth <= parentDepth)
+				{
+					return false;
+				}
+				break;
+
+			case XML_END_OF_DOCUMENT:
+			case XML_ERROR:
+				return false;
+
+			default:
+				break;
+			}
+		}
+	}
+
+	void XmlReader::ReadText(const char **text, size_t *length)
+	{
+		const int elementDepth = depth;
+		bool found = false;
+
+		*text = NULL;
+		*length = 0;
+
+		if (type != XML_START)
+		{
+			return;
+		}
+
+		for (;;)
+		{
+			switch (Next())
+			{
+			case XML_TEXT:
+				if (!found && depth == elementDepth)
+				{
+					*text = text_begin;
+					*length = text_end - text_begin;
+					found = true;
+				}
+				break;
+
+			case XML_END:
+				if (depth <= elementDepth)
+				{
+					return;
+				}
+				break;
+
+			case XML_END_OF_DOCUMENT:
+			case XML_ERROR:
+				return;
+
+			default:
+				break;
+			}
+		}
+	}
+
+	bool XmlReader::IsNamed(const char *name) const
+	{
+		const size_t length = strlen(name);
+		return (size_t)(name_end - name_begin) == length && !memcmp(name_begin, name, length);
+	}
+
+	const XmlReader::Attr *XmlReader::FindAttribute(const char *name) const
+	{
+		const size_t length = strlen(name);
+
+		for (size_t i = 0; i < attributes.size(); ++i)
+		{
+			const Attr &attr = attributes[i];
+			if ((size_t)(attr.name_end - attr.name_begin) == length && !memcmp(attr.name_begin, name, length))
+			{
+				return &attr;
+			}
+		}
+
+		return NULL;
+	}
+
+	bool XmlReader::Attribute(const char *name, std::string *value) const
+	{
+		const Attr *attr = FindAttribute(name);
+		if (!attr)
+		{
+			return false;
+		}
+
+		// Resolve the entity and character references.
+		value->clear();
+		for (const char *c = attr->value_begin; c < attr->value_end; ++c)
+		{
+			if (*c != '&')
+			{
+				*value += *c;
+				continue;
+			}
+
+			const char *semicolon = (const char *)memchr(c, ';', attr->value_end - c);
+			if (!semicolon)
+			{
+				*value += *c;
+				continue;
+			}
+
+			const std::string entity(c + 1, semicolon);
+			if (entity == "amp") *value += '&';
+			else if (entity == "lt") *value += '<';
+			else if (entity == "gt") *value += '>';
+			else if (entity == "quot") *value += '"';
+			else if (entity == "apos") *value += '\'';
+			else if (entity.size() > 2 && entity[0] == '#' && entity[1] == 'x') 
+				AppendCodePoint(value, strtoul(entity.c_str() + 2, NULL, 16));
+			else if (entity.size() > 1 && entity[0] == '#') 
+				AppendCodePoint(value, strtoul(entity.c_str() + 1, NULL, 10));
+			else
+			{
+				// Not a reference we know, keep it as it is.
+				value->append(c, semicolon + 1);
+			}
+
+			c = semicolon;
+		}
+
+		return true;
+	}
+
+	bool XmlReader::Attribute(const char *name, int *value) const
+	{
+		// The closing quote stops the conversion.
+		const Attr *attr = FindAttribute(name);
+		if (!attr)
+		{
+			return false;
+		}
+
+		char *last;
+		const long result = strtol(attr->value_begin, &last, 10);
+		if (last == attr->value_begin)
+		{
+			return false;
+		}
+
+		*value = (int)result;
+		return true;
+	}
+
+	bool XmlReader::Attribute(const char *name, double *value) const
+	{
+		const Attr *attr = FindAttribute(name);
+		if (!attr)
+		{
+			return false;
+		}
+
+		char *last;
+		const double result = strtod(attr->value_begin, &last);
+		if (last == attr->value_begin)
+		{
+			return false;
+		}
+
+		*value = result;
+		return true;
+	}
+
+	void XmlReader::SetError(const char *text)
+	{
+		if (type != XML_ERROR)
+		{
+			Error(text);
+		}
+	}
+
+	XmlReader::NodeType XmlReader::Error(const char *text)
+	{
+		// Count the lines up to the error.
+		int line = 1;
+		for (const char *c = begin; c < cursor && c < end; ++c)
+		{
+			if (*c == '\n')
+			{
+				++line;
+			}
+		}
+
+		char lineText[32];
+		sprintf(lineText, " (line %d)", line);
+
+		error_text = std::string(text) + lineText;
+		return type = XML_ERROR;
+	}
+};
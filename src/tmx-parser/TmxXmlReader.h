@@ -0,0 +1,140 @@
+//-----------------------------------------------------------------------------
+// TmxXmlReader.h
+//
+// Copyright (c) 2010-2012, Tamir Atias
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL TAMIR ATIAS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Tamir Atias
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace Tmx 
+{
+	//-------------------------------------------------------------------------
+	// Reads an XML document one node at a time, in place.
+	// Names, attribute values and text point into the document, which must
+	// outlive the reader. Nothing is built for the nodes that were read.
+	//-------------------------------------------------------------------------
+	class XmlReader 
+	{
+	private:
+		// Prevent copy constructor.
+		XmlReader(const XmlReader &_reader);
+
+	public:
+		//-------------------------------------------------------------------------
+		// Type of the node the reader is on.
+		//-------------------------------------------------------------------------
+		enum NodeType 
+		{
+			XML_NONE,
+			XML_START,
+			XML_END,
+			XML_TEXT,
+			XML_END_OF_DOCUMENT,
+			XML_ERROR
+		};
+
+		XmlReader(const char *text, size_t length);
+
+		// Move to the next start tag, end tag or text.
+		// Comments, declarations and whitespace between tags are skipped,
+		// an empty element tag gives a start and an end.
+		NodeType Next();
+
+		// Move to the next child element of the element at depth.
+		// Returns false at the end of that element, skipping whatever 
+		// was left of the previous child.
+		bool NextChild(int depth);
+
+		// Read up to the end of the current element.
+		// Gives the first text in it, as it is in the document.
+		void ReadText(const char **text, size_t *length);
+
+		// Get the type of the current node.
+		NodeType GetType() const { return type; }
+
+		// Get the depth of the current node, 1 for the root element.
+		int GetDepth() const { return depth; }
+
+		// Get whether the current element has a name.
+		bool IsNamed(const char *name) const;
+
+		// Get the name of the current element.
+		std::string GetName() const { return std::string(name_begin, name_end); }
+
+		// Read an attribute of the current start tag.
+		// These return false and leave the value alone when it is missing.
+		bool Attribute(const char *name, std::string *value) const;
+		bool Attribute(const char *name, int *value) const;
+		bool Attribute(const char *name, double *value) const;
+
+		// Set an error found in what was read, at the current line.
+		// The reader stops there, the first error is kept.
+		void SetError(const char *text);
+
+		// Get whether there was an error or not.
+		bool HasError() const { return type == XML_ERROR; }
+
+		// Get an error string containing the error and the line it is on.
+		const std::string &GetErrorText() const { return error_text; }
+
+	private:
+		struct Attr
+		{
+			const char *name_begin;
+			const char *name_end;
+			const char *value_begin;
+			const char *value_end;
+		};
+
+		// The raw value of an attribute, NULL when it is missing.
+		const Attr *FindAttribute(const char *name) const;
+
+		NodeType ReadTag();
+		NodeType Error(const char *text);
+
+		const char *begin;
+		const char *cursor;
+		const char *end;
+
+		NodeType type;
+		int depth;
+		bool pending_end;
+
+		const char *name_begin;
+		const char *name_end;
+		std::vector< Attr > attributes;
+
+		const char *text_begin;
+		const char *text_end;
+
+		// Names of the open elements, to match their end tags.
+		std::vector< std::pair< const char *, const char * > > open;
+
+		std::string error_text;
+	};
+};
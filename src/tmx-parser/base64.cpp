@@ -27,6 +27,7 @@
 
 #include "base64.h"
 #include <iostream>
+#include <string.h>
 
 static const std::string base64_chars = 
              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -120,4 +121,72 @@ std::string base64_decode(std::string const& encoded_string) {
   }
 
   return ret;
-}
\ No newline at end of file
+}
+
+namespace {
+  enum { BASE64_SKIP = 0x40, BASE64_STOP = 0x80 };
+
+  // Sextet of every character, BASE64_SKIP for whitespace and BASE64_STOP for the rest
+  struct base64_table {
+    unsigned char values[256];
+
+    base64_table() {
+      memset(values, BASE64_STOP, sizeof(values));
+      for (unsigned i = 0; i < base64_chars.size(); i++)
+        values[(unsigned char)base64_chars[i]] = (unsigned char)i;
+      values[(unsigned char)' '] = values[(unsigned char)'\t'] = BASE64_SKIP;
+      values[(unsigned char)'\n'] = values[(unsigned char)'\r'] = BASE64_SKIP;
+    }
+  };
+}
+
+size_t base64_decode(char const* in, size_t len, unsigned char* out, size_t out_len) {
+  static const base64_table table;
+  const unsigned char* t = table.values;
+
+  const unsigned char* p = (const unsigned char*)in;
+  const unsigned char* end = p + len;
+  unsigned char* o = out;
+  unsigned char* out_end = out + out_len;
+
+  for (;;) {
+    // Whole quads, as long as there is nothing to skip
+    while (end - p >= 4 && out_end - o >= 3) {
+      const unsigned a = t[p[0]], b = t[p[1]], c = t[p[2]], d = t[p[3]];
+      if ((a | b | c | d) & (BASE64_SKIP | BASE64_STOP))
+        break;
+
+      const unsigned v = (a << 18) | (b << 12) | (c << 6) | d;
+      o[0] = (unsigned char)(v >> 16);
+      o[1] = (unsigned char)(v >> 8);
+      o[2] = (unsigned char)v;
+      o += 3;
+      p += 4;
+    }
+
+    // One quad at a time past whitespace, up to the padding or the end
+    unsigned v = 0;
+    int n = 0;
+    while (n < 4 && p < end) {
+      const unsigned s = t[*p];
+      if (s == BASE64_SKIP) { p++; continue; }
+      if (s == BASE64_STOP) break;
+      v = (v << 6) | s;
+      n++;
+      p++;
+    }
+
+    if (n < 2)
+      break;
+
+    v <<= 6 * (4 - n);
+    const unsigned char bytes[3] = { (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v };
+    for (int i = 0; i < n - 1 && o < out_end; i++)
+      *o++ = bytes[i];
+
+    if (n < 4 || o == out_end)
+      break;
+  }
+
+  return o - out;
+}
@@ -27,9 +27,15 @@
 #ifndef TMXPARSER_BASE64_H_
 #define TMXPARSER_BASE64_H_
 
+#include <stddef.h>
 #include <string>
 
 std::string base64_encode(unsigned char const* , unsigned int len);
 std::string base64_decode(std::string const& s);
 
+// Decodes len characters of in straight into out, skipping whitespace and stopping
+// at the padding or the first character that is not base64.
+// Returns the number of bytes written, never more than out_len.
+size_t base64_decode(char const* in, size_t len, unsigned char* out, size_t out_len);
+
 #endif
\ No newline at end of file